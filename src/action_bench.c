@@ -0,0 +1,294 @@
+/* action_bench.c - Replay SOAP actions against the services offline.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Feeds SOAP action bodies directly to the action handlers of an offline
+// device (no network, "null" output) and reports latency and allocations
+// per action. Build with 'make action_bench'.
+//
+// Without a file, a built-in sequence of typical control point actions is
+// replayed. With --file, each line of the file is one SOAP action body
+// (the child of <s:Body>), e.g. captured from a control point, such as
+//   <u:Play xmlns:u="urn:schemas-upnp-org:service:AVTransport:1"><InstanceID>0</InstanceID><Speed>1</Speed></u:Play>
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <assert.h>
+#include <glib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <upnp.h>
+
+#include "bench_util.h"
+#include "logging.h"
+#include "metrics.h"
+#include "output.h"
+#include "upnp_compat.h"
+#include "upnp_device.h"
+#include "upnp_renderer.h"
+
+// -- Counting allocations. Only with glibc, which lets us forward to the
+// real implementation.
+static int count_allocations_ = 0;
+static uint64_t allocations_ = 0;
+static uint64_t allocated_bytes_ = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static void count_allocation(size_t size) {
+	if (count_allocations_) {
+		__atomic_add_fetch(&allocations_, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&allocated_bytes_, size, __ATOMIC_RELAXED);
+	}
+}
+void *malloc(size_t size) {
+	count_allocation(size);
+	return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+	count_allocation(n * size);
+	return __libc_calloc(n, size);
+}
+void *realloc(void *ptr, size_t size) {
+	count_allocation(size);
+	return __libc_realloc(ptr, size);
+}
+void free(void *ptr) {
+	__libc_free(ptr);
+}
+#  define HAVE_ALLOCATION_COUNT 1
+#else
+#  define HAVE_ALLOCATION_COUNT 0
+#endif
+
+#define AVT "xmlns:u=\"urn:schemas-upnp-org:service:AVTransport:1\""
+#define RCS "xmlns:u=\"urn:schemas-upnp-org:service:RenderingControl:1\""
+
+static const char *const kDefaultActions[] = {
+	"<u:SetAVTransportURI " AVT "><InstanceID>0</InstanceID>"
+	"<CurrentURI>http://192.168.1.10:8200/MediaItems/42.flac</CurrentURI>"
+	"<CurrentURIMetaData>&lt;DIDL-Lite xmlns=\"urn:schemas-upnp-org:"
+	"metadata-1-0/DIDL-Lite/\" xmlns:dc=\"http://purl.org/dc/elements/1.1/\""
+	" xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\"&gt;&lt;item "
+	"id=\"64$0$1\" parentID=\"64$0\" restricted=\"1\"&gt;&lt;dc:title&gt;"
+	"Some Song&lt;/dc:title&gt;&lt;upnp:artist&gt;Some Artist&lt;/upnp:"
+	"artist&gt;&lt;upnp:album&gt;Some Album&lt;/upnp:album&gt;&lt;upnp:"
+	"class&gt;object.item.audioItem.musicTrack&lt;/upnp:class&gt;&lt;res "
+	"protocolInfo=\"http-get:*:audio/x-flac:*\" duration=\"0:03:00.000\""
+	"&gt;http://192.168.1.10:8200/MediaItems/42.flac&lt;/res&gt;&lt;/item"
+	"&gt;&lt;/DIDL-Lite&gt;</CurrentURIMetaData></u:SetAVTransportURI>",
+	"<u:GetMediaInfo " AVT "><InstanceID>0</InstanceID></u:GetMediaInfo>",
+	"<u:Play " AVT "><InstanceID>0</InstanceID><Speed>1</Speed></u:Play>",
+	"<u:GetTransportInfo " AVT "><InstanceID>0</InstanceID>"
+	"</u:GetTransportInfo>",
+	"<u:GetPositionInfo " AVT "><InstanceID>0</InstanceID>"
+	"</u:GetPositionInfo>",
+	"<u:SetVolume " RCS "><InstanceID>0</InstanceID><Channel>Master"
+	"</Channel><DesiredVolume>42</DesiredVolume></u:SetVolume>",
+	"<u:GetVolume " RCS "><InstanceID>0</InstanceID><Channel>Master"
+	"</Channel></u:GetVolume>",
+	"<u:SetMute " RCS "><InstanceID>0</InstanceID><Channel>Master"
+	"</Channel><DesiredMute>1</DesiredMute></u:SetMute>",
+	"<u:GetMute " RCS "><InstanceID>0</InstanceID><Channel>Master"
+	"</Channel></u:GetMute>",
+	"<u:Seek " AVT "><InstanceID>0</InstanceID><Unit>REL_TIME</Unit>"
+	"<Target>0:01:30</Target></u:Seek>",
+	"<u:Pause " AVT "><InstanceID>0</InstanceID></u:Pause>",
+	"<u:GetPositionInfo " AVT "><InstanceID>0</InstanceID>"
+	"</u:GetPositionInfo>",
+	"<u:Stop " AVT "><InstanceID>0</InstanceID></u:Stop>",
+	NULL
+};
+
+// One action body to replay and the statistics we collect for it.
+struct replay_action {
+	struct bench_action action;
+	int64_t *latencies_us;
+	int latency_count;
+	uint64_t allocations;
+	uint64_t allocated_bytes;
+	int errors;
+};
+
+static int iterations = 1000;
+static const gchar *replay_file = NULL;
+static const gchar *log_levels = "*=error";
+
+static GOptionEntry option_entries[] = {
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &iterations,
+	  "Number of times to replay the sequence of actions.", NULL },
+	{ "file", 'f', 0, G_OPTION_ARG_STRING, &replay_file,
+	  "File with one SOAP action body per line to replay instead of "
+	  "the built-in sequence.", NULL },
+	{ "log-levels", 0, 0, G_OPTION_ARG_STRING, &log_levels,
+	  "Log levels per category, as in gmediarender. Default "
+	  "'*=error' to keep logging out of the measurement.", NULL },
+	{ NULL }
+};
+
+static void replay(struct upnp_device *device, struct replay_action *action) {
+	// Parsing the request is libupnp's work; not part of the measurement.
+	UpnpActionRequest *request = BenchAction_new_request(&action->action);
+
+	const uint64_t allocations_before = allocations_;
+	const uint64_t bytes_before = allocated_bytes_;
+	count_allocations_ = 1;
+	const int64_t start = Metrics_now_us();
+	upnp_device_handle_action(device, request);
+	const int64_t duration = Metrics_now_us() - start;
+	count_allocations_ = 0;
+
+	action->latencies_us[action->latency_count++] = duration;
+	action->allocations += allocations_ - allocations_before;
+	action->allocated_bytes += allocated_bytes_ - bytes_before;
+	if (UpnpActionRequest_get_ErrCode(request) != UPNP_E_SUCCESS)
+		action->errors++;
+	BenchAction_delete_request(request);
+}
+
+static void print_report(struct replay_action *actions, int count) {
+	printf("%-22s %7s %9s %7s %7s %7s %8s %9s %6s\n", "action", "calls",
+	       "mean(us)", "p50", "p99", "max", "allocs", "bytes", "errors");
+	for (int i = 0; i < count; ++i) {
+		struct replay_action *a = &actions[i];
+		const int n = a->latency_count;
+		if (n == 0) continue;
+		int64_t sum = 0;
+		for (int j = 0; j < n; ++j) sum += a->latencies_us[j];
+		printf("%-22s %7d %9.1f %7lld %7lld %7lld ",
+		       a->action.action_name, n, (double) sum / n,
+		       (long long) Bench_percentile(a->latencies_us, n, 50),
+		       (long long) Bench_percentile(a->latencies_us, n, 99),
+		       (long long) Bench_percentile(a->latencies_us, n, 100));
+		if (HAVE_ALLOCATION_COUNT) {
+			printf("%8.1f %9.1f", (double) a->allocations / n,
+			       (double) a->allocated_bytes / n);
+		} else {
+			printf("%8s %9s", "n/a", "n/a");
+		}
+		printf(" %6d\n", a->errors);
+	}
+}
+
+static char **read_lines(const char *filename) {
+	FILE *in = fopen(filename, "r");
+	if (in == NULL) {
+		perror(filename);
+		return NULL;
+	}
+	char **lines = NULL;
+	int count = 0;
+	char *line = NULL;
+	size_t len = 0;
+	ssize_t r;
+	while ((r = getline(&line, &len, in)) >= 0) {
+		while (r > 0 && (line[r-1] == '\n' || line[r-1] == '\r'))
+			line[--r] = '\0';
+		if (r == 0) continue;
+		lines = realloc(lines, (count + 2) * sizeof(char*));
+		lines[count++] = strdup(line);
+		lines[count] = NULL;
+	}
+	free(line);
+	fclose(in);
+	return lines;
+}
+
+int main(int argc, char **argv) {
+	GOptionContext *ctx = g_option_context_new("- replay UPnP actions");
+	g_option_context_add_main_entries(ctx, option_entries, NULL);
+	GError *err = NULL;
+	if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+		fprintf(stderr, "Failed to parse options: %s\n", err->message);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(ctx);
+	if (iterations <= 0) iterations = 1;
+	if (!Log_set_levels(log_levels)) {
+		fprintf(stderr, "Invalid --log-levels '%s'\n", log_levels);
+		return EXIT_FAILURE;
+	}
+
+	char **bodies = (char **) kDefaultActions;
+	if (replay_file != NULL) {
+		bodies = read_lines(replay_file);
+		if (bodies == NULL || bodies[0] == NULL) {
+			fprintf(stderr, "No actions to replay.\n");
+			return EXIT_FAILURE;
+		}
+	}
+	int action_count = 0;
+	while (bodies[action_count]) ++action_count;
+
+	if (output_init("null") != 0) {
+		return EXIT_FAILURE;
+	}
+	struct upnp_renderer *renderer
+		= upnp_renderer_new(1, "Benchmark", "uuid:benchmark", NULL,
+				    output_new(NULL, NULL));
+	if (renderer == NULL) {
+		return EXIT_FAILURE;
+	}
+	struct upnp_device_descriptor *desc
+		= upnp_renderer_get_descriptor(renderer);
+	struct upnp_device *device = upnp_device_init_offline(desc);
+	if (device == NULL) {
+		return EXIT_FAILURE;
+	}
+	upnp_renderer_start(renderer, device);
+
+	struct replay_action *actions = calloc(action_count, sizeof(*actions));
+	for (int i = 0; i < action_count; ++i) {
+		if (!BenchAction_init(&actions[i].action, desc, bodies[i]))
+			return EXIT_FAILURE;
+		actions[i].latencies_us = calloc(iterations, sizeof(int64_t));
+	}
+
+	// Warm up once, then measure.
+	for (int i = 0; i < action_count; ++i) {
+		replay(device, &actions[i]);
+		actions[i].latency_count = 0;
+		actions[i].allocations = actions[i].allocated_bytes = 0;
+		actions[i].errors = 0;
+	}
+	for (int round = 0; round < iterations; ++round) {
+		for (int i = 0; i < action_count; ++i) {
+			replay(device, &actions[i]);
+		}
+	}
+
+	print_report(actions, action_count);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+/* bench_util.c - Helpers shared by the benchmark programs.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "bench_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <upnp.h>
+#include <ixml.h>
+
+#include "upnp_device.h"
+#include "upnp_service.h"
+
+int BenchAction_init(struct bench_action *action,
+		     struct upnp_device_descriptor *desc, const char *body) {
+	memset(action, 0, sizeof(*action));
+	action->body = strdup(body);
+	IXML_Document *doc = ixmlParseBuffer(body);
+	if (doc == NULL) {
+		fprintf(stderr, "Can't parse '%s'\n", body);
+		return 0;
+	}
+	IXML_Node *root = ixmlNode_getFirstChild((IXML_Node*) doc);
+	const char *local_name = root ? ixmlNode_getLocalName(root) : NULL;
+	const char *service_type = root ? ixmlNode_getNamespaceURI(root) : NULL;
+	if (local_name != NULL && service_type != NULL) {
+		for (int i = 0; desc->services[i]; ++i) {
+			if (strcmp(desc->services[i]->service_type,
+				   service_type) == 0) {
+				action->service_id
+					= desc->services[i]->service_id;
+			}
+		}
+		action->action_name = strdup(local_name);
+	}
+	ixmlDocument_free(doc);
+	if (action->service_id == NULL) {
+		fprintf(stderr, "Unknown action or service in '%s'\n", body);
+		return 0;
+	}
+	return 1;
+}
+
+void BenchAction_clear(struct bench_action *action) {
+	free(action->body);
+	free(action->action_name);
+	memset(action, 0, sizeof(*action));
+}
+
+UpnpActionRequest *BenchAction_new_request(const struct bench_action *action) {
+#if UPNP_VERSION >= 10800
+	UpnpActionRequest *request = UpnpActionRequest_new();
+	UpnpActionRequest_strcpy_ActionName(request, action->action_name);
+	UpnpActionRequest_strcpy_ServiceID(request, action->service_id);
+#else
+	UpnpActionRequest *request = calloc(1, sizeof(*request));
+	strncpy(request->ActionName, action->action_name, NAME_SIZE - 1);
+	strncpy(request->ServiceID, action->service_id, NAME_SIZE - 1);
+#endif
+	UpnpActionRequest_set_ErrCode(request, UPNP_E_SUCCESS);
+	UpnpActionRequest_set_ActionRequest(request,
+					    ixmlParseBuffer(action->body));
+	return request;
+}
+
+void BenchAction_delete_request(UpnpActionRequest *request) {
+	ixmlDocument_free(UpnpActionRequest_get_ActionRequest(request));
+	UpnpActionRequest_set_ActionRequest(request, NULL);
+	if (UpnpActionRequest_get_ActionResult(request)) {
+		ixmlDocument_free(UpnpActionRequest_get_ActionResult(request));
+		UpnpActionRequest_set_ActionResult(request, NULL);
+	}
+#if UPNP_VERSION >= 10800
+	UpnpActionRequest_delete(request);
+#else
+	free(request);
+#endif
+}
+
+static int compare_int64(const void *a, const void *b) {
+	const int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+int64_t Bench_percentile(int64_t *values, int count, int percent) {
+	if (count <= 0) return 0;
+	qsort(values, count, sizeof(int64_t), compare_int64);
+	return values[(count - 1) * percent / 100];
+}
@@ -0,0 +1,55 @@
+/* bench_util.h - Helpers shared by the benchmark programs.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#ifndef _BENCH_UTIL_H
+#define _BENCH_UTIL_H
+
+#include <stdint.h>
+
+#include "upnp_compat.h"
+
+struct upnp_device_descriptor;
+
+// A SOAP action body, e.g.
+//   <u:Play xmlns:u="urn:schemas-upnp-org:service:AVTransport:1">...</u:Play>
+// and the action and service it addresses.
+struct bench_action {
+	char *body;
+	char *action_name;
+	const char *service_id;
+};
+
+// Parse "body" to find the action name and, from its namespace, the service
+// of "desc" it is meant for. Returns 0 and prints why if that fails.
+int BenchAction_init(struct bench_action *action,
+		     struct upnp_device_descriptor *desc, const char *body);
+void BenchAction_clear(struct bench_action *action);
+
+// Create a request as libupnp would hand it to us, with a freshly parsed
+// body. Free with BenchAction_delete_request().
+UpnpActionRequest *BenchAction_new_request(const struct bench_action *action);
+void BenchAction_delete_request(UpnpActionRequest *request);
+
+// Sorts "values" and returns the given percentile (0..100).
+int64_t Bench_percentile(int64_t *values, int count, int percent);
+
+#endif  // _BENCH_UTIL_H
@@ -0,0 +1,428 @@
+/* gena_bench.c - Load generator for event subscriptions.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// Runs a renderer (with the "null" output) on the loopback interface and
+// subscribes a number of fake control points to all of its services. Each
+// of them is a small HTTP listener on loopback that accepts the NOTIFY
+// requests. Then volume and URI changes are driven through the actions
+// as fast as possible (or at a given rate), and we measure how long it takes
+// from the change until each subscriber has received its event, and how
+// many events got lost on the way.
+// Build with 'make gena_bench'.
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <glib.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <upnp.h>
+
+#include "bench_util.h"
+#include "logging.h"
+#include "metrics.h"
+#include "output.h"
+#include "upnp_device.h"
+#include "upnp_renderer.h"
+#include "upnp_service.h"
+
+#define MAX_SERVICES 3
+
+static int subscriber_count = 50;
+static int change_count = 1000;
+static int change_rate = 0;
+static int drain_timeout = 10;
+static const gchar *interface_name = "lo";
+static const gchar *log_levels = "*=error";
+
+static GOptionEntry option_entries[] = {
+	{ "subscribers", 'n', 0, G_OPTION_ARG_INT, &subscriber_count,
+	  "Number of subscribing control points.", NULL },
+	{ "changes", 'c', 0, G_OPTION_ARG_INT, &change_count,
+	  "Number of variable changes to send.", NULL },
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &change_rate,
+	  "Changes per second; 0 means as fast as possible.", NULL },
+	{ "drain-timeout", 0, 0, G_OPTION_ARG_INT, &drain_timeout,
+	  "Seconds to wait for outstanding events at the end.", NULL },
+	{ "interface-name", 'I', 0, G_OPTION_ARG_STRING, &interface_name,
+	  "Interface for the renderer and the subscribers.", NULL },
+	{ "log-levels", 0, 0, G_OPTION_ARG_STRING, &log_levels,
+	  "Log levels per category, as in gmediarender.", NULL },
+	{ NULL }
+};
+
+// A fake control point.
+struct subscriber {
+	int listen_fd;
+	unsigned short port;
+	pthread_t thread;
+	int received[MAX_SERVICES];  // Events per service, including initial.
+};
+
+static struct upnp_device_descriptor *desc_;
+static int service_count_;
+static struct subscriber *subscribers_;
+static volatile int stopping_ = 0;
+
+// Time each change was triggered, by service and event sequence number.
+// The initial event after subscribing has sequence number 0, the n-th
+// change of the service sequence number n.
+static int64_t *change_time_us_[MAX_SERVICES];
+static int changes_per_service_[MAX_SERVICES];  // Only used by main thread.
+
+// Delivery latencies of all events caused by changes.
+static int64_t *latencies_us_;
+static int latency_count_;
+static int latency_capacity_;
+static int64_t last_delivery_us_;
+
+static int service_index(const char *service_id) {
+	for (int i = 0; i < service_count_; ++i) {
+		if (strcmp(desc_->services[i]->service_id, service_id) == 0)
+			return i;
+	}
+	return -1;
+}
+
+// Returns value of header "name" in the NUL-terminated header block, or
+// NULL. The value extends to the next "\r\n".
+static const char *find_header(const char *headers, const char *name) {
+	const size_t len = strlen(name);
+	for (const char *line = strstr(headers, "\r\n"); line != NULL;
+	     line = strstr(line, "\r\n")) {
+		line += 2;
+		if (strncasecmp(line, name, len) == 0 && line[len] == ':') {
+			const char *value = line + len + 1;
+			while (*value == ' ') ++value;
+			return value;
+		}
+	}
+	return NULL;
+}
+
+// Reads a HTTP request or response with its body into "buf". Returns the
+// length of the header block, with a NUL written at its end, or -1 on
+// error or end of connection. The peer waits for our answer before it sends
+// the next message, so we never read past the end of this one.
+static int read_http_message(int fd, char *buf, size_t size) {
+	size_t pos = 0;
+	char *header_end = NULL;
+	while (header_end == NULL) {
+		if (pos + 1 >= size) return -1;
+		const ssize_t r = read(fd, buf + pos, size - pos - 1);
+		if (r <= 0) return -1;
+		pos += r;
+		buf[pos] = '\0';
+		header_end = strstr(buf, "\r\n\r\n");
+	}
+	*header_end = '\0';
+	const int header_len = header_end - buf;
+	const char *length_header = find_header(buf, "Content-Length");
+	const size_t body_len = length_header ? strtoul(length_header, NULL, 10) : 0;
+	// The body we don't care about; just consume it.
+	size_t have = pos - (header_len + 4);
+	while (have < body_len) {
+		char discard[4096];
+		size_t want = body_len - have;
+		if (want > sizeof(discard)) want = sizeof(discard);
+		const ssize_t r = read(fd, discard, want);
+		if (r <= 0) return -1;
+		have += r;
+	}
+	return header_len;
+}
+
+static void record_event(struct subscriber *sub, int service, long seq) {
+	const int64_t now = Metrics_now_us();
+	sub->received[service]++;
+	__atomic_store_n(&last_delivery_us_, now, __ATOMIC_RELAXED);
+	if (seq <= 0 || seq > change_count)
+		return;   // initial event, or not one of ours.
+	const int64_t sent = __atomic_load_n(&change_time_us_[service][seq],
+					     __ATOMIC_ACQUIRE);
+	if (sent == 0)
+		return;
+	const int slot = __atomic_fetch_add(&latency_count_, 1,
+					    __ATOMIC_RELAXED);
+	if (slot < latency_capacity_)
+		latencies_us_[slot] = now - sent;
+}
+
+static void handle_connection(struct subscriber *sub, int fd) {
+	static const char kResponse[] =
+		"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+	char buf[8192];
+	// Serve requests until the publisher closes the connection.
+	while (read_http_message(fd, buf, sizeof(buf)) >= 0) {
+		int service = -1;
+		// The callback URL tells which service the event is from.
+		sscanf(buf, "NOTIFY /%d", &service);
+		const char *seq = find_header(buf, "SEQ");
+		if (service >= 0 && service < service_count_ && seq != NULL) {
+			record_event(sub, service, strtol(seq, NULL, 10));
+		}
+		if (write(fd, kResponse, sizeof(kResponse) - 1) < 0)
+			break;
+	}
+	close(fd);
+}
+
+static void *subscriber_thread(void *userdata) {
+	struct subscriber *sub = (struct subscriber*) userdata;
+	while (!stopping_) {
+		int fd = accept(sub->listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		handle_connection(sub, fd);
+	}
+	return NULL;
+}
+
+static int open_listener(struct subscriber *sub, const char *ip) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	inet_pton(AF_INET, ip, &addr.sin_addr);
+	sub->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	socklen_t len = sizeof(addr);
+	if (sub->listen_fd < 0
+	    || bind(sub->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+	    || listen(sub->listen_fd, 64) < 0
+	    || getsockname(sub->listen_fd, (struct sockaddr*) &addr, &len) < 0) {
+		perror("listener");
+		return 0;
+	}
+	sub->port = ntohs(addr.sin_port);
+	return pthread_create(&sub->thread, NULL, subscriber_thread, sub) == 0;
+}
+
+static int subscribe(struct subscriber *sub, int service,
+		     const char *ip, unsigned short port) {
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, ip, &addr.sin_addr);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		perror("connect");
+		if (fd >= 0) close(fd);
+		return 0;
+	}
+	char request[512];
+	const int len = snprintf(request, sizeof(request),
+				 "SUBSCRIBE %s HTTP/1.1\r\n"
+				 "HOST: %s:%d\r\n"
+				 "CALLBACK: <http://%s:%d/%d>\r\n"
+				 "NT: upnp:event\r\n"
+				 "TIMEOUT: Second-1800\r\n"
+				 "Content-Length: 0\r\n\r\n",
+				 desc_->services[service]->event_url,
+				 ip, port, ip, sub->port, service);
+	char response[4096];
+	int ok = (write(fd, request, len) == len
+		  && read_http_message(fd, response, sizeof(response)) >= 0
+		  && strncmp(response + 8, " 200", 4) == 0
+		  && find_header(response, "SID") != NULL);
+	close(fd);
+	if (!ok) {
+		fprintf(stderr, "SUBSCRIBE %s failed\n",
+			desc_->services[service]->event_url);
+	}
+	return ok;
+}
+
+static int total_received(void) {
+	int total = 0;
+	for (int i = 0; i < subscriber_count; ++i) {
+		for (int s = 0; s < service_count_; ++s) {
+			total += __atomic_load_n(&subscribers_[i].received[s],
+						 __ATOMIC_RELAXED);
+		}
+	}
+	return total;
+}
+
+// Wait until "expected" events arrived; returns 0 on timeout.
+static int wait_for_events(int expected, int timeout_sec) {
+	const int64_t deadline = Metrics_now_us() + timeout_sec * 1000000LL;
+	while (total_received() < expected) {
+		if (Metrics_now_us() > deadline)
+			return 0;
+		usleep(1000);
+	}
+	return 1;
+}
+
+static void sleep_until_us(int64_t t) {
+	const int64_t now = Metrics_now_us();
+	if (t > now) usleep(t - now);
+}
+
+// Trigger the n-th change: alternating between a volume change on
+// RenderingControl and a new URI on AVTransport.
+static void trigger_change(struct upnp_device *device, int n) {
+	char body[512];
+	if (n % 2 == 0) {
+		snprintf(body, sizeof(body),
+			 "<u:SetVolume xmlns:u=\"urn:schemas-upnp-org:"
+			 "service:RenderingControl:1\"><InstanceID>0"
+			 "</InstanceID><Channel>Master</Channel>"
+			 "<DesiredVolume>%d</DesiredVolume></u:SetVolume>",
+			 10 + (n / 2) % 50);
+	} else {
+		snprintf(body, sizeof(body),
+			 "<u:SetAVTransportURI xmlns:u=\"urn:schemas-upnp-org:"
+			 "service:AVTransport:1\"><InstanceID>0</InstanceID>"
+			 "<CurrentURI>http://127.0.0.1/bench/%d.mp3"
+			 "</CurrentURI><CurrentURIMetaData>"
+			 "</CurrentURIMetaData></u:SetAVTransportURI>", n);
+	}
+	struct bench_action action;
+	if (!BenchAction_init(&action, desc_, body))
+		return;
+	const int service = service_index(action.service_id);
+	UpnpActionRequest *request = BenchAction_new_request(&action);
+	const int seq = ++changes_per_service_[service];
+	__atomic_store_n(&change_time_us_[service][seq], Metrics_now_us(),
+			 __ATOMIC_RELEASE);
+	upnp_device_handle_action(device, request);
+	BenchAction_delete_request(request);
+	BenchAction_clear(&action);
+}
+
+int main(int argc, char **argv) {
+	GOptionContext *ctx = g_option_context_new("- event load generator");
+	g_option_context_add_main_entries(ctx, option_entries, NULL);
+	GError *err = NULL;
+	if (!g_option_context_parse(ctx, &argc, &argv, &err)) {
+		fprintf(stderr, "Failed to parse options: %s\n", err->message);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(ctx);
+	if (subscriber_count <= 0 || change_count <= 0) {
+		fprintf(stderr, "Need at least one subscriber and change.\n");
+		return EXIT_FAILURE;
+	}
+	if (!Log_set_levels(log_levels)) {
+		fprintf(stderr, "Invalid --log-levels '%s'\n", log_levels);
+		return EXIT_FAILURE;
+	}
+
+	if (output_init("null") != 0)
+		return EXIT_FAILURE;
+	struct upnp_renderer *renderer
+		= upnp_renderer_new(1, "Event Benchmark", "uuid:event-benchmark",
+				    NULL, output_new(NULL, NULL));
+	if (renderer == NULL)
+		return EXIT_FAILURE;
+	desc_ = upnp_renderer_get_descriptor(renderer);
+	struct upnp_device *device = upnp_device_init(desc_, interface_name, 0);
+	if (device == NULL)
+		return EXIT_FAILURE;
+	upnp_renderer_start(renderer, device);
+
+	while (service_count_ < MAX_SERVICES && desc_->services[service_count_])
+		++service_count_;
+	for (int s = 0; s < service_count_; ++s) {
+		change_time_us_[s] = calloc(change_count + 1, sizeof(int64_t));
+	}
+	latency_capacity_ = subscriber_count * change_count;
+	latencies_us_ = calloc(latency_capacity_, sizeof(int64_t));
+
+	const char *ip = UpnpGetServerIpAddress();
+	const unsigned short port = UpnpGetServerPort();
+	printf("Renderer at %s:%d; subscribing %d control points.\n",
+	       ip, port, subscriber_count);
+
+	subscribers_ = calloc(subscriber_count, sizeof(*subscribers_));
+	for (int i = 0; i < subscriber_count; ++i) {
+		if (!open_listener(&subscribers_[i], ip))
+			return EXIT_FAILURE;
+		for (int s = 0; s < service_count_; ++s) {
+			if (!subscribe(&subscribers_[i], s, ip, port))
+				return EXIT_FAILURE;
+		}
+	}
+	const int initial_events = subscriber_count * service_count_;
+	if (!wait_for_events(initial_events, drain_timeout)) {
+		fprintf(stderr, "Only got %d of %d initial events.\n",
+			total_received(), initial_events);
+	}
+
+	const int64_t start = Metrics_now_us();
+	for (int n = 0; n < change_count; ++n) {
+		if (change_rate > 0)
+			sleep_until_us(start + n * 1000000LL / change_rate);
+		trigger_change(device, n);
+	}
+	const int64_t send_done = Metrics_now_us();
+	const int expected = initial_events + subscriber_count * change_count;
+	wait_for_events(expected, drain_timeout);
+
+	const int received = total_received() - initial_events;
+	const int expected_changes = expected - initial_events;
+	int count = latency_count_;
+	if (count > latency_capacity_) count = latency_capacity_;
+	int64_t sum = 0;
+	for (int i = 0; i < count; ++i) sum += latencies_us_[i];
+	const int64_t end = last_delivery_us_ > send_done
+		? last_delivery_us_ : send_done;
+
+	printf("changes:       %d in %.3fs (%.0f/s)\n", change_count,
+	       (send_done - start) / 1e6,
+	       change_count * 1e6 / (send_done - start + 1));
+	printf("events:        %d of %d delivered (%d lost)\n",
+	       received, expected_changes, expected_changes - received);
+	printf("throughput:    %.0f events/s\n",
+	       received * 1e6 / (end - start + 1));
+	printf("latency (us):  mean %.0f  p50 %lld  p90 %lld  p99 %lld  "
+	       "max %lld\n", count ? (double) sum / count : 0.0,
+	       (long long) Bench_percentile(latencies_us_, count, 50),
+	       (long long) Bench_percentile(latencies_us_, count, 90),
+	       (long long) Bench_percentile(latencies_us_, count, 99),
+	       (long long) Bench_percentile(latencies_us_, count, 100));
+
+	stopping_ = 1;
+	upnp_device_shutdown(device);
+	for (int i = 0; i < subscriber_count; ++i) {
+		shutdown(subscribers_[i].listen_fd, SHUT_RDWR);
+		pthread_join(subscribers_[i].thread, NULL);
+		close(subscribers_[i].listen_fd);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,234 @@
+/* lockprof.c - Optional contention profiling of service mutexes.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "lockprof.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "metrics.h"
+
+// Histogram with power-of-two buckets: bucket i counts durations of less
+// than 2^i microseconds, which is precise enough to spot hot spots.
+#define LOCKPROF_BUCKETS 32
+#define LOCKPROF_MAX_SITES 32
+
+struct duration_histogram {
+	uint64_t buckets[LOCKPROF_BUCKETS];
+	uint64_t count;
+	uint64_t max_us;
+};
+
+struct call_site_stats {
+	const char *call_site;   // Claimed once with compare-and-swap.
+	struct duration_histogram wait;
+	struct duration_histogram hold;
+};
+
+struct lock_profile {
+	const char *name;
+	// Only accessed by the thread holding the mutex.
+	int64_t acquired_us;
+	struct call_site_stats *holder;
+
+	struct call_site_stats sites[LOCKPROF_MAX_SITES];
+	struct lock_profile *next;
+};
+
+static int enabled_ = 0;
+static int64_t report_interval_us_ = 0;
+static int64_t last_report_us_ = 0;
+static struct lock_profile *profiles_ = NULL;  // Only appended at startup.
+
+static void report_all(void);
+
+void LockProfile_enable(int report_interval_sec) {
+	enabled_ = 1;
+	report_interval_us_ = (int64_t) report_interval_sec * 1000000;
+	last_report_us_ = Metrics_now_us();
+}
+
+struct lock_profile *LockProfile_new(const char *lock_name) {
+	if (!enabled_)
+		return NULL;
+	struct lock_profile *profile = calloc(1, sizeof(*profile));
+	if (profile == NULL)
+		return NULL;
+	profile->name = lock_name;
+	profile->next = profiles_;
+	profiles_ = profile;
+	return profile;
+}
+
+static void histogram_add(struct duration_histogram *h, int64_t us) {
+	int bucket = 0;
+	while (bucket < LOCKPROF_BUCKETS - 1 && us >= (1LL << bucket))
+		++bucket;
+	__atomic_add_fetch(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+	while ((uint64_t) us > max
+	       && !__atomic_compare_exchange_n(&h->max_us, &max, us, 1,
+					       __ATOMIC_RELAXED,
+					       __ATOMIC_RELAXED)) {
+		/* retry with updated max */
+	}
+}
+
+// Upper bound of the bucket containing the given percentile.
+static uint64_t histogram_percentile(const struct duration_histogram *h,
+				     int percent) {
+	const uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	const uint64_t rank = (count * percent + 99) / 100;
+	uint64_t cumulative = 0;
+	for (int b = 0; b < LOCKPROF_BUCKETS; ++b) {
+		cumulative += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+		if (cumulative >= rank)
+			return 1ULL << b;
+	}
+	return __atomic_load_n(&h->max_us, __ATOMIC_RELAXED);
+}
+
+static struct call_site_stats *find_site(struct lock_profile *profile,
+					 const char *call_site) {
+	for (int i = 0; i < LOCKPROF_MAX_SITES; ++i) {
+		struct call_site_stats *s = &profile->sites[i];
+		const char *site = __atomic_load_n(&s->call_site,
+						   __ATOMIC_ACQUIRE);
+		if (site == NULL
+		    && __atomic_compare_exchange_n(&s->call_site, &site,
+						   call_site, 0,
+						   __ATOMIC_ACQ_REL,
+						   __ATOMIC_ACQUIRE)) {
+			return s;
+		}
+		if (site == call_site || strcmp(site, call_site) == 0)
+			return s;
+	}
+	return NULL;
+}
+
+void LockProfile_lock(struct lock_profile *profile, pthread_mutex_t *mutex,
+		      const char *call_site) {
+	if (profile == NULL) {
+		pthread_mutex_lock(mutex);
+		return;
+	}
+	const int64_t start = Metrics_now_us();
+	pthread_mutex_lock(mutex);
+	const int64_t acquired = Metrics_now_us();
+	struct call_site_stats *site = find_site(profile, call_site);
+	if (site != NULL) {
+		histogram_add(&site->wait, acquired - start);
+	}
+	profile->holder = site;
+	profile->acquired_us = acquired;
+}
+
+void LockProfile_unlock(struct lock_profile *profile, pthread_mutex_t *mutex) {
+	if (profile == NULL) {
+		pthread_mutex_unlock(mutex);
+		return;
+	}
+	const int64_t now = Metrics_now_us();
+	struct call_site_stats *site = profile->holder;
+	if (site != NULL) {
+		histogram_add(&site->hold, now - profile->acquired_us);
+	}
+	profile->holder = NULL;
+	pthread_mutex_unlock(mutex);
+
+	int64_t last = __atomic_load_n(&last_report_us_, __ATOMIC_RELAXED);
+	if (report_interval_us_ > 0 && now - last > report_interval_us_
+	    && __atomic_compare_exchange_n(&last_report_us_, &last, now, 0,
+					   __ATOMIC_RELAXED,
+					   __ATOMIC_RELAXED)) {
+		report_all();
+	}
+}
+
+static void report_all(void) {
+	for (struct lock_profile *p = profiles_; p; p = p->next) {
+		for (int i = 0; i < LOCKPROF_MAX_SITES; ++i) {
+			const struct call_site_stats *s = &p->sites[i];
+			const char *site = __atomic_load_n(&s->call_site,
+							   __ATOMIC_ACQUIRE);
+			if (site == NULL) break;
+			Log_info("lockprof", "%s lock from %s: n=%llu; "
+				 "wait p50<%llu p90<%llu p99<%llu max=%llu; "
+				 "hold p50<%llu p90<%llu p99<%llu max=%llu "
+				 "(usec)", p->name, site,
+				 (unsigned long long) s->wait.count,
+				 (unsigned long long) histogram_percentile(&s->wait, 50),
+				 (unsigned long long) histogram_percentile(&s->wait, 90),
+				 (unsigned long long) histogram_percentile(&s->wait, 99),
+				 (unsigned long long) s->wait.max_us,
+				 (unsigned long long) histogram_percentile(&s->hold, 50),
+				 (unsigned long long) histogram_percentile(&s->hold, 90),
+				 (unsigned long long) histogram_percentile(&s->hold, 99),
+				 (unsigned long long) s->hold.max_us);
+		}
+	}
+}
+
+static void write_summary(FILE *out, const char *metric,
+			  const char *lock_name, const char *site,
+			  const struct duration_histogram *h) {
+	static const int kPercentiles[] = { 50, 90, 99 };
+	for (int i = 0; i < 3; ++i) {
+		fprintf(out, "%s{lock=\"%s\",site=\"%s\",quantile=\"0.%d\"} "
+			"%llu\n", metric, lock_name, site, kPercentiles[i],
+			(unsigned long long) histogram_percentile(
+				h, kPercentiles[i]));
+	}
+	fprintf(out, "%s_count{lock=\"%s\",site=\"%s\"} %llu\n", metric,
+		lock_name, site, (unsigned long long) h->count);
+}
+
+void LockProfile_write_metrics(FILE *out) {
+	if (!enabled_)
+		return;
+	static const char *const kMetrics[] = {
+		"gmediarender_lock_site_wait_microseconds",
+		"gmediarender_lock_site_hold_microseconds",
+	};
+	for (int m = 0; m < 2; ++m) {
+		fprintf(out, "# TYPE %s summary\n", kMetrics[m]);
+		for (struct lock_profile *p = profiles_; p; p = p->next) {
+			for (int i = 0; i < LOCKPROF_MAX_SITES; ++i) {
+				const struct call_site_stats *s = &p->sites[i];
+				const char *site = __atomic_load_n(
+					&s->call_site, __ATOMIC_ACQUIRE);
+				if (site == NULL) break;
+				write_summary(out, kMetrics[m], p->name, site,
+					      m == 0 ? &s->wait : &s->hold);
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+/* lockprof.h - Optional contention profiling of service mutexes.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _LOCKPROF_H
+#define _LOCKPROF_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+// Records, per mutex and per call site, how long threads waited for the
+// lock and how long they held it. Percentiles are logged periodically
+// and exported with the metrics.
+
+struct lock_profile;
+
+// Enable profiling; must be called before any LockProfile_new(). Reports
+// are logged every "report_interval_sec" seconds (if > 0).
+void LockProfile_enable(int report_interval_sec);
+
+// Returns a new profile for a mutex with the given name, or NULL if
+// profiling is not enabled.
+struct lock_profile *LockProfile_new(const char *lock_name);
+
+// Lock/unlock "mutex", recording the time for "profile" if it is not NULL.
+// The "call_site" needs to be a string constant such as __func__.
+void LockProfile_lock(struct lock_profile *profile, pthread_mutex_t *mutex,
+		      const char *call_site);
+void LockProfile_unlock(struct lock_profile *profile, pthread_mutex_t *mutex);
+
+// Write percentiles of all profiles in the Prometheus text format.
+void LockProfile_write_metrics(FILE *out);
+
+#endif /* _LOCKPROF_H */
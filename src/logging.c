@@ -26,6 +26,9 @@
 #endif
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -52,6 +55,275 @@ static const char *info_markup_start_  = "INFO  ";
 static const char *error_markup_start_ = "ERROR ";
 static const char *markup_end_ = "";
 
+// Configured levels. Whenever they change, log_levels_generation_ is
+// incremented which invalidates the state cached at each call site.
+struct category_level {
+	char *category;
+	int level;
+};
+int log_levels_generation_ = 1;
+static pthread_mutex_t levels_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static struct category_level *spec_levels_ = NULL;  // From Log_set_levels()
+static int spec_levels_count_ = 0;
+static struct category_level *file_levels_ = NULL;  // From levels file.
+static int file_levels_count_ = 0;
+static char *levels_file_ = NULL;
+static volatile sig_atomic_t levels_reload_requested_ = 0;
+
+// If we log to a file, callers don't write themselves: they only format
+// their message into a slot of a bounded multi-producer/single-consumer
+// ring buffer (D. Vyukov's sequence-number queue) and a writer thread does
+// the time formatting and writes the log in batches. So a slow log device
+// never blocks threads that hold locks.
+// If the queue is full, messages are dropped and counted; the count shows
+// up in the log once there is room again.
+#define LOG_QUEUE_SIZE     512   // Needs to be a power of two.
+#define LOG_TEXT_SIZE      512   // Longer messages are put on the heap.
+#define LOG_CATEGORY_SIZE   32
+#define LOG_WRITE_BATCH     32   // Records per writev().
+
+struct log_record {
+	unsigned long seq;   // Sequence number, see log_enqueue()/log_drain()
+	struct timeval time;
+	const char *markup_start;
+	char category[LOG_CATEGORY_SIZE];
+	char *long_text;     // Only set if message didn't fit into text[].
+	int len;
+	char text[LOG_TEXT_SIZE];
+};
+
+static struct log_record *log_queue_ = NULL;
+static unsigned long enqueue_pos_ = 0;  // Shared among producers.
+static unsigned long dequeue_pos_ = 0;  // Consumer only.
+static unsigned long dropped_ = 0;
+static sem_t queue_sem_;
+static int writer_started_ = 0;
+// Serializes consumers: the writer thread and explicit flushes.
+static pthread_mutex_t consumer_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+
+static void log_flush(void);
+static void invalidate_callsites(void);
+static void *log_writer_thread(void *userdata);
+
+// The writer thread does not survive a fork() (such as daemon()), so before
+// forking we write out everything, and the child starts a new writer the
+// next time it logs.
+static void log_prepare_fork(void) {
+	log_flush();
+	pthread_mutex_lock(&consumer_mutex_);
+}
+static void log_parent_after_fork(void) {
+	pthread_mutex_unlock(&consumer_mutex_);
+}
+static void log_child_after_fork(void) {
+	pthread_mutex_init(&consumer_mutex_, NULL);
+	sem_init(&queue_sem_, 0, 0);
+	writer_started_ = 0;
+}
+
+static void init_log_queue(void) {
+	log_queue_ = (struct log_record*) calloc(LOG_QUEUE_SIZE,
+						 sizeof(struct log_record));
+	if (log_queue_ == NULL)
+		return;  // We just log synchronously then.
+	for (unsigned long i = 0; i < LOG_QUEUE_SIZE; ++i) {
+		log_queue_[i].seq = i;
+	}
+	sem_init(&queue_sem_, 0, 0);
+	pthread_atfork(log_prepare_fork, log_parent_after_fork,
+		       log_child_after_fork);
+	atexit(log_flush);
+}
+
+static void start_writer_if_needed(void) {
+	int expected = 0;
+	if (!__atomic_compare_exchange_n(&writer_started_, &expected, 1, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		return;
+	}
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, log_writer_thread, NULL) != 0) {
+		writer_started_ = 0;  // Next caller tries again.
+	}
+	pthread_attr_destroy(&attr);
+}
+
+// Producer side. Lock-free; returns 0 if the queue was full.
+static int log_enqueue(const char *markup_start, const char *category,
+		       const char *format, va_list ap) {
+	struct log_record *record;
+	unsigned long pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+	for (;;) {
+		record = &log_queue_[pos & (LOG_QUEUE_SIZE - 1)];
+		const unsigned long seq = __atomic_load_n(&record->seq,
+							  __ATOMIC_ACQUIRE);
+		const long diff = (long) seq - (long) pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&enqueue_pos_, &pos,
+							pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			__atomic_add_fetch(&dropped_, 1, __ATOMIC_RELAXED);
+			return 0;
+		} else {
+			pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+		}
+	}
+
+	gettimeofday(&record->time, NULL);
+	record->markup_start = markup_start;
+	strncpy(record->category, category, LOG_CATEGORY_SIZE - 1);
+	record->category[LOG_CATEGORY_SIZE - 1] = '\0';
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+	int len = vsnprintf(record->text, LOG_TEXT_SIZE, format, ap);
+	record->long_text = NULL;
+	if (len >= LOG_TEXT_SIZE) {
+		if (vasprintf(&record->long_text, format, ap_copy) < 0) {
+			record->long_text = NULL;
+			len = LOG_TEXT_SIZE - 1;  // Keep truncated version.
+		}
+	}
+	va_end(ap_copy);
+	record->len = len < 0 ? 0 : len;
+
+	__atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&queue_sem_);
+	start_writer_if_needed();
+	return 1;
+}
+
+static const char *format_time(const struct timeval *tv,
+			       time_t *cached_sec, char *buf, size_t len) {
+	if (tv->tv_sec != *cached_sec) {
+		struct tm time_breakdown;
+		localtime_r(&tv->tv_sec, &time_breakdown);
+		strftime(buf, len, "%F %T", &time_breakdown);
+		*cached_sec = tv->tv_sec;
+	}
+	return buf;
+}
+
+// Consumer side; must be called with consumer_mutex_ held. Writes out
+// all records that are ready. Returns number of records written.
+static int log_drain(void) {
+	static time_t cached_sec = -1;
+	static char time_buf[64];
+	char headers[LOG_WRITE_BATCH + 1][LOG_CATEGORY_SIZE + 128];
+	struct iovec parts[3 * (LOG_WRITE_BATCH + 1)];
+	int total = 0;
+
+	for (;;) {
+		int part_count = 0;
+		int header_count = 0;
+		struct timeval now;
+		const unsigned long dropped
+			= __atomic_exchange_n(&dropped_, 0, __ATOMIC_RELAXED);
+		if (dropped > 0) {
+			gettimeofday(&now, NULL);
+			parts[part_count].iov_base = headers[header_count];
+			parts[part_count].iov_len = snprintf(
+				headers[header_count],
+				sizeof(headers[header_count]),
+				"%s[%s.%06ld | logging]%s %lu log messages "
+				"dropped; queue full.\n",
+				error_markup_start_,
+				format_time(&now, &cached_sec, time_buf,
+					    sizeof(time_buf)),
+				(long) now.tv_usec, markup_end_, dropped);
+			++part_count;
+			++header_count;
+		}
+
+		// Collect records that are ready to be written.
+		unsigned long pos = dequeue_pos_;
+		int records = 0;
+		for (/**/; records < LOG_WRITE_BATCH; ++records, ++pos) {
+			struct log_record *record
+				= &log_queue_[pos & (LOG_QUEUE_SIZE - 1)];
+			if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE)
+			    != pos + 1) {
+				break;
+			}
+			char *header = headers[header_count++];
+			int header_len = snprintf(
+				header, sizeof(headers[0]),
+				"%s[%s.%06ld | %s]%s ",
+				record->markup_start,
+				format_time(&record->time, &cached_sec,
+					    time_buf, sizeof(time_buf)),
+				(long) record->time.tv_usec,
+				record->category, markup_end_);
+			if (header_len >= (int) sizeof(headers[0]))
+				header_len = sizeof(headers[0]) - 1;
+			const char *text = (record->long_text
+					    ? record->long_text
+					    : record->text);
+			parts[part_count].iov_base = header;
+			parts[part_count++].iov_len = header_len;
+			parts[part_count].iov_base = (void*) text;
+			parts[part_count++].iov_len = record->len;
+			if (record->len == 0 || text[record->len - 1] != '\n') {
+				parts[part_count].iov_base = (void*) "\n";
+				parts[part_count++].iov_len = 1;
+			}
+		}
+
+		if (part_count == 0)
+			break;
+		if (writev(log_fd, parts, part_count) < 0) {
+			// Logging trouble. Ignore.
+		}
+
+		// Give the slots back to the producers.
+		for (int i = 0; i < records; ++i, ++dequeue_pos_) {
+			struct log_record *record
+				= &log_queue_[dequeue_pos_ & (LOG_QUEUE_SIZE-1)];
+			free(record->long_text);
+			record->long_text = NULL;
+			__atomic_store_n(&record->seq,
+					 dequeue_pos_ + LOG_QUEUE_SIZE,
+					 __ATOMIC_RELEASE);
+		}
+		total += records;
+		if (records < LOG_WRITE_BATCH)
+			break;
+	}
+	return total;
+}
+
+static void *log_writer_thread(void *userdata) {
+	for (;;) {
+		while (sem_wait(&queue_sem_) != 0) {
+			// EINTR; retry.
+		}
+		// We write everything that is there, so we don't need the
+		// wakeups that accumulated in the meantime.
+		while (sem_trywait(&queue_sem_) == 0) {
+			/* drain */
+		}
+		pthread_mutex_lock(&consumer_mutex_);
+		log_drain();
+		pthread_mutex_unlock(&consumer_mutex_);
+	}
+	return NULL;
+}
+
+// Write out everything that is queued right now from the calling thread.
+static void log_flush(void) {
+	if (log_queue_ == NULL)
+		return;
+	pthread_mutex_lock(&consumer_mutex_);
+	log_drain();
+	pthread_mutex_unlock(&consumer_mutex_);
+}
+
 void Log_init(const char *filename) {
 	if (filename == NULL)
 		return;
@@ -74,6 +346,161 @@ void Log_init(const char *filename) {
 		error_markup_start_ = kErrorHighlight;
 		markup_end_ = kTermReset;
 	}
+	init_log_queue();
+	invalidate_callsites();
+}
+
+static int parse_level(const char *name) {
+	if (strcmp(name, "off") == 0 || strcmp(name, "none") == 0)
+		return LOG_LEVEL_OFF;
+	if (strcmp(name, "error") == 0)
+		return LOG_LEVEL_ERROR;
+	if (strcmp(name, "info") == 0)
+		return LOG_LEVEL_INFO;
+	return -1;
+}
+
+static void free_levels(struct category_level *levels, int count) {
+	for (int i = 0; i < count; ++i) {
+		free(levels[i].category);
+	}
+	free(levels);
+}
+
+// Parse "category=level" entries separated by comma or whitespace; '#'
+// comments out the rest of the line. Returns 0 on parse error.
+static int parse_levels(const char *spec,
+			struct category_level **levels, int *count) {
+	*levels = NULL;
+	*count = 0;
+	char *copy = strdup(spec);
+	char *line_save = NULL;
+	int success = 1;
+	for (char *line = strtok_r(copy, "\n", &line_save); line != NULL;
+	     line = strtok_r(NULL, "\n", &line_save)) {
+		char *comment = strchr(line, '#');
+		if (comment) *comment = '\0';
+		char *entry_save = NULL;
+		for (char *entry = strtok_r(line, ", \t\r", &entry_save);
+		     entry != NULL;
+		     entry = strtok_r(NULL, ", \t\r", &entry_save)) {
+			char *eq = strchr(entry, '=');
+			const int level = eq ? parse_level(eq + 1) : -1;
+			if (level < 0) {
+				success = 0;
+				continue;
+			}
+			*eq = '\0';
+			*levels = realloc(*levels, (*count + 1)
+					  * sizeof(struct category_level));
+			(*levels)[*count].category = strdup(entry);
+			(*levels)[*count].level = level;
+			++*count;
+		}
+	}
+	free(copy);
+	return success;
+}
+
+// Needs to be called with levels_mutex_ held.
+static void read_levels_file(void) {
+	levels_reload_requested_ = 0;
+	free_levels(file_levels_, file_levels_count_);
+	file_levels_ = NULL;
+	file_levels_count_ = 0;
+	if (levels_file_ == NULL)
+		return;
+	FILE *f = fopen(levels_file_, "r");
+	if (f == NULL)
+		return;  // No file: no overrides.
+	char *content = NULL;
+	size_t content_len = 0;
+	char buffer[256];
+	size_t r;
+	while ((r = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		content = realloc(content, content_len + r + 1);
+		memcpy(content + content_len, buffer, r);
+		content_len += r;
+		content[content_len] = '\0';
+	}
+	fclose(f);
+	if (content != NULL) {
+		parse_levels(content, &file_levels_, &file_levels_count_);
+		free(content);
+	}
+}
+
+// Needs to be called with levels_mutex_ held.
+static int find_level(const struct category_level *levels, int count,
+		      const char *category, int *level) {
+	int found = 0;
+	for (int i = 0; i < count; ++i) {
+		if (strcmp(levels[i].category, category) == 0) {
+			*level = levels[i].level;
+			return 1;  // Specific setting wins.
+		}
+		if (strcmp(levels[i].category, "*") == 0) {
+			*level = levels[i].level;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+int Log_callsite_update_(struct log_callsite *site, int level,
+			 const char *category) {
+	pthread_mutex_lock(&levels_mutex_);
+	if (levels_reload_requested_) {
+		read_levels_file();
+	}
+	const int generation = __atomic_load_n(&log_levels_generation_,
+					       __ATOMIC_RELAXED);
+	int category_level = LOG_LEVEL_INFO;
+	if (!find_level(file_levels_, file_levels_count_, category,
+			&category_level)) {
+		find_level(spec_levels_, spec_levels_count_, category,
+			   &category_level);
+	}
+	pthread_mutex_unlock(&levels_mutex_);
+
+	// Info messages need a logfile.
+	const int max_level = log_fd >= 0 ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR;
+	const int enabled = (level <= category_level && level <= max_level);
+	__atomic_store_n(&site->enabled, enabled, __ATOMIC_RELAXED);
+	__atomic_store_n(&site->category, category, __ATOMIC_RELAXED);
+	__atomic_store_n(&site->generation, generation, __ATOMIC_RELEASE);
+	return enabled;
+}
+
+static void invalidate_callsites(void) {
+	__atomic_add_fetch(&log_levels_generation_, 1, __ATOMIC_RELEASE);
+}
+
+int Log_set_levels(const char *spec) {
+	struct category_level *levels;
+	int count;
+	const int success = parse_levels(spec, &levels, &count);
+	pthread_mutex_lock(&levels_mutex_);
+	free_levels(spec_levels_, spec_levels_count_);
+	spec_levels_ = levels;
+	spec_levels_count_ = count;
+	pthread_mutex_unlock(&levels_mutex_);
+	invalidate_callsites();
+	return success;
+}
+
+void Log_set_levels_file(const char *filename) {
+	pthread_mutex_lock(&levels_mutex_);
+	free(levels_file_);
+	levels_file_ = filename ? strdup(filename) : NULL;
+	read_levels_file();
+	pthread_mutex_unlock(&levels_mutex_);
+	invalidate_callsites();
+}
+
+void Log_request_levels_reload(void) {
+	levels_reload_requested_ = 1;
+	invalidate_callsites();
 }
 
 int Log_color_allowed(void) { return enable_color; }
@@ -108,18 +535,26 @@ static void Log_internal(int fd, const char *markup_start,
 	free(parts[1].iov_base);
 }
 
-void Log_info(const char *category, const char *format, ...) {
+void Log_info_message(const char *category, const char *format, ...) {
 	if (log_fd < 0) return;
 	va_list ap;
 	va_start(ap, format);
-	Log_internal(log_fd, info_markup_start_, category, format, ap);
+	if (log_queue_ != NULL) {
+		log_enqueue(info_markup_start_, category, format, ap);
+	} else {
+		Log_internal(log_fd, info_markup_start_, category, format, ap);
+	}
 	va_end(ap);
 }
 
-void Log_error(const char *category, const char *format, ...) {
+void Log_error_message(const char *category, const char *format, ...) {
 	va_list ap;
 	va_start(ap, format);
-	Log_internal(log_fd < 0 ? STDERR_FILENO : log_fd,
-		     error_markup_start_, category, format, ap);
+	if (log_queue_ != NULL) {
+		log_enqueue(error_markup_start_, category, format, ap);
+	} else {
+		Log_internal(log_fd < 0 ? STDERR_FILENO : log_fd,
+			     error_markup_start_, category, format, ap);
+	}
 	va_end(ap);
 }
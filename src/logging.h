@@ -28,16 +28,84 @@
 #define PRINTF_FMT_CHECK(fmt_pos, args_pos) \
     __attribute__ ((format (printf, fmt_pos, args_pos)))
 
+// Log levels, per category. A message is logged if its level is less or
+// equal to the level configured for its category.
+#define LOG_LEVEL_OFF   0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO  2
+
+// Messages above this level are compiled out entirely, including the
+// evaluation of their arguments (configure --disable-info-log sets this
+// to LOG_LEVEL_ERROR).
+#ifndef LOG_COMPILED_LEVEL
+#  define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#endif
+
 // With filename given, logs info and error to that file. If filename is NULL,
 // nothing is logged (TODO: log error to syslog).
+// Logging to a file is asynchronous: messages are queued and written by a
+// background thread (flushed at exit and before fork()). If the queue
+// overflows, messages are dropped and the number of dropped messages logged.
 void Log_init(const char *filename);
 int Log_color_allowed(void);  // Returns if we're allowed to use terminal color.
 int Log_info_enabled(void);
 int Log_error_enabled(void);
 
-void Log_info(const char *category, const char *format, ...)
+// Set levels per category from a spec such as "upnp=error,webserver=off";
+// the category "*" sets the default. Returns 0 if the spec can't be parsed.
+int Log_set_levels(const char *spec);
+
+// Set a file containing a level spec (entries separated by commas or
+// whitespace, '#' starts a comment). It is read now and again after each
+// Log_request_levels_reload(); its entries override Log_set_levels().
+void Log_set_levels_file(const char *filename);
+
+// Schedule re-reading the levels file. Async-signal-safe, so it can be
+// called from a SIGHUP handler; the file is read on the next log call.
+void Log_request_levels_reload(void);
+
+// Log_info() and Log_error() are macros: whether a call site is enabled is
+// cached at the call site and only re-evaluated when the levels change, and
+// the arguments are not evaluated if the message is not logged.
+#define Log_info(category, ...)						\
+	LOG_AT_LEVEL_(LOG_LEVEL_INFO, Log_info_message, category, __VA_ARGS__)
+#define Log_error(category, ...)					\
+	LOG_AT_LEVEL_(LOG_LEVEL_ERROR, Log_error_message, category, __VA_ARGS__)
+
+// -- Implementation details of the above macros.
+
+struct log_callsite {
+	const char *category;  // Category the state was computed for.
+	int generation;        // log_levels_generation_ it was computed at.
+	int enabled;
+};
+extern int log_levels_generation_;
+int Log_callsite_update_(struct log_callsite *site, int level,
+			 const char *category);
+
+static inline int Log_callsite_enabled_(struct log_callsite *site, int level,
+					const char *category) {
+	// Racy reads are fine: worst case we re-evaluate.
+	if (__atomic_load_n(&site->generation, __ATOMIC_ACQUIRE)
+	    == __atomic_load_n(&log_levels_generation_, __ATOMIC_RELAXED)
+	    && __atomic_load_n(&site->category, __ATOMIC_RELAXED) == category) {
+		return __atomic_load_n(&site->enabled, __ATOMIC_RELAXED);
+	}
+	return Log_callsite_update_(site, level, category);
+}
+
+#define LOG_AT_LEVEL_(level, print_fun, category, ...)			\
+	do {								\
+		static struct log_callsite log_site_;			\
+		if ((level) <= LOG_COMPILED_LEVEL			\
+		    && Log_callsite_enabled_(&log_site_, level, category)) { \
+			print_fun(category, __VA_ARGS__);		\
+		}							\
+	} while (0)
+
+void Log_info_message(const char *category, const char *format, ...)
 	PRINTF_FMT_CHECK(2, 3);
-void Log_error(const char *category, const char *format, ...)
+void Log_error_message(const char *category, const char *format, ...)
 	PRINTF_FMT_CHECK(2, 3);
 
 #endif /* _LOGGING_H */
@@ -33,6 +33,7 @@
 #include <glib.h>
 #include <limits.h>
 #include <locale.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,8 +54,11 @@
 #endif
 
 #include "git-version.h"
+#include "lockprof.h"
 #include "logging.h"
+#include "metrics.h"
 #include "output.h"
+#include "trace.h"
 #include "upnp_service.h"
 #include "upnp_control.h"
 #include "upnp_device.h"
@@ -83,7 +87,15 @@ static const gchar *friendly_name = PACKAGE_NAME;
 static const gchar *output = NULL;
 static const gchar *pid_file = NULL;
 static const gchar *log_file = NULL;
+static const gchar *log_levels = NULL;
+static const gchar *log_levels_file = NULL;
+static const gchar *trace_file = NULL;
+static int lock_profile_interval = 0;
 static const gchar *mime_filter = NULL;
+static gboolean check_mime_type = FALSE;
+static int stall_timeout = 0;
+static gboolean openhome = FALSE;
+static gchar **zones = NULL;
 
 /* Generic GMediaRender options */
 static GOptionEntry option_entries[] = {
@@ -109,8 +121,35 @@ static GOptionEntry option_entries[] = {
 	{ "mime-filter", 0, 0, G_OPTION_ARG_STRING, &mime_filter,
 	  "Filter the supported media types. "
 		"e.g. Audio only: '--mime-filter audio'. Disable FLAC: '--mime-filter -audio/x-flac'.", NULL },
+	{ "check-mime-type", 0, 0, G_OPTION_ARG_NONE, &check_mime_type,
+	  "Reject SetAVTransportURI early if the protocolInfo in the meta "
+	  "data announces an unsupported mime type.", NULL },
+	{ "stall-timeout", 0, 0, G_OPTION_ARG_INT, &stall_timeout,
+	  "Rebuild the playing pipeline if the position did not move for "
+	  "this many seconds; 0 = off.", NULL },
+	{ "openhome", 0, 0, G_OPTION_ARG_NONE, &openhome,
+	  "Also offer the OpenHome Playlist, Time, Info and Product "
+	  "services.", NULL },
 	{ "logfile", 0, 0, G_OPTION_ARG_STRING, &log_file,
 	  "Debug log filename. Use 'stdout' or 'stderr' to log to console.", NULL },
+	{ "log-levels", 0, 0, G_OPTION_ARG_STRING, &log_levels,
+	  "Log levels (off, error, info) per category, e.g. "
+	  "'upnp=error,webserver=off'; '*' sets the default.", NULL },
+	{ "log-levels-file", 0, 0, G_OPTION_ARG_STRING, &log_levels_file,
+	  "File with log levels in the format of --log-levels; re-read "
+	  "on SIGHUP.", NULL },
+	{ "trace-file", 0, 0, G_OPTION_ARG_STRING, &trace_file,
+	  "Record timing of actions, output calls and events; written "
+	  "to this file at exit in Chrome trace (JSON) format.", NULL },
+	{ "lock-profile", 0, 0, G_OPTION_ARG_INT, &lock_profile_interval,
+	  "Profile wait and hold times of the service locks per call site; "
+	  "log percentiles every given number of seconds and export them "
+	  "in /metrics.", NULL },
+	{ "zone", 0, 0, G_OPTION_ARG_STRING_ARRAY, &zones,
+	  "Host a renderer with these options instead of the default one, "
+	  "e.g. \"-f Kitchen --gstout-audiodevice=hw:1\". Given multiple "
+	  "times, hosts one renderer per zone in this process; each can set "
+	  "-f, -u, --gstout-audiosink and --gstout-audiodevice.", NULL },
 	{ "list-outputs", 0, 0, G_OPTION_ARG_NONE, &show_outputs,
 	  "List available output modules and exit", NULL },
 	{ "dump-devicedesc", 0, 0, G_OPTION_ARG_NONE, &show_devicedesc,
@@ -182,6 +221,60 @@ static gboolean process_cmdline(int argc, char **argv)
 	return TRUE;
 }
 
+// A renderer of its own within this process; see --zone.
+struct zone {
+	gchar *friendly_name;
+	gchar *uuid;
+	gchar *audio_sink;    // NULL: the one configured for the output.
+	gchar *audio_device;
+	struct upnp_renderer *renderer;
+	struct upnp_device *device;
+};
+
+// Parse the options of zone "index". Where they don't set their own, uuid
+// and name are derived from the common ones, so that the zones don't clash.
+static gboolean parse_zone(int index, struct zone *zone) {
+	GOptionEntry zone_entries[] = {
+		{ "friendly-name", 'f', 0, G_OPTION_ARG_STRING,
+		  &zone->friendly_name, "Friendly name to advertise.", NULL },
+		{ "uuid", 'u', 0, G_OPTION_ARG_STRING, &zone->uuid,
+		  "UUID to advertise", NULL },
+		{ "gstout-audiosink", 0, 0, G_OPTION_ARG_STRING,
+		  &zone->audio_sink, "GStreamer audio sink to use", NULL },
+		{ "gstout-audiodevice", 0, 0, G_OPTION_ARG_STRING,
+		  &zone->audio_device, "GStreamer device for the sink", NULL },
+		{ NULL }
+	};
+	gint zone_argc = 0;
+	gchar **zone_argv = NULL;
+	GError *err = NULL;
+	char *cmdline = g_strdup_printf("zone %s", zones[index]);
+	gboolean ok = g_shell_parse_argv(cmdline, &zone_argc, &zone_argv, &err);
+	g_free(cmdline);
+	if (ok) {
+		GOptionContext *ctx = g_option_context_new(NULL);
+		g_option_context_add_main_entries(ctx, zone_entries, NULL);
+		ok = g_option_context_parse(ctx, &zone_argc, &zone_argv, &err);
+		g_option_context_free(ctx);
+	}
+	if (!ok) {
+		fprintf(stderr, "Invalid --zone '%s': %s\n",
+			zones[index], err->message);
+		g_error_free(err);
+	} else if (zone_argc > 1) {
+		fprintf(stderr, "Invalid --zone '%s': unexpected '%s'\n",
+			zones[index], zone_argv[1]);
+		ok = FALSE;
+	}
+	g_strfreev(zone_argv);
+	if (zone->uuid == NULL)
+		zone->uuid = g_strdup_printf("%s-%d", uuid, index + 1);
+	if (zone->friendly_name == NULL)
+		zone->friendly_name = g_strdup_printf("%s (%d)", friendly_name,
+						      index + 1);
+	return ok;
+}
+
 static void log_variable_change(void *userdata, int var_num,
 				const char *variable_name,
 				const char *old_value,
@@ -199,6 +292,32 @@ static void log_variable_change(void *userdata, int var_num,
 		 variable_value, needs_newline ? "\n" : "");
 }
 
+static void reload_log_levels_sighandler(int sig) {
+	(void)sig;
+	Log_request_levels_reload();
+}
+
+static void log_startup_phase(const char *phase, int64_t start_us,
+			      int64_t end_us) {
+	Log_info("startup", "%-20s %8.1fms", phase, (end_us - start_us) / 1e3);
+}
+
+// The output module initializes in its own thread while libupnp comes up.
+struct output_init_job {
+	const char *output;
+	int rc;
+	int64_t start_us;
+	int64_t end_us;
+};
+
+static void *output_init_thread(void *userdata) {
+	struct output_init_job *job = (struct output_init_job*) userdata;
+	job->start_us = Metrics_now_us();
+	job->rc = output_init(job->output);
+	job->end_us = Metrics_now_us();
+	return NULL;
+}
+
 static void init_logging(const char *log_file) {
 	char version[1024];
 	GetVersionInfo(version, sizeof(version));
@@ -218,8 +337,9 @@ static void init_logging(const char *log_file) {
 
 int main(int argc, char **argv)
 {
-	int rc;
-	struct upnp_device_descriptor *upnp_renderer;
+	const int64_t startup_us = Metrics_now_us();
+	struct zone *zone_list;
+	int zone_count = 0;
 
 	// According to the official GLib documentation (https://docs.gtk.org/glib/running.html#locale),
 	// many GLib interfaces rely on the application's current locale.
@@ -234,6 +354,8 @@ int main(int argc, char **argv)
 	if (!process_cmdline(argc, argv)) {
 		return EXIT_FAILURE;
 	}
+	// This includes initializing GStreamer and checking its registry.
+	const int64_t cmdline_done_us = Metrics_now_us();
 
 	if (show_version) {
 		do_show_version();
@@ -257,7 +379,57 @@ int main(int argc, char **argv)
 		exit(EXIT_SUCCESS);
 	}
 
+	if (zones != NULL) {
+		if (openhome) {
+			fprintf(stderr, "--openhome can't be combined with "
+				"--zone\n");
+			return EXIT_FAILURE;
+		}
+		while (zones[zone_count]) ++zone_count;
+#if UPNP_VERSION < 10800
+		// Older libupnp only registers a single root device.
+		if (zone_count > 1) {
+			fprintf(stderr, "More than one --zone needs libupnp "
+				"1.8 or newer\n");
+			return EXIT_FAILURE;
+		}
+#endif
+		zone_list = g_new0(struct zone, zone_count);
+		for (int i = 0; i < zone_count; ++i) {
+			if (!parse_zone(i, &zone_list[i]))
+				return EXIT_FAILURE;
+		}
+	} else {
+		zone_count = 1;
+		zone_list = g_new0(struct zone, 1);
+		zone_list[0].friendly_name = g_strdup(friendly_name);
+		zone_list[0].uuid = g_strdup(uuid);
+	}
+
 	init_logging(log_file);
+	log_startup_phase("options", startup_us, cmdline_done_us);
+	if (log_levels != NULL && !Log_set_levels(log_levels)) {
+		fprintf(stderr, "Invalid --log-levels '%s'\n", log_levels);
+		return EXIT_FAILURE;
+	}
+	if (log_levels_file != NULL) {
+		// Daemon mode changes cwd; the file is re-read later.
+		char *levels_file = NULL;
+		if (log_levels_file[0] != '/') {
+			char cwd[PATH_MAX];
+			if (getcwd(cwd, sizeof(cwd)) != NULL)
+				levels_file = g_build_filename(
+					cwd, log_levels_file, NULL);
+		}
+		Log_set_levels_file(levels_file ? levels_file
+				    : log_levels_file);
+		g_free(levels_file);
+		signal(SIGHUP, &reload_log_levels_sighandler);
+	}
+
+	if (trace_file != NULL && !Trace_init(trace_file)) {
+		return EXIT_FAILURE;
+	}
 
 	// Now we're going to start threads etc, which means we need
 	// to become a daemon before that.
@@ -280,19 +452,15 @@ int main(int argc, char **argv)
 		fclose(pid_file_stream);
 	}
 
-	upnp_renderer = upnp_renderer_descriptor(friendly_name, uuid, mime_filter);
-	if (upnp_renderer == NULL) {
-		return EXIT_FAILURE;
+	if (lock_profile_interval > 0) {
+		// Needs to be enabled before the services are created.
+		LockProfile_enable(lock_profile_interval);
 	}
 
-	rc = output_init(output);
-	if (rc != 0) {
-		Log_error("main",
-			  "ERROR: Failed to initialize Output subsystem");
-		return EXIT_FAILURE;
+	if (openhome) {
+		upnp_renderer_enable_openhome();
 	}
 
-	struct upnp_device *device;
 	if (listen_port != 0 &&
 	    (listen_port < 49152 || listen_port > 65535)) {
 		// Somewhere obscure internally in libupnp, they clamp the
@@ -304,43 +472,119 @@ int main(int argc, char **argv)
 			  listen_port);
 		return EXIT_FAILURE;
 	}
-	device = upnp_device_init(upnp_renderer, interface_name, listen_port);
-	if (device == NULL) {
+
+	// Loading the output plugins and bringing up the network (which
+	// might need to wait for the interface) are the slow parts of
+	// startup and independent of each other, so run them in parallel.
+	// The device can only be created once the output registered the
+	// mime types it supports.
+	struct output_init_job output_job = { output, -1, 0, 0 };
+	pthread_t output_thread;
+	const int output_threaded = (pthread_create(&output_thread, NULL,
+						    output_init_thread,
+						    &output_job) == 0);
+	if (!output_threaded) {
+		output_init_thread(&output_job);  // Do it ourselves then.
+	}
+
+	int64_t phase_start_us = Metrics_now_us();
+	const int network_ok = upnp_device_network_init(interface_name,
+							listen_port);
+	log_startup_phase("network", phase_start_us, Metrics_now_us());
+
+	phase_start_us = Metrics_now_us();
+	if (output_threaded) {
+		pthread_join(output_thread, NULL);
+	}
+	log_startup_phase("output", output_job.start_us, output_job.end_us);
+	log_startup_phase("waiting for output", phase_start_us,
+			  Metrics_now_us());
+	if (output_job.rc != 0) {
+		Log_error("main",
+			  "ERROR: Failed to initialize Output subsystem");
+		return EXIT_FAILURE;
+	}
+	if (!network_ok) {
 		Log_error("main", "ERROR: Failed to initialize UPnP device");
 		return EXIT_FAILURE;
 	}
 
-	upnp_transport_init(device);
-	upnp_control_init(device);
+	// One renderer per zone, each a device of its own. They share the
+	// output module (and with it GStreamer) and libupnp with its port.
+	phase_start_us = Metrics_now_us();
+	upnp_transport_set_check_mime_type(check_mime_type);
+	upnp_transport_set_stall_timeout(stall_timeout);
+	for (int i = 0; i < zone_count; ++i) {
+		struct zone *zone = &zone_list[i];
+		struct output *out = output_new(zone->audio_sink,
+						zone->audio_device);
+		if (out == NULL) {
+			Log_error("main", "ERROR: Failed to create output for "
+				  "'%s'", zone->friendly_name);
+			return EXIT_FAILURE;
+		}
+		zone->renderer = upnp_renderer_new(i + 1, zone->friendly_name,
+						   zone->uuid, mime_filter,
+						   out);
+		if (zone->renderer == NULL) {
+			return EXIT_FAILURE;
+		}
+		zone->device = upnp_device_init(
+			upnp_renderer_get_descriptor(zone->renderer),
+			interface_name, listen_port);
+		if (zone->device == NULL) {
+			Log_error("main", "ERROR: Failed to initialize UPnP "
+				  "device for '%s'", zone->friendly_name);
+			return EXIT_FAILURE;
+		}
+	}
+	log_startup_phase("device", phase_start_us, Metrics_now_us());
+
+	phase_start_us = Metrics_now_us();
+	for (int i = 0; i < zone_count; ++i) {
+		upnp_renderer_start(zone_list[i].renderer, zone_list[i].device);
+	}
+	log_startup_phase("services", phase_start_us, Metrics_now_us());
 
 	if (show_devicedesc) {
 		// This can only be run after all services have been
 		// initialized.
-		char *buf = upnp_create_device_desc(upnp_renderer);
+		char *buf = upnp_create_device_desc(
+			upnp_renderer_get_descriptor(zone_list[0].renderer));
 		assert(buf != NULL);
 		fputs(buf, stdout);
 		exit(EXIT_SUCCESS);
 	}
 
-	if (Log_info_enabled()) {
-		upnp_transport_register_variable_listener(log_variable_change,
-							  (void*) "transport");
-		upnp_control_register_variable_listener(log_variable_change,
-							(void*) "control");
+	for (int i = 0; i < zone_count; ++i) {
+		struct zone *zone = &zone_list[i];
+		if (Log_info_enabled()) {
+			upnp_transport_register_variable_listener(
+				upnp_renderer_get_transport(zone->renderer),
+				log_variable_change, (void*) "transport");
+			upnp_control_register_variable_listener(
+				upnp_renderer_get_control(zone->renderer),
+				log_variable_change, (void*) "control");
+		}
 	}
 
-	// Write both to the log (which might be disabled) and console.
-	Log_info("main", "Ready for rendering ('%s'; uuid=%s).",
-		 friendly_name, uuid);
-	fprintf(stderr, "Ready for rendering ('%s'; uuid=%s).\n",
-		friendly_name, uuid);
+	log_startup_phase("total", startup_us, Metrics_now_us());
+	for (int i = 0; i < zone_count; ++i) {
+		// Write both to the log (which might be disabled) and console.
+		Log_info("main", "Ready for rendering ('%s'; uuid=%s).",
+			 zone_list[i].friendly_name, zone_list[i].uuid);
+		fprintf(stderr, "Ready for rendering ('%s'; uuid=%s).\n",
+			zone_list[i].friendly_name, zone_list[i].uuid);
+	}
 
 	output_loop();
 
 	// We're here, because the loop exited. Probably due to catching
 	// a signal.
 	Log_info("main", "Exiting.");
-	upnp_device_shutdown(device);
+	for (int i = zone_count - 1; i >= 0; --i) {
+		upnp_device_shutdown(zone_list[i].device);
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,541 @@
+/* media_cache.c - Keep played tracks on disk for the next time.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "media_cache.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "logging.h"
+
+// Each entry is a file named by its key hash with the content, and the same
+// name with ".uri" holding the URI it came from and, on a second line, its
+// ETag. The modification time of the content file is the last use.
+#define URI_SUFFIX ".uri"
+#define FILL_PREFIX "fill-"
+
+// How long to wait for the server to confirm that our copy is current.
+static const int kRevalidateTimeoutSec = 3;
+
+enum validation {
+	COPY_UNKNOWN,  // Not asked yet, or server not reachable or not telling.
+	COPY_CURRENT,
+	COPY_STALE,
+};
+
+struct cache_entry {
+	char *hash;
+	char *uri;
+	char *etag;    // NULL if the server didn't send one.
+	int64_t size;  // Also the Content-Length.
+	time_t last_used;
+	enum validation verdict;  // Last answer of the server.
+	int revalidating;         // Asking the server right now.
+	struct cache_entry *next;
+};
+
+struct media_cache_fill {
+	char *uri;
+	char *etag;
+	int64_t content_length;
+	char *tmp_path;
+	FILE *out;
+	uint64_t written;
+	int failed;
+};
+
+static pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static char *dir_ = NULL;
+static int64_t max_bytes_ = 0;
+static unsigned int fill_count_ = 0;
+
+// Guarded by mutex_
+static struct cache_entry *entries_ = NULL;
+static int64_t total_bytes_ = 0;
+static unsigned int plays_ = 0;
+static unsigned int hits_ = 0;
+static int64_t bytes_saved_ = 0;
+
+static char *entry_path(const char *hash, const char *suffix) {
+	return g_strdup_printf("%s/%s%s", dir_, hash, suffix);
+}
+
+static void entry_free(struct cache_entry *entry) {
+	g_free(entry->hash);
+	g_free(entry->uri);
+	g_free(entry->etag);
+	free(entry);
+}
+
+// Unlinks the entry from the list and removes its files. Needs mutex_.
+static void remove_entry_locked(struct cache_entry *entry) {
+	for (struct cache_entry **e = &entries_; *e; e = &(*e)->next) {
+		if (*e == entry) {
+			*e = entry->next;
+			break;
+		}
+	}
+	char *path = entry_path(entry->hash, "");
+	unlink(path);
+	g_free(path);
+	path = entry_path(entry->hash, URI_SUFFIX);
+	unlink(path);
+	g_free(path);
+	total_bytes_ -= entry->size;
+	entry_free(entry);
+}
+
+static void evict_locked(void) {
+	while (total_bytes_ > max_bytes_ && entries_ != NULL) {
+		struct cache_entry *oldest = entries_;
+		for (struct cache_entry *e = entries_; e; e = e->next) {
+			if (e->last_used < oldest->last_used)
+				oldest = e;
+		}
+		Log_info("cache", "Evicting %s", oldest->uri);
+		remove_entry_locked(oldest);
+	}
+}
+
+static void log_stats_locked(void) {
+	int count = 0;
+	for (struct cache_entry *e = entries_; e; e = e->next)
+		++count;
+	Log_info("cache", "%d entries, %" G_GINT64_FORMAT "MB; "
+		 "hits %u/%u (%.0f%%), %" G_GINT64_FORMAT "MB saved",
+		 count, total_bytes_ >> 20,
+		 hits_, plays_, plays_ ? 100.0 * hits_ / plays_ : 0.0,
+		 bytes_saved_ >> 20);
+}
+
+// Pick up an existing entry from disk. Needs mutex_.
+static void load_entry_locked(const char *name) {
+	char *path = entry_path(name, "");
+	char *uri_path = entry_path(name, URI_SUFFIX);
+	char *content = NULL;
+	struct stat st;
+	if (stat(path, &st) == 0
+	    && g_file_get_contents(uri_path, &content, NULL, NULL)) {
+		char **lines = g_strsplit(content, "\n", 3);
+		g_free(content);
+		struct cache_entry *entry = (struct cache_entry*)
+			calloc(1, sizeof(*entry));
+		entry->hash = g_strdup(name);
+		entry->uri = g_strdup(lines[0] ? lines[0] : "");
+		if (lines[0] && lines[1] && strlen(lines[1]) > 0)
+			entry->etag = g_strdup(lines[1]);
+		g_strfreev(lines);
+		entry->size = st.st_size;
+		entry->last_used = st.st_mtime;
+		entry->next = entries_;
+		entries_ = entry;
+		total_bytes_ += entry->size;
+	} else {
+		unlink(path);  // Incomplete entry.
+		unlink(uri_path);
+	}
+	g_free(path);
+	g_free(uri_path);
+}
+
+int MediaCache_init(const char *dir, int64_t max_bytes) {
+	if (!g_path_is_absolute(dir)) {
+		// We might be a daemon with / as working directory by now.
+		Log_error("cache", "Need an absolute path, got '%s'", dir);
+		return -1;
+	}
+	if (g_mkdir_with_parents(dir, 0700) < 0) {
+		Log_error("cache", "Can't create '%s': %s", dir,
+			  strerror(errno));
+		return -1;
+	}
+	GDir *d = g_dir_open(dir, 0, NULL);
+	if (d == NULL) {
+		Log_error("cache", "Can't read '%s'", dir);
+		return -1;
+	}
+	pthread_mutex_lock(&mutex_);
+	dir_ = strdup(dir);
+	max_bytes_ = max_bytes;
+	const char *name;
+	while ((name = g_dir_read_name(d)) != NULL) {
+		int pid;
+		if (sscanf(name, FILL_PREFIX "%d-", &pid) == 1) {
+			// Fills of earlier runs, not of other live processes
+			// (zones) sharing the directory.
+			if (kill(pid, 0) < 0 && errno == ESRCH) {
+				char *path = entry_path(name, "");
+				unlink(path);
+				g_free(path);
+			}
+		} else if (strlen(name) == 40) {  // SHA1 in hex.
+			load_entry_locked(name);
+		}
+	}
+	g_dir_close(d);
+	evict_locked();
+	log_stats_locked();
+	pthread_mutex_unlock(&mutex_);
+	return 0;
+}
+
+// Asks the server with a HEAD request if "uri" still is what we stored
+// with "etag" (can be NULL) and "size".
+static enum validation revalidate(const char *uri, const char *etag,
+				  int64_t size) {
+	const int is_https = g_str_has_prefix(uri, "https:");
+	const char *authority = strstr(uri, "://");
+	if (authority == NULL)
+		return COPY_UNKNOWN;
+	authority += 3;
+	const char *path = strchr(authority, '/');
+	char *host = (path != NULL ? g_strndup(authority, path - authority)
+		      : g_strdup(authority));
+	enum validation result = COPY_UNKNOWN;
+	GError *error = NULL;
+	GSocketClient *client = g_socket_client_new();
+	g_socket_client_set_timeout(client, kRevalidateTimeoutSec);
+	g_socket_client_set_tls(client, is_https);
+	GSocketConnection *connection = g_socket_client_connect_to_uri(
+		client, uri, is_https ? 443 : 80, NULL, &error);
+	if (connection == NULL) {
+		Log_info("cache", "Can't revalidate %s: %s", uri,
+			 error->message);
+		g_error_free(error);
+		g_object_unref(client);
+		g_free(host);
+		return COPY_UNKNOWN;
+	}
+	char *request = g_strdup_printf("HEAD %s HTTP/1.1\r\n"
+					"Host: %s\r\n"
+					"%s%s%s"
+					"Connection: close\r\n\r\n",
+					path != NULL ? path : "/", host,
+					etag ? "If-None-Match: " : "",
+					etag ? etag : "", etag ? "\r\n" : "");
+	GDataInputStream *in = g_data_input_stream_new(
+		g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_data_input_stream_set_newline_type(in,
+					     G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+	int status = 0;
+	char *server_etag = NULL;
+	int64_t content_length = -1;
+	if (g_output_stream_write_all(
+		    g_io_stream_get_output_stream(G_IO_STREAM(connection)),
+		    request, strlen(request), NULL, NULL, &error)) {
+		char *line = g_data_input_stream_read_line(in, NULL, NULL,
+							   &error);
+		if (line == NULL || sscanf(line, "HTTP/%*s %d", &status) != 1)
+			status = 0;
+		while (line != NULL && strlen(line) > 0) {
+			g_free(line);
+			line = g_data_input_stream_read_line(in, NULL, NULL,
+							     &error);
+			if (line == NULL)
+				break;
+			char *value = strchr(line, ':');
+			if (value == NULL)
+				continue;
+			*value++ = '\0';
+			value = g_strstrip(value);
+			if (g_ascii_strcasecmp(line, "ETag") == 0) {
+				g_free(server_etag);
+				server_etag = g_strdup(value);
+			} else if (g_ascii_strcasecmp(line,
+						      "Content-Length") == 0) {
+				content_length =
+					g_ascii_strtoll(value, NULL, 10);
+			}
+		}
+		g_free(line);
+	}
+	if (error != NULL) {
+		Log_info("cache", "Can't revalidate %s: %s", uri,
+			 error->message);
+		g_error_free(error);
+	} else if (status == 304) {
+		result = COPY_CURRENT;
+	} else if (status == 404 || status == 410) {
+		result = COPY_STALE;
+	} else if (status == 200) {
+		// Server might not do conditional HEAD; compare ourselves.
+		if (etag != NULL && server_etag != NULL) {
+			result = (strcmp(etag, server_etag) == 0
+				  ? COPY_CURRENT : COPY_STALE);
+		} else if (content_length >= 0) {
+			result = (content_length == size
+				  ? COPY_CURRENT : COPY_STALE);
+		}
+	}
+	g_free(server_etag);
+	g_free(request);
+	g_object_unref(in);
+	g_object_unref(connection);
+	g_object_unref(client);
+	g_free(host);
+	return result;
+}
+
+// The newest entry for "uri", if it was stored with different validators.
+// Needs mutex_.
+static struct cache_entry *find_entry_locked(const char *uri) {
+	struct cache_entry *found = NULL;
+	for (struct cache_entry *e = entries_; e; e = e->next) {
+		if (strcmp(e->uri, uri) == 0
+		    && (found == NULL || e->last_used > found->last_used)) {
+			found = e;
+		}
+	}
+	return found;
+}
+
+struct revalidation {
+	char *uri;
+	char *hash;
+	char *etag;
+	int64_t size;
+};
+
+static void revalidation_free(struct revalidation *job) {
+	g_free(job->uri);
+	g_free(job->hash);
+	g_free(job->etag);
+	free(job);
+}
+
+static void *revalidate_thread(void *userdata) {
+	struct revalidation *job = (struct revalidation*) userdata;
+	const enum validation verdict = revalidate(job->uri, job->etag,
+						   job->size);
+	pthread_mutex_lock(&mutex_);
+	struct cache_entry *found = find_entry_locked(job->uri);
+	if (found != NULL && strcmp(found->hash, job->hash) == 0) {
+		found->revalidating = 0;
+		if (verdict == COPY_STALE) {
+			Log_info("cache", "Dropping outdated copy of %s",
+				 job->uri);
+			remove_entry_locked(found);
+		} else {
+			// If unknown, keep it for when the server is back.
+			found->verdict = verdict;
+		}
+	}
+	pthread_mutex_unlock(&mutex_);
+	revalidation_free(job);
+	return NULL;
+}
+
+void MediaCache_revalidate(const char *uri) {
+	if (dir_ == NULL || uri == NULL)
+		return;
+	pthread_mutex_lock(&mutex_);
+	struct cache_entry *found = find_entry_locked(uri);
+	if (found == NULL || found->revalidating) {
+		pthread_mutex_unlock(&mutex_);
+		return;
+	}
+	found->revalidating = 1;
+	struct revalidation *job = (struct revalidation*)
+		calloc(1, sizeof(*job));
+	job->uri = g_strdup(uri);
+	job->hash = g_strdup(found->hash);
+	job->etag = g_strdup(found->etag);
+	job->size = found->size;
+	pthread_mutex_unlock(&mutex_);
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, revalidate_thread, job) != 0) {
+		Log_error("cache", "Can't start revalidating %s", uri);
+		pthread_mutex_lock(&mutex_);
+		found = find_entry_locked(uri);
+		if (found != NULL && strcmp(found->hash, job->hash) == 0)
+			found->revalidating = 0;
+		pthread_mutex_unlock(&mutex_);
+		revalidation_free(job);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+char *MediaCache_lookup(const char *uri) {
+	if (dir_ == NULL || uri == NULL)
+		return NULL;
+	char *result = NULL;
+	pthread_mutex_lock(&mutex_);
+	struct cache_entry *found = find_entry_locked(uri);
+	if (found != NULL && found->verdict == COPY_CURRENT) {
+		char *path = entry_path(found->hash, "");
+		if (utime(path, NULL) == 0) {
+			found->last_used = time(NULL);
+			result = g_filename_to_uri(path, NULL, NULL);
+		} else {
+			// Evicted by another process sharing the directory.
+			remove_entry_locked(found);
+		}
+		g_free(path);
+	}
+	pthread_mutex_unlock(&mutex_);
+	return result;
+}
+
+void MediaCache_count_play(const char *uri, int from_cache) {
+	if (dir_ == NULL || uri == NULL || !g_str_has_prefix(uri, "http"))
+		return;
+	pthread_mutex_lock(&mutex_);
+	++plays_;
+	if (from_cache) {
+		++hits_;
+		struct cache_entry *entry = find_entry_locked(uri);
+		if (entry != NULL)
+			bytes_saved_ += entry->size;
+	}
+	log_stats_locked();
+	pthread_mutex_unlock(&mutex_);
+}
+
+struct media_cache_fill *MediaCache_fill_begin(const char *uri) {
+	if (dir_ == NULL || uri == NULL)
+		return NULL;
+	pthread_mutex_lock(&mutex_);
+	char *tmp_path = g_strdup_printf("%s/" FILL_PREFIX "%d-%u", dir_,
+					 (int) getpid(), ++fill_count_);
+	pthread_mutex_unlock(&mutex_);
+	FILE *out = fopen(tmp_path, "we");
+	if (out == NULL) {
+		Log_error("cache", "%s: %s", tmp_path, strerror(errno));
+		g_free(tmp_path);
+		return NULL;
+	}
+	struct media_cache_fill *fill = (struct media_cache_fill*)
+		calloc(1, sizeof(*fill));
+	fill->uri = g_strdup(uri);
+	fill->content_length = -1;
+	fill->tmp_path = tmp_path;
+	fill->out = out;
+	return fill;
+}
+
+void MediaCache_fill_set_validators(struct media_cache_fill *fill,
+				    const char *etag, int64_t content_length) {
+	if (fill->written > 0)
+		return;  // Response to a resume; only has the rest's length.
+	g_free(fill->etag);
+	fill->etag = g_strdup(etag);
+	fill->content_length = content_length;
+}
+
+void MediaCache_fill_write(struct media_cache_fill *fill,
+			   uint64_t offset, const void *data, size_t len) {
+	if (fill->failed)
+		return;
+	if (offset != fill->written
+	    || (int64_t) (fill->written + len) > max_bytes_
+	    || fwrite(data, 1, len, fill->out) != len) {
+		fill->failed = 1;
+		return;
+	}
+	fill->written += len;
+}
+
+// Move the complete fill into place as a new entry.
+static void commit_fill(struct media_cache_fill *fill) {
+	char *key = g_strdup_printf("%s\n%s\n%" G_GINT64_FORMAT, fill->uri,
+				    fill->etag ? fill->etag : "",
+				    fill->content_length);
+	char *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, key, -1);
+	g_free(key);
+
+	pthread_mutex_lock(&mutex_);
+	char *path = entry_path(hash, "");
+	char *uri_path = entry_path(hash, URI_SUFFIX);
+	// Replace what we had for the URI; it is outdated or the same.
+	for (struct cache_entry *e = entries_; e; /**/) {
+		struct cache_entry *next = e->next;
+		if (strcmp(e->uri, fill->uri) == 0)
+			remove_entry_locked(e);
+		e = next;
+	}
+	char *sidecar = g_strdup_printf("%s\n%s\n", fill->uri,
+					fill->etag ? fill->etag : "");
+	if (g_file_set_contents(uri_path, sidecar, -1, NULL)
+	    && rename(fill->tmp_path, path) == 0) {
+		struct cache_entry *entry = (struct cache_entry*)
+			calloc(1, sizeof(*entry));
+		entry->hash = hash;
+		entry->uri = g_strdup(fill->uri);
+		entry->etag = g_strdup(fill->etag);
+		entry->size = fill->written;
+		entry->last_used = time(NULL);
+		entry->verdict = COPY_CURRENT;  // Just got it from the server.
+		entry->next = entries_;
+		entries_ = entry;
+		total_bytes_ += entry->size;
+		hash = NULL;
+		Log_info("cache", "Stored %s (%" G_GINT64_FORMAT " bytes)",
+			 fill->uri, entry->size);
+		evict_locked();
+		log_stats_locked();
+	} else {
+		Log_error("cache", "Can't store %s: %s", path, strerror(errno));
+		unlink(uri_path);
+	}
+	pthread_mutex_unlock(&mutex_);
+	g_free(sidecar);
+	g_free(path);
+	g_free(uri_path);
+	g_free(hash);
+}
+
+void MediaCache_fill_end(struct media_cache_fill *fill, int complete) {
+	if (fill == NULL)
+		return;
+	if (fclose(fill->out) != 0)
+		fill->failed = 1;
+	if (complete && !fill->failed && fill->written > 0
+	    && (fill->content_length < 0
+		|| (int64_t) fill->written == fill->content_length)) {
+		commit_fill(fill);
+	}
+	unlink(fill->tmp_path);  // If not committed.
+	g_free(fill->uri);
+	g_free(fill->etag);
+	g_free(fill->tmp_path);
+	free(fill);
+}
@@ -0,0 +1,78 @@
+/* media_cache.h - Keep played tracks on disk for the next time.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#ifndef _MEDIA_CACHE_H
+#define _MEDIA_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Persistent disk cache of streams we played, for playlists that repeat the
+// same tracks. A stream is stored under a hash of its URI, ETag and
+// Content-Length; if a server serves something new under a known URI, the
+// next complete play stores it as a new entry. When over the size limit,
+// the least recently used entries are removed.
+//
+// The cache is filled while playing: the bytes coming from the network are
+// handed to a media_cache_fill; only streams played from start to end
+// without seeking make it into the cache.
+
+// Use "dir" for the cache, holding at most "max_bytes". Picks up what is
+// already there. Returns 0 on success.
+int MediaCache_init(const char *dir, int64_t max_bytes);
+
+// If "uri" is cached, asks the server in the background if our copy is
+// still current (ETag, Content-Length). Outdated copies are removed. Call
+// this when a uri is coming up, so that the answer is in when it plays.
+void MediaCache_revalidate(const char *uri);
+
+// If "uri" is cached and the server last confirmed our copy, returns a newly
+// allocated file:// URI of the copy (to be g_free()d) and marks it recently
+// used. Otherwise NULL, also while the answer is outstanding. Doesn't block
+// on the network.
+char *MediaCache_lookup(const char *uri);
+
+// Tell that "uri" started playing, from the copy returned by
+// MediaCache_lookup() if "from_cache", else from the network. Counts for
+// the hit rate and bytes saved.
+void MediaCache_count_play(const char *uri, int from_cache);
+
+struct media_cache_fill;
+
+// Start recording the stream of "uri". NULL if the cache is not in use.
+struct media_cache_fill *MediaCache_fill_begin(const char *uri);
+
+// Validators as reported by the server; either can be NULL or -1. Only
+// the ones before the first data count.
+void MediaCache_fill_set_validators(struct media_cache_fill *fill,
+				    const char *etag, int64_t content_length);
+
+// Append data found at byte "offset" of the stream. A gap or overlap means
+// we are not seeing the stream in one go (seek); the fill is abandoned.
+void MediaCache_fill_write(struct media_cache_fill *fill,
+			   uint64_t offset, const void *data, size_t len);
+
+// Done with the fill. If "complete", i.e. we saw the end of the stream, the
+// copy goes into the cache. Frees "fill".
+void MediaCache_fill_end(struct media_cache_fill *fill, int complete);
+
+#endif  // _MEDIA_CACHE_H
@@ -0,0 +1,343 @@
+/* metrics.c - Counters and latency histograms, exported for Prometheus.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <glib.h>
+
+#include "lockprof.h"
+
+// Upper bounds of the histogram buckets in microseconds; there is an
+// implicit last +Inf bucket.
+static const int64_t kBucketBounds[] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+	100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+#define BUCKET_COUNT (sizeof(kBucketBounds) / sizeof(kBucketBounds[0]) + 1)
+
+struct histogram {
+	uint64_t buckets[BUCKET_COUNT];  // Not cumulative.
+	uint64_t count;
+	uint64_t sum_us;
+};
+
+// Actions are a small, fixed set; we keep their names in a table whose
+// slots are claimed with compare-and-swap on first use of an action name.
+#define MAX_ACTIONS 64
+
+// Threads are spread round-robin over shards, each on its own cache lines,
+// so that busy threads don't contend on the same counters. Threads sharing a
+// shard still use atomic adds. Metrics_to_text() sums up the shards.
+#define SHARD_COUNT 8
+struct metrics_shard {
+	uint64_t counters[METRIC_COUNTER_COUNT];
+	struct histogram lock_waits[METRIC_LOCK_COUNT];
+	uint64_t action_errors[MAX_ACTIONS];
+	struct histogram action_latency[MAX_ACTIONS];
+} __attribute__((aligned(64)));
+
+static struct metrics_shard shards_[SHARD_COUNT];
+static unsigned int next_shard_ = 0;
+static __thread struct metrics_shard *thread_shard_ = NULL;
+
+static int64_t gauges_[METRIC_GAUGE_COUNT];
+static const char *action_names_[MAX_ACTIONS];  // Set once, never changed.
+
+// libupnp handles renewals, unsubscribes and expiry itself without telling
+// us, so a subscription counts as active until its timeout has passed since
+// it was made, or its device is unregistered. sid -> struct subscription.
+struct subscription {
+	const void *owner;
+	int64_t expires_us;
+};
+static pthread_mutex_t subscriptions_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *subscriptions_ = NULL;
+
+static const char *const kCounterNames[METRIC_COUNTER_COUNT] = {
+	[METRIC_SUBSCRIPTIONS] = "gmediarender_subscriptions_total",
+	[METRIC_LASTCHANGE_EVENTS] = "gmediarender_lastchange_events_total",
+	[METRIC_LASTCHANGE_BYTES] = "gmediarender_lastchange_bytes_total",
+	[METRIC_BUFFER_UNDERRUNS] = "gmediarender_buffer_underruns_total",
+	[METRIC_BUFFER_STALLS] = "gmediarender_buffer_stalls_total",
+	[METRIC_BUFFER_STALL_US] = "gmediarender_buffer_stall_seconds_total",
+	[METRIC_PIPELINE_RESTARTS] = "gmediarender_pipeline_restarts_total",
+};
+static const char *const kGaugeNames[METRIC_GAUGE_COUNT] = {
+	[METRIC_BUFFER_PERCENT] = "gmediarender_buffer_percent",
+	[METRIC_SUBSCRIPTIONS_ACTIVE] = "gmediarender_subscriptions_active",
+};
+static const char *const kLockNames[METRIC_LOCK_COUNT] = {
+	[METRIC_LOCK_TRANSPORT] = "transport",
+	[METRIC_LOCK_CONTROL] = "control",
+};
+
+int64_t Metrics_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct metrics_shard *my_shard(void) {
+	if (thread_shard_ == NULL) {
+		const unsigned int n = __atomic_fetch_add(&next_shard_, 1,
+							  __ATOMIC_RELAXED);
+		thread_shard_ = &shards_[n % SHARD_COUNT];
+	}
+	return thread_shard_;
+}
+
+void Metrics_add(enum metric_counter counter, uint64_t value) {
+	__atomic_add_fetch(&my_shard()->counters[counter], value,
+			   __ATOMIC_RELAXED);
+}
+
+void Metrics_set(enum metric_gauge gauge, int64_t value) {
+	__atomic_store_n(&gauges_[gauge], value, __ATOMIC_RELAXED);
+}
+
+static void histogram_observe(struct histogram *h, int64_t value_us) {
+	if (value_us < 0) value_us = 0;
+	size_t b = 0;
+	while (b < BUCKET_COUNT - 1 && value_us > kBucketBounds[b])
+		++b;
+	__atomic_add_fetch(&h->buckets[b], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->sum_us, value_us, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+// Returns the slot index of the action, -1 if the table is full.
+static int find_action(const char *name) {
+	for (int i = 0; i < MAX_ACTIONS; ++i) {
+		const char *slot_name = __atomic_load_n(&action_names_[i],
+							__ATOMIC_ACQUIRE);
+		if (slot_name == NULL) {
+			char *copy = strdup(name);
+			if (__atomic_compare_exchange_n(&action_names_[i],
+							&slot_name, copy, 0,
+							__ATOMIC_ACQ_REL,
+							__ATOMIC_ACQUIRE)) {
+				return i;
+			}
+			free(copy);  // Somebody else was faster.
+		}
+		if (strcmp(slot_name, name) == 0)
+			return i;
+	}
+	return -1;  // Table full. Unlikely with a fixed set of actions.
+}
+
+void Metrics_action(const char *action_name, int64_t latency_us, int failed) {
+	const int a = find_action(action_name);
+	if (a < 0)
+		return;
+	struct metrics_shard *shard = my_shard();
+	histogram_observe(&shard->action_latency[a], latency_us);
+	if (failed)
+		__atomic_add_fetch(&shard->action_errors[a], 1,
+				   __ATOMIC_RELAXED);
+}
+
+void Metrics_lock_wait(enum metric_lock lock, int64_t wait_us) {
+	histogram_observe(&my_shard()->lock_waits[lock], wait_us);
+}
+
+void Metrics_subscribed(const void *owner, const char *sid,
+			int timeout_sec) {
+	struct subscription *sub = g_new(struct subscription, 1);
+	sub->owner = owner;
+	sub->expires_us = Metrics_now_us() + timeout_sec * 1000000LL;
+	pthread_mutex_lock(&subscriptions_mutex_);
+	if (subscriptions_ == NULL) {
+		subscriptions_ = g_hash_table_new_full(g_str_hash, g_str_equal,
+						       g_free, g_free);
+	}
+	g_hash_table_replace(subscriptions_, g_strdup(sid), sub);
+	pthread_mutex_unlock(&subscriptions_mutex_);
+}
+
+static gboolean is_owned_by(gpointer key, gpointer value, gpointer owner) {
+	return ((const struct subscription*) value)->owner == owner;
+}
+
+void Metrics_unsubscribe_all(const void *owner) {
+	pthread_mutex_lock(&subscriptions_mutex_);
+	if (subscriptions_ != NULL) {
+		g_hash_table_foreach_remove(subscriptions_, is_owned_by,
+					    (gpointer) owner);
+	}
+	pthread_mutex_unlock(&subscriptions_mutex_);
+}
+
+static gboolean is_expired(gpointer key, gpointer value, gpointer now) {
+	return ((const struct subscription*) value)->expires_us
+		<= *(const int64_t*) now;
+}
+
+// Drops expired subscriptions and updates the gauge.
+static void update_active_subscriptions(void) {
+	int64_t now = Metrics_now_us();
+	int64_t active = 0;
+	pthread_mutex_lock(&subscriptions_mutex_);
+	if (subscriptions_ != NULL) {
+		g_hash_table_foreach_remove(subscriptions_, is_expired, &now);
+		active = g_hash_table_size(subscriptions_);
+	}
+	pthread_mutex_unlock(&subscriptions_mutex_);
+	Metrics_set(METRIC_SUBSCRIPTIONS_ACTIVE, active);
+}
+
+static uint64_t load(const uint64_t *value) {
+	return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static uint64_t sum_counter(enum metric_counter counter) {
+	uint64_t sum = 0;
+	for (int s = 0; s < SHARD_COUNT; ++s)
+		sum += load(&shards_[s].counters[counter]);
+	return sum;
+}
+
+static uint64_t sum_action_errors(int action) {
+	uint64_t sum = 0;
+	for (int s = 0; s < SHARD_COUNT; ++s)
+		sum += load(&shards_[s].action_errors[action]);
+	return sum;
+}
+
+// Adds a histogram of one shard to "sum", which is only seen by us.
+static void add_histogram(struct histogram *sum,
+			  const struct histogram *shard) {
+	for (size_t b = 0; b < BUCKET_COUNT; ++b)
+		sum->buckets[b] += load(&shard->buckets[b]);
+	sum->sum_us += load(&shard->sum_us);
+	sum->count += load(&shard->count);
+}
+
+// Seconds with microsecond resolution. Not using printf("%f") as that
+// would follow the locale's decimal separator.
+static const char *format_seconds(char *buf, size_t len, uint64_t us) {
+	snprintf(buf, len, "%llu.%06llu", (unsigned long long) (us / 1000000),
+		 (unsigned long long) (us % 1000000));
+	return buf;
+}
+
+static void print_histogram(FILE *out, const char *name, const char *label,
+			    const struct histogram *h) {
+	char seconds[32];
+	uint64_t cumulative = 0;
+	for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+		cumulative += load(&h->buckets[b]);
+		if (b < BUCKET_COUNT - 1) {
+			fprintf(out, "%s_bucket{%s,le=\"%s\"} %llu\n", name,
+				label, format_seconds(seconds, sizeof(seconds),
+						      kBucketBounds[b]),
+				(unsigned long long) cumulative);
+		} else {
+			fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name,
+				label, (unsigned long long) cumulative);
+		}
+	}
+	fprintf(out, "%s_sum{%s} %s\n", name, label,
+		format_seconds(seconds, sizeof(seconds), load(&h->sum_us)));
+	// The count is updated last, so might lag behind the buckets; use
+	// the +Inf bucket to stay consistent.
+	fprintf(out, "%s_count{%s} %llu\n", name, label,
+		(unsigned long long) cumulative);
+}
+
+char *Metrics_to_text(void) {
+	char *result = NULL;
+	size_t len = 0;
+	FILE *out = open_memstream(&result, &len);
+	if (out == NULL)
+		return NULL;
+
+	char seconds[32];
+	for (int i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+		if (i == METRIC_BUFFER_STALL_US) {
+			fprintf(out, "# TYPE %s counter\n%s %s\n",
+				kCounterNames[i], kCounterNames[i],
+				format_seconds(seconds, sizeof(seconds),
+					       sum_counter(i)));
+			continue;
+		}
+		fprintf(out, "# TYPE %s counter\n%s %llu\n",
+			kCounterNames[i], kCounterNames[i],
+			(unsigned long long) sum_counter(i));
+	}
+	update_active_subscriptions();
+	for (int i = 0; i < METRIC_GAUGE_COUNT; ++i) {
+		fprintf(out, "# TYPE %s gauge\n%s %lld\n",
+			kGaugeNames[i], kGaugeNames[i],
+			(long long) __atomic_load_n(&gauges_[i],
+						    __ATOMIC_RELAXED));
+	}
+
+	char label[128];
+	fprintf(out, "# TYPE gmediarender_action_duration_seconds histogram\n");
+	for (int i = 0; i < MAX_ACTIONS; ++i) {
+		const char *name = __atomic_load_n(&action_names_[i],
+						   __ATOMIC_ACQUIRE);
+		if (name == NULL) break;
+		struct histogram latency = { { 0 }, 0, 0 };
+		for (int s = 0; s < SHARD_COUNT; ++s)
+			add_histogram(&latency, &shards_[s].action_latency[i]);
+		snprintf(label, sizeof(label), "action=\"%s\"", name);
+		print_histogram(out, "gmediarender_action_duration_seconds",
+				label, &latency);
+	}
+	fprintf(out, "# TYPE gmediarender_action_errors_total counter\n");
+	for (int i = 0; i < MAX_ACTIONS; ++i) {
+		const char *name = __atomic_load_n(&action_names_[i],
+						   __ATOMIC_ACQUIRE);
+		if (name == NULL) break;
+		fprintf(out, "gmediarender_action_errors_total"
+			"{action=\"%s\"} %llu\n", name,
+			(unsigned long long) sum_action_errors(i));
+	}
+
+	fprintf(out, "# TYPE gmediarender_lock_wait_seconds histogram\n");
+	for (int i = 0; i < METRIC_LOCK_COUNT; ++i) {
+		struct histogram waits = { { 0 }, 0, 0 };
+		for (int s = 0; s < SHARD_COUNT; ++s)
+			add_histogram(&waits, &shards_[s].lock_waits[i]);
+		snprintf(label, sizeof(label), "lock=\"%s\"", kLockNames[i]);
+		print_histogram(out, "gmediarender_lock_wait_seconds",
+				label, &waits);
+	}
+
+	LockProfile_write_metrics(out);
+
+	fclose(out);
+	return result;
+}
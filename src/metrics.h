@@ -0,0 +1,81 @@
+/* metrics.h - Counters and latency histograms, exported for Prometheus.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdint.h>
+
+// All updates except the subscription bookkeeping are lock-free atomic
+// operations on per-thread shards, so they can be called from any thread,
+// including while holding service locks.
+
+enum metric_counter {
+	METRIC_SUBSCRIPTIONS,        // GENA subscription requests.
+	METRIC_LASTCHANGE_EVENTS,    // LastChange events sent.
+	METRIC_LASTCHANGE_BYTES,     // Size of (escaped) LastChange sent.
+	METRIC_BUFFER_UNDERRUNS,     // Stream buffer ran empty while playing.
+	METRIC_BUFFER_STALLS,        // Playback paused to refill the buffer.
+	METRIC_BUFFER_STALL_US,      // Time spent in these; exported as seconds.
+	METRIC_PIPELINE_RESTARTS,    // Rebuilt by the stall watchdog.
+	METRIC_COUNTER_COUNT
+};
+
+enum metric_gauge {
+	METRIC_BUFFER_PERCENT,       // Last reported stream buffer fill.
+	METRIC_SUBSCRIPTIONS_ACTIVE, // See Metrics_subscribed().
+	METRIC_GAUGE_COUNT
+};
+
+enum metric_lock {
+	METRIC_LOCK_TRANSPORT,
+	METRIC_LOCK_CONTROL,
+	METRIC_LOCK_COUNT
+};
+
+// Monotonic time in microseconds, to measure durations.
+int64_t Metrics_now_us(void);
+
+void Metrics_add(enum metric_counter counter, uint64_t value);
+void Metrics_set(enum metric_gauge gauge, int64_t value);
+
+// Record a finished action with its latency; "failed" if it returned an
+// error to the control point.
+void Metrics_action(const char *action_name, int64_t latency_us, int failed);
+
+// Record time waited to acquire a service lock.
+void Metrics_lock_wait(enum metric_lock lock, int64_t wait_us);
+
+// A control point subscribed to a service of device "owner" with the given
+// SID, for up to "timeout_sec"; counts as active until then. Renewals are
+// handled inside libupnp and not seen here.
+void Metrics_subscribed(const void *owner, const char *sid, int timeout_sec);
+
+// The device "owner" was unregistered, which ends all its subscriptions.
+void Metrics_unsubscribe_all(const void *owner);
+
+// Returns a newly allocated string with all metrics in the Prometheus text
+// exposition format.
+char *Metrics_to_text(void);
+
+#endif /* _METRICS_H */
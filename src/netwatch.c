@@ -0,0 +1,168 @@
+/* netwatch.c - Get notified when network addresses change.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "netwatch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#  include <net/if.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <linux/netlink.h>
+#  include <linux/rtnetlink.h>
+#endif
+
+#include "logging.h"
+
+#ifdef __linux__
+
+struct netwatch {
+	int fd;
+	char *interface_name;  // NULL: any interface but loopback.
+};
+
+static int64_t now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct netwatch *NetWatch_open(const char *interface_name) {
+	int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		Log_error("netwatch", "Can't open netlink socket: %s",
+			  strerror(errno));
+		return NULL;
+	}
+	struct sockaddr_nl addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		Log_error("netwatch", "Can't bind netlink socket: %s",
+			  strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	struct netwatch *watch = (struct netwatch*) malloc(sizeof(*watch));
+	watch->fd = fd;
+	watch->interface_name = interface_name ? strdup(interface_name) : NULL;
+	return watch;
+}
+
+// Returns 1 if the address message is about the interface we watch.
+static int is_relevant(const struct netwatch *watch,
+		       const struct ifaddrmsg *ifa) {
+	if (watch->interface_name == NULL)
+		return ifa->ifa_scope != RT_SCOPE_HOST;
+	char name[IF_NAMESIZE];
+	return (if_indextoname(ifa->ifa_index, name) != NULL
+		&& strcmp(name, watch->interface_name) == 0);
+}
+
+// Read pending messages; returns 1 if one of them was relevant.
+static int read_changes(struct netwatch *watch) {
+	char buf[8192] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+	int relevant = 0;
+	for (;;) {
+		ssize_t len = recv(watch->fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			// ENOBUFS: we missed messages; assume something changed.
+			if (errno == ENOBUFS) relevant = 1;
+			return relevant;
+		}
+		for (struct nlmsghdr *msg = (struct nlmsghdr*) buf;
+		     NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+			if (msg->nlmsg_type != RTM_NEWADDR
+			    && msg->nlmsg_type != RTM_DELADDR)
+				continue;
+			const struct ifaddrmsg *ifa = NLMSG_DATA(msg);
+			if (is_relevant(watch, ifa)) {
+				Log_info("netwatch", "Address %s on %s",
+					 msg->nlmsg_type == RTM_NEWADDR
+					 ? "added" : "removed",
+					 watch->interface_name
+					 ? watch->interface_name : "network");
+				relevant = 1;
+			}
+		}
+	}
+}
+
+int NetWatch_wait(struct netwatch *watch, int timeout_ms) {
+	if (watch == NULL) {
+		usleep(timeout_ms * 1000);
+		return 0;
+	}
+	const int64_t deadline = now_ms() + timeout_ms;
+	for (;;) {
+		const int64_t remaining = deadline - now_ms();
+		if (remaining <= 0)
+			return 0;
+		struct pollfd pfd = { watch->fd, POLLIN, 0 };
+		const int rc = poll(&pfd, 1, remaining);
+		if (rc < 0 && errno != EINTR) {
+			usleep(remaining * 1000);
+			return 0;
+		}
+		if (rc > 0 && read_changes(watch))
+			return 1;
+	}
+}
+
+void NetWatch_close(struct netwatch *watch) {
+	if (watch == NULL)
+		return;
+	close(watch->fd);
+	free(watch->interface_name);
+	free(watch);
+}
+
+#else  // !__linux__
+
+struct netwatch *NetWatch_open(const char *interface_name) {
+	(void) interface_name;
+	return NULL;
+}
+
+int NetWatch_wait(struct netwatch *watch, int timeout_ms) {
+	(void) watch;
+	usleep(timeout_ms * 1000);
+	return 0;
+}
+
+void NetWatch_close(struct netwatch *watch) {
+	(void) watch;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/* netwatch.h - Get notified when network addresses change.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#ifndef _NETWATCH_H
+#define _NETWATCH_H
+
+// Watches for addresses being added to or removed from a network interface,
+// using rtnetlink on Linux. Elsewhere, NetWatch_open() returns NULL, and
+// NetWatch_wait() just sleeps for the timeout.
+struct netwatch;
+
+// Start watching "interface_name", or all interfaces but loopback if NULL.
+// Changes that happen after this call are reported by NetWatch_wait().
+struct netwatch *NetWatch_open(const char *interface_name);
+
+// Wait up to "timeout_ms" for an address change on the interface. Returns 1
+// if there was one, 0 on timeout.
+int NetWatch_wait(struct netwatch *watch, int timeout_ms);
+
+void NetWatch_close(struct netwatch *watch);
+
+#endif  // _NETWATCH_H
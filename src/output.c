@@ -40,7 +40,9 @@
 #ifdef HAVE_GST
 #include "output_gstreamer.h"
 #endif
+#include "output_null.h"
 #include "output.h"
+#include "trace.h"
 
 static struct output_module *modules[] = {
 #ifdef HAVE_GST
@@ -50,10 +52,15 @@ static struct output_module *modules[] = {
 	// in waiting till then.
 #error "No output configured. You need to ./configure --with-gstreamer"
 #endif
+	&null_output,
 };
 
 static struct output_module *output_module = NULL;
 
+struct output {
+	void *player;
+};
+
 void output_dump_modules(void)
 {
 	int count;
@@ -103,12 +110,29 @@ int output_init(const char *shortname)
 		 output_module->shortname, output_module->description);
 
 	if (output_module->init) {
-		return output_module->init();
+		const int64_t start = Trace_begin();
+		const int rc = output_module->init();
+		Trace_end("output", "init", start);
+		return rc;
 	}
 
 	return 0;
 }
 
+struct output *output_new(const char *audio_sink, const char *audio_device)
+{
+	if (output_module == NULL || output_module->create == NULL)
+		return NULL;
+	const int64_t start = Trace_begin();
+	void *player = output_module->create(audio_sink, audio_device);
+	Trace_end("output", "create", start);
+	if (player == NULL)
+		return NULL;
+	struct output *out = (struct output*) malloc(sizeof(*out));
+	out->player = player;
+	return out;
+}
+
 static GMainLoop *main_loop_ = NULL;
 static void exit_loop_sighandler(int sig) {
 	if (main_loop_) {
@@ -147,73 +171,131 @@ int output_add_options(GOptionContext *ctx)
 	return 0;
 }
 
-void output_set_uri(const char *uri, output_update_meta_cb_t meta_cb) {
+void output_set_uri(struct output *out, const char *uri,
+		    output_update_meta_cb_t meta_cb, void *userdata) {
 	if (output_module && output_module->set_uri) {
-		output_module->set_uri(uri, meta_cb);
+		const int64_t start = Trace_begin();
+		output_module->set_uri(out->player, uri, meta_cb, userdata);
+		Trace_end("output", "set_uri", start);
 	}
 }
-void output_set_next_uri(const char *uri) {
+void output_set_next_uri(struct output *out, const char *uri) {
 	if (output_module && output_module->set_next_uri) {
-		output_module->set_next_uri(uri);
+		const int64_t start = Trace_begin();
+		output_module->set_next_uri(out->player, uri);
+		Trace_end("output", "set_next_uri", start);
 	}
 }
 
-int output_play(output_transition_cb_t transition_callback) {
+int output_play(struct output *out,
+		output_transition_cb_t transition_callback, void *userdata) {
 	if (output_module && output_module->play) {
-		return output_module->play(transition_callback);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->play(out->player,
+						   transition_callback,
+						   userdata);
+		Trace_end("output", "play", start);
+		return rc;
 	}
 	return -1;
 }
 
-int output_pause(void) {
+int output_pause(struct output *out) {
 	if (output_module && output_module->pause) {
-		return output_module->pause();
+		const int64_t start = Trace_begin();
+		const int rc = output_module->pause(out->player);
+		Trace_end("output", "pause", start);
+		return rc;
 	}
 	return -1;
 }
 
-int output_stop(void) {
+int output_stop(struct output *out) {
 	if (output_module && output_module->stop) {
-		return output_module->stop();
+		const int64_t start = Trace_begin();
+		const int rc = output_module->stop(out->player);
+		Trace_end("output", "stop", start);
+		return rc;
 	}
 	return -1;
 }
 
-int output_seek(gint64 position_nanos) {
+int output_seek(struct output *out, gint64 position_nanos) {
 	if (output_module && output_module->seek) {
-		return output_module->seek(position_nanos);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->seek(out->player, position_nanos);
+		Trace_end("output", "seek", start);
+		return rc;
+	}
+	return -1;
+}
+
+int output_set_loop(struct output *out, int enable) {
+	if (output_module && output_module->set_loop) {
+		const int64_t start = Trace_begin();
+		const int rc = output_module->set_loop(out->player, enable);
+		Trace_end("output", "set_loop", start);
+		return rc;
+	}
+	return -1;
+}
+
+int output_restart(struct output *out) {
+	if (output_module && output_module->restart) {
+		const int64_t start = Trace_begin();
+		const int rc = output_module->restart(out->player);
+		Trace_end("output", "restart", start);
+		return rc;
 	}
 	return -1;
 }
 
-int output_get_position(gint64 *track_dur, gint64 *track_pos) {
+int output_get_position(struct output *out,
+			gint64 *track_dur, gint64 *track_pos) {
 	if (output_module && output_module->get_position) {
-		return output_module->get_position(track_dur, track_pos);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->get_position(out->player,
+							   track_dur,
+							   track_pos);
+		Trace_end("output", "get_position", start);
+		return rc;
 	}
 	return -1;
 }
 
-int output_get_volume(float *value) {
+int output_get_volume(struct output *out, float *value) {
 	if (output_module && output_module->get_volume) {
-		return output_module->get_volume(value);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->get_volume(out->player, value);
+		Trace_end("output", "get_volume", start);
+		return rc;
 	}
 	return -1;
 }
-int output_set_volume(float value) {
+int output_set_volume(struct output *out, float value) {
 	if (output_module && output_module->set_volume) {
-		return output_module->set_volume(value);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->set_volume(out->player, value);
+		Trace_end("output", "set_volume", start);
+		return rc;
 	}
 	return -1;
 }
-int output_get_mute(int *value) {
+int output_get_mute(struct output *out, int *value) {
 	if (output_module && output_module->get_mute) {
-		return output_module->get_mute(value);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->get_mute(out->player, value);
+		Trace_end("output", "get_mute", start);
+		return rc;
 	}
 	return -1;
 }
-int output_set_mute(int value) {
+int output_set_mute(struct output *out, int value) {
 	if (output_module && output_module->set_mute) {
-		return output_module->set_mute(value);
+		const int64_t start = Trace_begin();
+		const int rc = output_module->set_mute(out->player, value);
+		Trace_end("output", "set_mute", start);
+		return rc;
 	}
 	return -1;
 }
@@ -32,12 +32,17 @@
 enum PlayFeedback {
 	PLAY_STOPPED,
 	PLAY_STARTED_NEXT_STREAM,
+	PLAY_BUFFERING,             // Stalled while playing, waiting for data.
+	PLAY_BUFFERING_DONE,        // Playing again after PLAY_BUFFERING.
+	PLAY_ERROR,                 // Stream failed; followed by STOPPED or
+	                            // STARTED_NEXT_STREAM if it was playing.
 };
-typedef void (*output_transition_cb_t)(enum PlayFeedback);
+typedef void (*output_transition_cb_t)(enum PlayFeedback, void *userdata);
 
 // In case the stream gets to know details about the song, this is a
 // callback with changes we send back to the controlling layer.
-typedef void (*output_update_meta_cb_t)(const struct SongMetaData *);
+typedef void (*output_update_meta_cb_t)(const struct SongMetaData *,
+					void *userdata);
 
 int output_init(const char *shortname);
 int output_add_options(GOptionContext *ctx);
@@ -45,18 +50,37 @@ void output_dump_modules(void);
 
 int output_loop(void);
 
-void output_set_uri(const char *uri, output_update_meta_cb_t meta_info);
-void output_set_next_uri(const char *uri);
+// One player of the module selected with output_init(); each zone has its
+// own. "audio_sink" and "audio_device" replace the ones given on the
+// command line if not NULL. Returns NULL on failure.
+struct output;
+struct output *output_new(const char *audio_sink, const char *audio_device);
 
-int output_play(output_transition_cb_t done_callback);
-int output_stop(void);
-int output_pause(void);
-int output_get_position(gint64 *track_dur_nanos, gint64 *track_pos_nanos);
-int output_seek(gint64 position_nanos);
+// The callbacks are called with "userdata".
+void output_set_uri(struct output *out, const char *uri,
+		    output_update_meta_cb_t meta_info, void *userdata);
+void output_set_next_uri(struct output *out, const char *uri);
 
-int output_get_volume(float *v);
-int output_set_volume(float v);
-int output_get_mute(int *m);
-int output_set_mute(int m);
+int output_play(struct output *out, output_transition_cb_t done_callback,
+		void *userdata);
+int output_stop(struct output *out);
+int output_pause(struct output *out);
+int output_get_position(struct output *out,
+			gint64 *track_dur_nanos, gint64 *track_pos_nanos);
+int output_seek(struct output *out, gint64 position_nanos);
+
+// Play the current track over and over, without a gap, until called with
+// 0. Returns -1 if the output can't do that.
+int output_set_loop(struct output *out, int enable);
+
+// Tear down and rebuild the playing stream, continuing at the current
+// position; for when it got stuck. Returns 1 if the output is already
+// reconnecting on its own and nothing was rebuilt, -1 if not possible.
+int output_restart(struct output *out);
+
+int output_get_volume(struct output *out, float *v);
+int output_set_volume(struct output *out, float v);
+int output_get_mute(struct output *out, int *m);
+int output_set_mute(struct output *out, int m);
 
 #endif /* _OUTPUT_H */
@@ -30,6 +30,9 @@
 
 #include <assert.h>
 #include <gst/gst.h>
+#ifdef HAVE_GST_NET
+#  include <gst/net/net.h>
+#endif
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -38,9 +41,12 @@
 #include <inttypes.h>
 
 #include "logging.h"
+#include "metrics.h"
 #include "upnp_connmgr.h"
 #include "output_module.h"
 #include "output_gstreamer.h"
+#include "media_cache.h"
+#include "prefetch.h"
 
 static double buffer_duration = 0.0; /* Buffer disbled by default, see #182 */
 
@@ -122,47 +128,279 @@ static void scan_mime_list(void)
 	register_mime_type("audio/*");
 }
 
-static GstElement *player_ = NULL;
-static char *gsuri_ = NULL;         // locally strdup()ed
-static char *gs_next_uri_ = NULL;   // locally strdup()ed
-static struct SongMetaData song_meta_;
-
-static output_transition_cb_t play_trans_callback_ = NULL;
-static output_update_meta_cb_t meta_update_callback_ = NULL;
-
 struct track_time_info {
 	gint64 duration;
 	gint64 position;
 };
-static struct track_time_info last_known_time_ = {0, 0};
 
-static GstState get_current_player_state() {
+// One playbin and what we know about it; each zone has its own.
+struct gst_player {
+	GstElement *pipeline;
+	char *gsuri;         // locally strdup()ed
+	char *gs_next_uri;   // locally strdup()ed
+	struct SongMetaData song_meta;
+	struct prefetch *prefetch;
+
+	output_transition_cb_t play_trans_callback;
+	void *play_trans_userdata;
+	output_update_meta_cb_t meta_update_callback;
+	void *meta_update_userdata;
+
+	struct track_time_info last_known_time;
+
+	// Set at about-to-finish, when playbin got the next uri. That is a
+	// while before the next stream is audible, so we only tell about the
+	// track change once its STREAM_START arrives.
+	int next_stream_pending;
+
+	GstClockTime paused_running_time;  // Only used if synchronized.
+
+	// Buffering; see handle_buffering().
+	int buffer_full;        // Buffer reached 100% since stream started.
+	GstState target_state;  // As requested by play() etc.
+	int buffer_ready;       // Reached high watermark since start.
+	int buffer_waiting;     // Paused until the high watermark.
+	int64_t stall_start_us; // Stalled while playing; 0: initial fill.
+
+	// If the uri set by set_player_uri() was looked up in the cache: 1 if
+	// it plays from there, 0 from the network; -1 otherwise. The cache
+	// counts it once the stream actually plays.
+	int cache_use;
+
+	int prerolled;  // Pipeline is (getting) paused on gsuri.
+
+	// Recovering from stream errors; see handle_error().
+	int retry_attempt;
+	gint64 resume_position;  // Seek here once reconnected.
+	int error_skips;
+	guint recovery_source;   // Scheduled retry or skip.
+	guint stable_source;
+
+	// Looping; see segment_seek().
+	int loop;
+	int segment_active;  // Pipeline plays a segment seek.
+};
+
+static void report_transition(struct gst_player *p,
+			      enum PlayFeedback feedback) {
+	if (p->play_trans_callback)
+		p->play_trans_callback(feedback, p->play_trans_userdata);
+}
+
+static GstState get_current_player_state(struct gst_player *p) {
 	GstState state = GST_STATE_PLAYING;
 	GstState pending = GST_STATE_NULL;
-	gst_element_get_state(player_, &state, &pending, 0);
+	gst_element_get_state(p->pipeline, &state, &pending, 0);
 	return state;
 }
 
-static int output_gstreamer_play(output_transition_cb_t callback) {
-	play_trans_callback_ = callback;
-	if (get_current_player_state() != GST_STATE_PAUSED) {
-		if (gst_element_set_state(player_, GST_STATE_READY) ==
+// -- Synchronized playback of a group of renderers.
+// All use the same clock, served by one of them. As we don't talk to each
+// other, the base time is chosen as the next multiple of sync_window_ms on
+// that clock, so renderers told to play within the same window start at
+// exactly the same time.
+#ifdef HAVE_GST_NET
+static int clock_provide_port = 0;    // Serve our clock on this port.
+static gchar *clock_master = NULL;    // host:port of the group's clock.
+#endif
+static int sync_latency_ms = 500;
+static int sync_window_ms = 1000;
+
+static GstClock *sync_clock_ = NULL;  // Only set if synchronized.
+
+// Set the base time, so that we continue at "running_time" at the next
+// sync point.
+static void sync_set_base_time(struct gst_player *p,
+			       GstClockTime running_time) {
+	if (sync_clock_ == NULL)
+		return;
+	const GstClockTime window = sync_window_ms * GST_MSECOND;
+	const GstClockTime earliest = gst_clock_get_time(sync_clock_)
+		+ sync_latency_ms * GST_MSECOND;
+	const GstClockTime start = (earliest / window + 1) * window;
+	gst_element_set_base_time(p->pipeline, start - running_time);
+}
+
+// Remember where we are, so that a later sync_resume() continues there.
+static void sync_remember_position(struct gst_player *p) {
+	if (sync_clock_ == NULL)
+		return;
+	const GstClockTime now = gst_clock_get_time(sync_clock_);
+	const GstClockTime base = gst_element_get_base_time(p->pipeline);
+	p->paused_running_time = now > base ? now - base : 0;
+}
+
+static GstStateChangeReturn set_paused(struct gst_player *p) {
+	sync_remember_position(p);
+	return gst_element_set_state(p->pipeline, GST_STATE_PAUSED);
+}
+
+static GstStateChangeReturn set_playing(struct gst_player *p,
+					GstClockTime running_time) {
+	sync_set_base_time(p, running_time);
+	return gst_element_set_state(p->pipeline, GST_STATE_PLAYING);
+}
+
+// -- Buffering with hysteresis.
+// Once the buffer was filled to the high watermark, we only pause when it
+// drops below the low watermark, then wait until it is at the high one
+// again. With a single threshold, a stream arriving at about its bitrate
+// makes us flap between paused and playing.
+static int buffer_low_percent = 10;
+static int buffer_high_percent = 100;
+
+static void end_stall(struct gst_player *p) {
+	if (p->stall_start_us == 0)
+		return;
+	Metrics_add(METRIC_BUFFER_STALL_US,
+		    Metrics_now_us() - p->stall_start_us);
+	p->stall_start_us = 0;
+}
+
+static void reset_buffering(struct gst_player *p) {
+	end_stall(p);
+	p->buffer_ready = 0;
+	p->buffer_waiting = 0;
+}
+
+static void handle_buffering(struct gst_player *p, int percent) {
+	if (!p->buffer_waiting) {
+		if (percent >= buffer_high_percent)
+			p->buffer_ready = 1;
+		const int threshold = (p->buffer_ready
+				       ? buffer_low_percent
+				       : buffer_high_percent);
+		if (percent >= threshold || p->target_state != GST_STATE_PLAYING)
+			return;
+		p->buffer_waiting = 1;
+		set_paused(p);
+		if (p->buffer_ready) {
+			p->stall_start_us = Metrics_now_us();
+			Metrics_add(METRIC_BUFFER_STALLS, 1);
+			Log_info("gstreamer", "Buffer at %d%%; pausing until %d%%",
+				 percent, buffer_high_percent);
+			report_transition(p, PLAY_BUFFERING);
+		}
+		return;
+	}
+
+	if (percent < buffer_high_percent)
+		return;
+	p->buffer_ready = 1;
+	p->buffer_waiting = 0;
+	if (p->target_state == GST_STATE_PLAYING)
+		set_playing(p, p->paused_running_time);
+	if (p->stall_start_us != 0) {
+		end_stall(p);
+		Log_info("gstreamer", "Buffer refilled; continuing");
+		report_transition(p, PLAY_BUFFERING_DONE);
+	}
+}
+
+static void report_cache_use(struct gst_player *p) {
+	if (p->cache_use >= 0)
+		MediaCache_count_play(p->gsuri, p->cache_use);
+	p->cache_use = -1;
+}
+
+// Switch playbin to p->gsuri; use a local copy if we have one. Only reads
+// the verdict of the revalidation started in set_uri/set_next_uri, so it
+// never waits on the network.
+static void set_player_uri(struct gst_player *p) {
+	char *local = Prefetch_get_local_uri(p->prefetch, p->gsuri);
+	p->cache_use = -1;
+	if (local == NULL) {
+		local = MediaCache_lookup(p->gsuri);
+		p->cache_use = (local != NULL);
+	}
+	if (local != NULL)
+		Log_info("gstreamer", "Playing local copy %s", local);
+	g_object_set(G_OBJECT(p->pipeline), "uri", local ? local : p->gsuri,
+		     NULL);
+	g_free(local);
+}
+
+// With --gstout-preroll, SetAVTransportURI already brings the pipeline to
+// PAUSED on the new URI, so that connecting and prerolling happen before
+// Play arrives.
+static gboolean preroll_on_set_uri = FALSE;
+
+static void preroll_uri(struct gst_player *p) {
+	reset_buffering(p);
+	gst_element_set_state(p->pipeline, GST_STATE_READY);
+	if (p->gsuri == NULL)
+		return;
+	set_player_uri(p);
+	p->paused_running_time = 0;
+	if (gst_element_set_state(p->pipeline, GST_STATE_PAUSED) ==
+	    GST_STATE_CHANGE_FAILURE) {
+		Log_error("gstreamer", "prerolling '%s' failed", p->gsuri);
+		return;
+	}
+	p->prerolled = 1;
+}
+
+// -- Recovering from stream errors.
+// Network errors are retried after 1, 2, 4, ... seconds, continuing where
+// the stream broke off. Other errors, and network errors that persist,
+// skip to the next uri.
+static const int kMaxRetryDelaySec = 30;
+static const int kStablePlaySec = 30;   // Then forget about earlier retries.
+static const int kMaxErrorSkips = 10;   // In a row, without one playing.
+static int error_retries = 5;
+
+static void remove_source(guint *source) {
+	if (*source != 0)
+		g_source_remove(*source);
+	*source = 0;
+}
+
+// Forget an ongoing recovery, as we play something else now.
+static void cancel_recovery(struct gst_player *p) {
+	remove_source(&p->recovery_source);
+	remove_source(&p->stable_source);
+	p->retry_attempt = 0;
+	p->resume_position = 0;
+}
+
+static int output_gstreamer_play(void *player, output_transition_cb_t callback,
+				 void *userdata) {
+	struct gst_player *p = (struct gst_player*) player;
+	p->play_trans_callback = callback;
+	p->play_trans_userdata = userdata;
+	p->target_state = GST_STATE_PLAYING;
+	p->error_skips = 0;
+	GstClockTime running_time = p->paused_running_time;
+	if (p->prerolled) {
+		// Might still be on its way to PAUSED; fine to go on from there.
+		p->prerolled = 0;
+	} else if (get_current_player_state(p) != GST_STATE_PAUSED) {
+		reset_buffering(p);
+		if (gst_element_set_state(p->pipeline, GST_STATE_READY) ==
 		    GST_STATE_CHANGE_FAILURE) {
 			Log_error("gstreamer", "setting play state failed (1)");
 			// Error, but continue; can't get worse :)
 		}
-		g_object_set(G_OBJECT(player_), "uri", gsuri_, NULL);
+		set_player_uri(p);
+		running_time = 0;
+	} else if (p->buffer_waiting) {
+		return 0;  // Continues once buffered.
 	}
-	if (gst_element_set_state(player_, GST_STATE_PLAYING) ==
-	    GST_STATE_CHANGE_FAILURE) {
+	if (set_playing(p, running_time) == GST_STATE_CHANGE_FAILURE) {
 		Log_error("gstreamer", "setting play state failed (2)");
 		return -1;
 	}
 	return 0;
 }
 
-static int output_gstreamer_stop(void) {
-	if (gst_element_set_state(player_, GST_STATE_READY) ==
+static int output_gstreamer_stop(void *player) {
+	struct gst_player *p = (struct gst_player*) player;
+	p->target_state = GST_STATE_READY;
+	p->prerolled = 0;
+	p->next_stream_pending = 0;
+	cancel_recovery(p);
+	reset_buffering(p);
+	if (gst_element_set_state(p->pipeline, GST_STATE_READY) ==
 	    GST_STATE_CHANGE_FAILURE) {
 		return -1;
 	} else {
@@ -170,41 +408,138 @@ static int output_gstreamer_stop(void) {
 	}
 }
 
-static int output_gstreamer_pause(void) {
-	if (gst_element_set_state(player_, GST_STATE_PAUSED) ==
-	    GST_STATE_CHANGE_FAILURE) {
+static int output_gstreamer_pause(void *player) {
+	struct gst_player *p = (struct gst_player*) player;
+	p->target_state = GST_STATE_PAUSED;
+	if (p->buffer_waiting)
+		return 0;  // Already paused.
+	if (set_paused(p) == GST_STATE_CHANGE_FAILURE) {
 		return -1;
 	} else {
 		return 0;
 	}
 }
 
-static int output_gstreamer_seek(gint64 position_nanos) {
-	if (gst_element_seek_simple(player_, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
-								position_nanos)) {
+// While looping (REPEAT_ONE), the track is played as a segment: at its end
+// the pipeline posts SEGMENT_DONE instead of EOS, and we seek back to the
+// start without flushing, so the data of the next round follows the last
+// sample without a gap and without prerolling again.
+static gboolean segment_seek(struct gst_player *p, gint64 position_nanos,
+			     GstSeekFlags flags) {
+	if (!gst_element_seek(p->pipeline, 1.0, GST_FORMAT_TIME,
+			      flags | GST_SEEK_FLAG_SEGMENT,
+			      GST_SEEK_TYPE_SET, position_nanos,
+			      GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE)) {
+		Log_error("gstreamer", "Segment seek failed; can't loop.");
+		return FALSE;
+	}
+	p->segment_active = 1;
+	return TRUE;
+}
+
+static int output_gstreamer_seek(void *player, gint64 position_nanos) {
+	struct gst_player *p = (struct gst_player*) player;
+	if (p->recovery_source != 0 && p->resume_position > 0) {
+		// Waiting to reconnect; continue there instead.
+		p->resume_position = position_nanos;
+		return 0;
+	}
+	const gboolean ok = p->loop
+		? segment_seek(p, position_nanos, GST_SEEK_FLAG_FLUSH)
+		: gst_element_seek_simple(p->pipeline, GST_FORMAT_TIME,
+					  GST_SEEK_FLAG_FLUSH, position_nanos);
+	if (ok) {
+		if (!p->loop)
+			p->segment_active = 0;
+		// The flush starts running time from zero again.
+		if (get_current_player_state(p) == GST_STATE_PLAYING)
+			sync_set_base_time(p, 0);
+		else
+			p->paused_running_time = 0;
 		return 0;
 	} else {
 		return -1;
 	}
 }
 
-static void output_gstreamer_set_next_uri(const char *uri) {
+static int output_gstreamer_get_position(void *player,
+					 gint64 *track_duration,
+					 gint64 *track_pos);
+
+static int output_gstreamer_set_loop(void *player, int enable) {
+	struct gst_player *p = (struct gst_player*) player;
+	Log_info("gstreamer", "%s looping", enable ? "Start" : "Stop");
+	p->loop = enable;
+	if (!p->loop || p->segment_active)
+		return 0;  // Ends at SEGMENT_DONE, or continues there.
+	const GstState state = get_current_player_state(p);
+	if (state != GST_STATE_PAUSED && state != GST_STATE_PLAYING)
+		return 0;  // Becomes a segment once prerolled.
+	// Replay from where we are as segment; costs a short flush.
+	gint64 duration, position;
+	output_gstreamer_get_position(p, &duration, &position);
+	return output_gstreamer_seek(p, position);
+}
+
+// Rebuild the pipeline from scratch, continuing at the last position.
+static int output_gstreamer_restart(void *player) {
+	struct gst_player *p = (struct gst_player*) player;
+	if (p->gsuri == NULL || p->target_state != GST_STATE_PLAYING)
+		return -1;
+	if (p->recovery_source != 0)
+		return 1;  // Waiting to reconnect anyway.
+	Log_info("gstreamer", "Rebuilding pipeline for %s at %.1fs", p->gsuri,
+		 p->last_known_time.position / 1e9);
+	p->next_stream_pending = 0;
+	reset_buffering(p);
+	if (p->resume_position == 0)  // Else not reconnected yet.
+		p->resume_position = p->last_known_time.position;
+	gst_element_set_state(p->pipeline, GST_STATE_NULL);
+	set_player_uri(p);
+	p->paused_running_time = 0;
+	if (set_playing(p, 0) == GST_STATE_CHANGE_FAILURE) {
+		Log_error("gstreamer", "Rebuilding pipeline failed");
+		return -1;
+	}
+	return 0;
+}
+
+static void output_gstreamer_set_next_uri(void *player, const char *uri) {
+	struct gst_player *p = (struct gst_player*) player;
 	Log_info("gstreamer", "Set next uri to '%s'", uri);
-	free(gs_next_uri_);
-	gs_next_uri_ = (uri && *uri) ? strdup(uri) : NULL;
+	free(p->gs_next_uri);
+	p->gs_next_uri = (uri && *uri) ? strdup(uri) : NULL;
+	Prefetch_start(p->prefetch, p->gs_next_uri);
+	MediaCache_revalidate(p->gs_next_uri);
 }
 
-static void output_gstreamer_set_uri(const char *uri,
-				     output_update_meta_cb_t meta_cb) {
+static void output_gstreamer_set_uri(void *player, const char *uri,
+				     output_update_meta_cb_t meta_cb,
+				     void *userdata) {
+	struct gst_player *p = (struct gst_player*) player;
 	Log_info("gstreamer", "Set uri to '%s'", uri);
-	free(gsuri_);
-	gsuri_ = (uri && *uri) ? strdup(uri) : NULL;
-	meta_update_callback_ = meta_cb;
-	SongMetaData_clear(&song_meta_);
-
-	// If already playing, update the playbin's URI
-	if (get_current_player_state() == GST_STATE_PLAYING)
-		output_gstreamer_play(play_trans_callback_);
+	free(p->gsuri);
+	p->gsuri = (uri && *uri) ? strdup(uri) : NULL;
+	MediaCache_revalidate(p->gsuri);
+	p->meta_update_callback = meta_cb;
+	p->meta_update_userdata = userdata;
+	SongMetaData_clear(&p->song_meta);
+	p->buffer_full = 0;
+	p->prerolled = 0;
+	p->next_stream_pending = 0;
+	cancel_recovery(p);
+	p->last_known_time.duration = 0;
+	p->last_known_time.position = 0;
+
+	// If already playing, update the playbin's URI. This includes being
+	// paused for buffering.
+	if (p->target_state == GST_STATE_PLAYING) {
+		gst_element_set_state(p->pipeline, GST_STATE_READY);
+		output_gstreamer_play(p, p->play_trans_callback,
+				      p->play_trans_userdata);
+	} else if (preroll_on_set_uri) {
+		preroll_uri(p);
+	}
 }
 
 #if 0
@@ -263,11 +598,106 @@ static void MetaModify_add_tag(const GstTagList *list, const gchar *tag,
 	}
 }
 
+// Switch to p->gs_next_uri right away; unlike about-to-finish with a gap.
+static void start_next_uri(struct gst_player *p) {
+	free(p->gsuri);
+	p->gsuri = p->gs_next_uri;
+	p->gs_next_uri = NULL;
+	cancel_recovery(p);
+	p->last_known_time.duration = 0;
+	p->last_known_time.position = 0;
+	gst_element_set_state(p->pipeline, GST_STATE_READY);
+	set_player_uri(p);
+	set_playing(p, 0);
+	report_transition(p, PLAY_STARTED_NEXT_STREAM);
+}
+
+static int is_network_error(const GError *err) {
+	return err->domain == GST_RESOURCE_ERROR
+		&& (err->code == GST_RESOURCE_ERROR_READ
+		    || err->code == GST_RESOURCE_ERROR_OPEN_READ
+		    || err->code == GST_RESOURCE_ERROR_OPEN_READ_WRITE);
+}
+
+static gboolean retry_stream(gpointer userdata) {
+	struct gst_player *p = (struct gst_player*) userdata;
+	p->recovery_source = 0;
+	Log_info("gstreamer", "Reconnecting to %s (attempt %d of %d)",
+		 p->gsuri, p->retry_attempt, error_retries);
+	set_player_uri(p);
+	p->paused_running_time = 0;
+	if (p->target_state == GST_STATE_PLAYING)
+		set_playing(p, 0);
+	else
+		gst_element_set_state(p->pipeline, GST_STATE_PAUSED);
+	return FALSE;
+}
+
+static gboolean skip_stream(gpointer userdata) {
+	struct gst_player *p = (struct gst_player*) userdata;
+	p->recovery_source = 0;
+	if (p->gs_next_uri == NULL || p->error_skips >= kMaxErrorSkips) {
+		Log_error("gstreamer", "Stopping after error.");
+		p->target_state = GST_STATE_READY;
+		report_transition(p, PLAY_STOPPED);
+		return FALSE;
+	}
+	++p->error_skips;
+	Log_info("gstreamer", "Skipping to %s", p->gs_next_uri);
+	start_next_uri(p);
+	return FALSE;
+}
+
+static gboolean forget_retries(gpointer userdata) {
+	struct gst_player *p = (struct gst_player*) userdata;
+	p->stable_source = 0;
+	Log_info("gstreamer", "Playing fine again after %d retries",
+		 p->retry_attempt);
+	p->retry_attempt = 0;
+	p->resume_position = 0;
+	return FALSE;
+}
+
+static void handle_error(struct gst_player *p, const GError *err) {
+	if (p->recovery_source != 0)
+		return;  // Follow-up of the error we are handling.
+	remove_source(&p->stable_source);
+	p->next_stream_pending = 0;
+	reset_buffering(p);
+	gst_element_set_state(p->pipeline, GST_STATE_READY);
+	if (p->target_state != GST_STATE_PLAYING
+	    && p->target_state != GST_STATE_PAUSED) {
+		// Not playing yet, e.g. prerolling; Play tries again.
+		p->prerolled = 0;
+		report_transition(p, PLAY_ERROR);
+		return;
+	}
+	if (is_network_error(err) && p->retry_attempt < error_retries) {
+		if (p->resume_position == 0)  // Else not reconnected yet.
+			p->resume_position = p->last_known_time.position;
+		int delay = 1 << p->retry_attempt;
+		if (delay > kMaxRetryDelaySec)
+			delay = kMaxRetryDelaySec;
+		++p->retry_attempt;
+		Log_info("gstreamer", "Network error; reconnecting in %ds "
+			 "to continue at %.1fs", delay,
+			 p->resume_position / 1e9);
+		p->recovery_source = g_timeout_add_seconds(delay, retry_stream,
+							   p);
+		return;
+	}
+	Log_error("gstreamer", "Can't play %s", p->gsuri);
+	cancel_recovery(p);
+	report_transition(p, PLAY_ERROR);
+	// Once the messages of the broken stream are through.
+	p->recovery_source = g_idle_add(skip_stream, p);
+}
+
 static gboolean my_bus_callback(GstBus * bus, GstMessage * msg,
 				gpointer data)
 {
 	(void)bus;
-	(void)data;
+	struct gst_player *p = (struct gst_player*) data;
 
 	GstMessageType msgType;
 	const GstObject *msgSrc;
@@ -278,22 +708,30 @@ static gboolean my_bus_callback(GstBus * bus, GstMessage * msg,
 	msgSrcName = GST_OBJECT_NAME(msgSrc);
 
 	switch (msgType) {
+	case GST_MESSAGE_SEGMENT_DONE:
+		if (p->loop) {
+			// Not flushing: continues right after the queued data.
+			Log_info("gstreamer", "%s: Segment done, loop", msgSrcName);
+			segment_seek(p, 0, GST_SEEK_FLAG_NONE);
+			break;
+		}
+		// Looping was switched off: this is the end of the track.
+		p->segment_active = 0;
+		/* fallthrough */
 	case GST_MESSAGE_EOS:
 		Log_info("gstreamer", "%s: End-of-stream", msgSrcName);
-		if (gs_next_uri_ != NULL) {
+		p->next_stream_pending = 0;
+		if (p->loop) {
+			// Could not loop as segment; start over.
+			gst_element_set_state(p->pipeline, GST_STATE_READY);
+			set_player_uri(p);
+			set_playing(p, 0);
+		} else if (p->gs_next_uri != NULL) {
 			// If playbin does not support gapless (old
 			// versions didn't), this will trigger.
-			free(gsuri_);
-			gsuri_ = gs_next_uri_;
-			gs_next_uri_ = NULL;
-			gst_element_set_state(player_, GST_STATE_READY);
-			g_object_set(G_OBJECT(player_), "uri", gsuri_, NULL);
-			gst_element_set_state(player_, GST_STATE_PLAYING);
-			if (play_trans_callback_) {
-				play_trans_callback_(PLAY_STARTED_NEXT_STREAM);
-			}
-		} else if (play_trans_callback_) {
-			play_trans_callback_(PLAY_STOPPED);
+			start_next_uri(p);
+		} else {
+			report_transition(p, PLAY_STOPPED);
 		}
 		break;
 
@@ -305,15 +743,58 @@ static gboolean my_bus_callback(GstBus * bus, GstMessage * msg,
 
 		Log_error("gstreamer", "%s: Error: %s (Debug: %s)",
 			  msgSrcName, err->message, debug);
+		handle_error(p, err);
 		g_error_free(err);
 		g_free(debug);
 
 		break;
 	}
+#if (GST_VERSION_MAJOR >= 1)
+	case GST_MESSAGE_STREAM_START:
+		if (p->next_stream_pending) {
+			Log_info("gstreamer", "%s: Next stream started",
+				 msgSrcName);
+			p->next_stream_pending = 0;
+			cancel_recovery(p);
+			report_cache_use(p);
+			// Don't report the old track's time for the new one.
+			p->last_known_time.duration = 0;
+			p->last_known_time.position = 0;
+			report_transition(p, PLAY_STARTED_NEXT_STREAM);
+		}
+		break;
+#endif
+
 	case GST_MESSAGE_STATE_CHANGED: {
 		GstState oldstate, newstate, pending;
 		gst_message_parse_state_changed(msg, &oldstate, &newstate,
 						&pending);
+		if (msgSrc == GST_OBJECT(p->pipeline)) {
+			if (newstate == GST_STATE_READY) {
+				p->segment_active = 0;
+			} else if (newstate == GST_STATE_PLAYING) {
+				p->error_skips = 0;
+				if (!p->next_stream_pending)
+					report_cache_use(p);
+				if (p->retry_attempt > 0 && p->stable_source == 0) {
+					p->stable_source = g_timeout_add_seconds(
+						kStablePlaySec, forget_retries,
+						p);
+				}
+			} else if (oldstate == GST_STATE_READY
+				   && newstate == GST_STATE_PAUSED
+				   && p->resume_position > 0) {
+				// Reconnected; continue where we were. A
+				// later error starts from p->last_known_time.
+				output_gstreamer_seek(p, p->resume_position);
+				p->resume_position = 0;
+			} else if (oldstate == GST_STATE_READY
+				   && newstate == GST_STATE_PAUSED && p->loop
+				   && !p->segment_active) {
+				// Prerolled a new stream: play it as segment.
+				segment_seek(p, 0, GST_SEEK_FLAG_FLUSH);
+			}
+		}
 		/*
 		g_print("GStreamer: %s: State change: '%s' -> '%s', "
 			"PENDING: '%s'\n", msgSrcName,
@@ -327,18 +808,19 @@ static gboolean my_bus_callback(GstBus * bus, GstMessage * msg,
 	case GST_MESSAGE_TAG: {
 		GstTagList *tags = NULL;
 
-		if (meta_update_callback_ != NULL) {
+		if (p->meta_update_callback != NULL) {
 			gst_message_parse_tag(msg, &tags);
 			/*g_print("GStreamer: Got tags from element %s\n",
 				GST_OBJECT_NAME (msg->src));
 			*/
 			struct MetaModify modify;
-			modify.meta = &song_meta_;
+			modify.meta = &p->song_meta;
 			modify.any_change = 0;
 			gst_tag_list_foreach(tags, &MetaModify_add_tag, &modify);
 			gst_tag_list_free(tags);
 			if (modify.any_change) {
-				meta_update_callback_(&song_meta_);
+				p->meta_update_callback(&p->song_meta,
+							p->meta_update_userdata);
 			}
 		}
 		break;
@@ -346,17 +828,17 @@ static gboolean my_bus_callback(GstBus * bus, GstMessage * msg,
 
 	case GST_MESSAGE_BUFFERING:
         {
-                if (buffer_duration <= 0.0) break;  /* nothing to buffer */
-
                 gint percent = 0;
                 gst_message_parse_buffering (msg, &percent);
+		Metrics_set(METRIC_BUFFER_PERCENT, percent);
+		if (percent < 100 && p->buffer_full) {
+			Metrics_add(METRIC_BUFFER_UNDERRUNS, 1);
+		}
+		p->buffer_full = (percent >= 100);
 
+                if (buffer_duration <= 0.0) break;  /* nothing to buffer */
 
-                /* Pause playback until buffering is complete. */
-                if (percent < 100)
-                        gst_element_set_state(player_, GST_STATE_PAUSED);
-                else
-                        gst_element_set_state(player_, GST_STATE_PLAYING);
+		handle_buffering(p, percent);
 		break;
         }
 	default:
@@ -376,6 +858,14 @@ static gchar *audio_pipe = NULL;
 static gchar *video_sink = NULL;
 static gchar *video_pipe = NULL;
 static double initial_db = 0.0;
+static int http_timeout = 0;         // Seconds; 0: the source's default.
+static int http_retries = -1;        // -1: the source's default.
+static gboolean http_keep_alive = FALSE;
+static int ring_buffer_mb = 0;
+static gchar *prefetch_dir = NULL;
+static int prefetch_max_mb = 512;
+static gchar *cache_dir = NULL;
+static int cache_max_mb = 4096;
 
 /* Options specific to output_gstreamer */
 static GOptionEntry option_entries[] = {
@@ -401,9 +891,60 @@ static GOptionEntry option_entries[] = {
         { "gstout-buffer-duration", 0, 0, G_OPTION_ARG_DOUBLE, &buffer_duration,
           "The size of the buffer in seconds. Set to zero to disable buffering.",
           NULL },
+        { "gstout-buffer-low-percent", 0, 0, G_OPTION_ARG_INT,
+          &buffer_low_percent,
+          "While playing, pause to refill the buffer when it drops below "
+          "this percentage.", NULL },
+        { "gstout-buffer-high-percent", 0, 0, G_OPTION_ARG_INT,
+          &buffer_high_percent,
+          "Percentage the buffer needs to reach before playback starts or "
+          "continues.", NULL },
         { "gstout-initial-volume-db", 0, 0, G_OPTION_ARG_DOUBLE, &initial_db,
           "GStreamer initial volume in decibel (e.g. 0.0 = max; -6 = 1/2 max) ",
 	  NULL },
+        { "gstout-http-timeout", 0, 0, G_OPTION_ARG_INT, &http_timeout,
+          "Seconds without data after which the HTTP source reconnects.",
+          NULL },
+        { "gstout-http-retries", 0, 0, G_OPTION_ARG_INT, &http_retries,
+          "How often the HTTP source reconnects (resuming at the byte it "
+          "stopped) before giving up; -1 = source default.", NULL },
+        { "gstout-http-keep-alive", 0, 0, G_OPTION_ARG_NONE, &http_keep_alive,
+          "Keep HTTP connections open between requests.", NULL },
+        { "gstout-ring-buffer-size", 0, 0, G_OPTION_ARG_INT, &ring_buffer_mb,
+          "Download into a ring buffer of this many MB; lets playback "
+          "ride out longer network hiccups. 0 = off.", NULL },
+        { "gstout-prefetch-dir", 0, 0, G_OPTION_ARG_STRING, &prefetch_dir,
+          "Download the next track into this directory (e.g. on a tmpfs "
+          "like /dev/shm) while the current one plays.", NULL },
+        { "gstout-prefetch-max-mb", 0, 0, G_OPTION_ARG_INT, &prefetch_max_mb,
+          "Don't download tracks bigger than this.", NULL },
+        { "gstout-cache-dir", 0, 0, G_OPTION_ARG_STRING, &cache_dir,
+          "Keep streams played from start to end in this directory (an "
+          "absolute path), and play them from there next time.", NULL },
+        { "gstout-cache-max-mb", 0, 0, G_OPTION_ARG_INT, &cache_max_mb,
+          "Size of the cache; least recently played tracks are removed "
+          "beyond this.", NULL },
+        { "gstout-error-retries", 0, 0, G_OPTION_ARG_INT, &error_retries,
+          "After a network error, reconnect this often (waiting 1, 2, 4.. "
+          "seconds) before skipping to the next track.", NULL },
+        { "gstout-preroll", 0, 0, G_OPTION_ARG_NONE, &preroll_on_set_uri,
+          "Connect to and preroll a stream as soon as it is set, so "
+          "that Play starts it instantly.", NULL },
+#ifdef HAVE_GST_NET
+        { "gstout-clock-provide", 0, 0, G_OPTION_ARG_INT, &clock_provide_port,
+          "Synchronized playback: serve our clock to the group on this "
+          "UDP port.", NULL },
+        { "gstout-clock-master", 0, 0, G_OPTION_ARG_STRING, &clock_master,
+          "Synchronized playback: use the clock of the group served at "
+          "host:port.", NULL },
+        { "gstout-sync-latency-ms", 0, 0, G_OPTION_ARG_INT, &sync_latency_ms,
+          "Synchronized playback: time to allow for all renderers to get "
+          "ready to play.", NULL },
+        { "gstout-sync-window-ms", 0, 0, G_OPTION_ARG_INT, &sync_window_ms,
+          "Synchronized playback: start at the next multiple of this on the "
+          "group clock; renderers told to play within the same window "
+          "start together.", NULL },
+#endif
         { NULL }
 };
 
@@ -422,13 +963,15 @@ static int output_gstreamer_add_options(GOptionContext *ctx)
 	return 0;
 }
 
-static int output_gstreamer_get_position(gint64 *track_duration,
+static int output_gstreamer_get_position(void *player,
+					 gint64 *track_duration,
 					 gint64 *track_pos) {
-	*track_duration = last_known_time_.duration;
-	*track_pos = last_known_time_.position;
+	struct gst_player *p = (struct gst_player*) player;
+	*track_duration = p->last_known_time.duration;
+	*track_pos = p->last_known_time.position;
 
 	int rc = 0;
-	if (get_current_player_state() != GST_STATE_PLAYING) {
+	if (get_current_player_state(p) != GST_STATE_PLAYING) {
 		return rc;  // playbin2 only returns valid values then.
 	}
 #if (GST_VERSION_MAJOR < 1)
@@ -437,84 +980,338 @@ static int output_gstreamer_get_position(gint64 *track_duration,
 #else
 	GstFormat query_type = GST_FORMAT_TIME;
 #endif
-	if (!gst_element_query_duration(player_, query_type, track_duration)) {
+	if (!gst_element_query_duration(p->pipeline, query_type,
+					track_duration)) {
 		Log_error("gstreamer", "Failed to get track duration.");
 		rc = -1;
 	}
-	if (!gst_element_query_position(player_, query_type, track_pos)) {
+	if (!gst_element_query_position(p->pipeline, query_type, track_pos)) {
 		Log_error("gstreamer", "Failed to get track pos");
 		rc = -1;
 	}
 	// playbin2 does not allow to query while paused. Remember in case
 	// we're asked then (it actually returns something, but it is bogus).
-	last_known_time_.duration = *track_duration;
-	last_known_time_.position = *track_pos;
+	p->last_known_time.duration = *track_duration;
+	p->last_known_time.position = *track_pos;
 	return rc;
 }
 
-static int output_gstreamer_get_volume(float *v) {
+static int output_gstreamer_get_volume(void *player, float *v) {
+	struct gst_player *p = (struct gst_player*) player;
 	double volume;
-	g_object_get(player_, "volume", &volume, NULL);
+	g_object_get(p->pipeline, "volume", &volume, NULL);
 	Log_info("gstreamer", "Query volume fraction: %f", volume);
 	*v = volume;
 	return 0;
 }
-static int output_gstreamer_set_volume(float value) {
+static int output_gstreamer_set_volume(void *player, float value) {
+	struct gst_player *p = (struct gst_player*) player;
 	Log_info("gstreamer", "Set volume fraction to %f", value);
-	g_object_set(player_, "volume", (double) value, NULL);
+	g_object_set(p->pipeline, "volume", (double) value, NULL);
 	return 0;
 }
-static int output_gstreamer_get_mute(int *m) {
+static int output_gstreamer_get_mute(void *player, int *m) {
+	struct gst_player *p = (struct gst_player*) player;
 	gboolean val;
-	g_object_get(player_, "mute", &val, NULL);
+	g_object_get(p->pipeline, "mute", &val, NULL);
 	*m = val;
 	return 0;
 }
-static int output_gstreamer_set_mute(int m) {
+static int output_gstreamer_set_mute(void *player, int m) {
+	struct gst_player *p = (struct gst_player*) player;
 	Log_info("gstreamer", "Set mute to %s", m ? "on" : "off");
-	g_object_set(player_, "mute", (gboolean) m, NULL);
+	g_object_set(p->pipeline, "mute", (gboolean) m, NULL);
 	return 0;
 }
 
 static void prepare_next_stream(GstElement *obj, gpointer userdata) {
 	(void)obj;
-	(void)userdata;
+	struct gst_player *p = (struct gst_player*) userdata;
 
+	if (p->loop) {
+		// Only if the stream can't be played as segment.
+		Log_info("gstreamer", "about-to-finish cb: repeat %s", p->gsuri);
+		set_player_uri(p);
+		return;
+	}
 	Log_info("gstreamer", "about-to-finish cb: setting uri %s",
-		 gs_next_uri_);
-	free(gsuri_);
-	gsuri_ = gs_next_uri_;
-	gs_next_uri_ = NULL;
-	if (gsuri_ != NULL) {
-		g_object_set(G_OBJECT(player_), "uri", gsuri_, NULL);
-		if (play_trans_callback_) {
-			// TODO(hzeller): can we figure out when we _actually_
-			// start playing this ? there are probably a couple
-			// of seconds between now and actual start.
-			play_trans_callback_(PLAY_STARTED_NEXT_STREAM);
+		 p->gs_next_uri);
+	free(p->gsuri);
+	p->gsuri = p->gs_next_uri;
+	p->gs_next_uri = NULL;
+	if (p->gsuri != NULL) {
+		set_player_uri(p);
+#if (GST_VERSION_MAJOR < 1)
+		// No STREAM_START message here; the change is a couple of
+		// seconds early.
+		report_transition(p, PLAY_STARTED_NEXT_STREAM);
+#else
+		p->next_stream_pending = 1;
+#endif
+	}
+}
+
+#ifdef HAVE_GST_NET
+// Set up the shared clock if we're part of a synchronized group.
+static gboolean init_sync_clock(void) {
+	if (clock_master == NULL && clock_provide_port <= 0)
+		return TRUE;
+	if (sync_window_ms <= 0 || sync_latency_ms < 0) {
+		Log_error("gstreamer", "Invalid sync window or latency.");
+		return FALSE;
+	}
+	GstClock *clock;
+	if (clock_master != NULL) {
+		char *host = g_strdup(clock_master);
+		char *colon = strrchr(host, ':');
+		const int port = colon ? atoi(colon + 1) : 0;
+		if (colon) *colon = '\0';
+		if (port <= 0) {
+			Log_error("gstreamer", "--gstout-clock-master needs "
+				  "host:port (got '%s')", clock_master);
+			g_free(host);
+			return FALSE;
+		}
+		clock = gst_net_client_clock_new("group-clock", host, port, 0);
+		g_free(host);
+		if (clock == NULL) {
+			Log_error("gstreamer", "Can't create clock for %s",
+				  clock_master);
+			return FALSE;
 		}
+		// Don't hold up startup for long; it keeps syncing anyway.
+		if (!gst_clock_wait_for_sync(clock, 2 * GST_SECOND)) {
+			Log_error("gstreamer", "Clock at %s not synced yet.",
+				  clock_master);
+		}
+	} else {
+		clock = gst_system_clock_obtain();
+	}
+	if (clock_provide_port > 0) {
+		GstNetTimeProvider *provider =
+			gst_net_time_provider_new(clock, NULL,
+						  clock_provide_port);
+		if (provider == NULL) {
+			Log_error("gstreamer", "Can't serve clock on port %d",
+				  clock_provide_port);
+			gst_object_unref(clock);
+			return FALSE;
+		}
+		// Stays alive as long as we do.
+	}
+	sync_clock_ = clock;
+	Log_info("gstreamer", "Synchronized playback; clock %s%s, "
+		 "latency %dms, window %dms",
+		 clock_master ? "from " : "local",
+		 clock_master ? clock_master : "",
+		 sync_latency_ms, sync_window_ms);
+	return TRUE;
+}
+#endif
+
+// All pipelines play on the group's clock, if we're part of one.
+static void use_sync_clock(struct gst_player *p) {
+	if (sync_clock_ == NULL)
+		return;
+	gst_pipeline_use_clock(GST_PIPELINE(p->pipeline), sync_clock_);
+	// We set the base time ourselves.
+	gst_element_set_start_time(p->pipeline, GST_CLOCK_TIME_NONE);
+	gst_pipeline_set_latency(GST_PIPELINE(p->pipeline),
+				 sync_latency_ms * GST_MSECOND);
+}
+
+// Only set properties the source has; e.g. souphttpsrc and curlhttpsrc
+// differ, and file sources have none of them.
+static void set_if_supported(GstElement *source, const char *name, int value) {
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(source), name)) {
+		g_object_set(G_OBJECT(source), name, value, NULL);
+		Log_info("gstreamer", "%s: %s=%d",
+			 G_OBJECT_TYPE_NAME(source), name, value);
 	}
 }
 
+#if (GST_VERSION_MAJOR >= 1)
+// -- Filling the media cache.
+// A probe on the source's pad sees the stream as it comes from the network.
+struct http_validators {
+	const char *etag;
+	gint64 content_length;
+};
+
+static gboolean find_validator(GQuark field, const GValue *value,
+			       gpointer userdata) {
+	struct http_validators *validators = (struct http_validators*) userdata;
+	if (!G_VALUE_HOLDS_STRING(value))
+		return TRUE;
+	const char *name = g_quark_to_string(field);
+	if (g_ascii_strcasecmp(name, "ETag") == 0) {
+		validators->etag = g_value_get_string(value);
+	} else if (g_ascii_strcasecmp(name, "Content-Length") == 0) {
+		validators->content_length =
+			g_ascii_strtoll(g_value_get_string(value), NULL, 10);
+	}
+	return TRUE;
+}
+
+static GstPadProbeReturn cache_probe(GstPad *pad, GstPadProbeInfo *info,
+				     gpointer userdata) {
+	(void)pad;
+	struct media_cache_fill **fill = (struct media_cache_fill**) userdata;
+	if (*fill == NULL)
+		return GST_PAD_PROBE_OK;
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER) {
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		GstMapInfo map;
+		if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+			MediaCache_fill_write(*fill, GST_BUFFER_OFFSET(buffer),
+					      map.data, map.size);
+			gst_buffer_unmap(buffer, &map);
+		}
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	if (GST_EVENT_TYPE(event) == GST_EVENT_EOS) {
+		MediaCache_fill_end(*fill, 1);
+		*fill = NULL;
+	} else if (GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_DOWNSTREAM_STICKY
+		   && gst_event_has_name(event, "http-headers")) {
+		// souphttpsrc tells us about the response.
+		GstStructure *headers = NULL;
+		gst_structure_get(gst_event_get_structure(event),
+				  "response-headers", GST_TYPE_STRUCTURE,
+				  &headers, NULL);
+		if (headers != NULL) {
+			struct http_validators validators = { NULL, -1 };
+			gst_structure_foreach(headers, find_validator,
+					      &validators);
+			MediaCache_fill_set_validators(
+				*fill, validators.etag,
+				validators.content_length);
+			gst_structure_free(headers);
+		}
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+// Pad (and the probe) gone without having seen the end.
+static void end_cache_fill(gpointer userdata) {
+	struct media_cache_fill **fill = (struct media_cache_fill**) userdata;
+	MediaCache_fill_end(*fill, 0);
+	g_free(fill);
+}
+
+static void start_cache_fill(GstElement *source) {
+	if (!g_object_class_find_property(G_OBJECT_GET_CLASS(source),
+					  "location"))
+		return;
+	gchar *location = NULL;
+	g_object_get(G_OBJECT(source), "location", &location, NULL);
+	if (location == NULL || !g_str_has_prefix(location, "http")) {
+		g_free(location);
+		return;  // Local already.
+	}
+	struct media_cache_fill *fill = MediaCache_fill_begin(location);
+	g_free(location);
+	if (fill == NULL)
+		return;
+	GstPad *pad = gst_element_get_static_pad(source, "src");
+	if (pad == NULL) {
+		MediaCache_fill_end(fill, 0);
+		return;
+	}
+	struct media_cache_fill **slot = g_new(struct media_cache_fill*, 1);
+	*slot = fill;
+	gst_pad_add_probe(pad, (GST_PAD_PROBE_TYPE_BUFFER
+				| GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+			  cache_probe, slot, end_cache_fill);
+	gst_object_unref(pad);
+}
+#endif
+
+// playbin created the element to fetch the stream.
+static void setup_source(GstElement *playbin, GstElement *source,
+			 gpointer userdata) {
+	(void)playbin;
+	(void)userdata;
+	if (http_timeout > 0)
+		set_if_supported(source, "timeout", http_timeout);
+	if (http_retries >= 0)
+		set_if_supported(source, "retries", http_retries);
+	if (http_keep_alive)
+		set_if_supported(source, "keep-alive", TRUE);
+#if (GST_VERSION_MAJOR >= 1)
+	if (cache_dir != NULL)
+		start_cache_fill(source);
+#endif
+}
+
 static int output_gstreamer_init(void)
 {
-	GstBus *bus;
-
-	SongMetaData_init(&song_meta_);
 	scan_mime_list();
 
+	if (buffer_low_percent < 0 || buffer_high_percent > 100
+	    || buffer_low_percent >= buffer_high_percent) {
+		Log_error("gstreamer", "Need 0 <= --gstout-buffer-low-percent "
+			  "< --gstout-buffer-high-percent <= 100");
+		return 1;
+	}
+	if (audio_sink != NULL && audio_pipe != NULL) {
+		Log_error("gstreamer", "--gstout-audosink and --gstout-audiopipe are mutually exclusive.");
+		return 1;
+	}
+	if (video_sink != NULL && video_pipe != NULL) {
+		Log_error("gstreamer", "--gstout-videosink and --gstout-videopipe are mutually exclusive.");
+		return 1;
+	}
+	if (prefetch_dir != NULL
+	    && Prefetch_init(prefetch_dir,
+			     (int64_t) prefetch_max_mb * 1024 * 1024) != 0) {
+		return 1;
+	}
+	if (cache_dir != NULL
+	    && MediaCache_init(cache_dir,
+			       (int64_t) cache_max_mb * 1024 * 1024) != 0) {
+		return 1;
+	}
+
+#ifdef HAVE_GST_NET
+	if (!init_sync_clock()) {
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+// A zone's "zone_sink" and "zone_device" take the place of --gstout-audiosink
+// and --gstout-audiodevice (and --gstout-audiopipe).
+static void *output_gstreamer_create(const char *zone_sink,
+				     const char *zone_device)
+{
+	GstBus *bus;
+	const char *sink_name = zone_sink ? zone_sink : audio_sink;
+	const char *device = zone_device ? zone_device : audio_device;
+
 #if (GST_VERSION_MAJOR < 1)
 	const char player_element_name[] = "playbin2";
 #else
 	const char player_element_name[] = "playbin";
 #endif
 
-	player_ = gst_element_factory_make(player_element_name, "play");
-	if (!player_) {
+	struct gst_player *p = (struct gst_player*) calloc(1, sizeof(*p));
+	SongMetaData_init(&p->song_meta);
+	p->target_state = GST_STATE_NULL;
+	p->cache_use = -1;
+	p->prefetch = Prefetch_new();
+	p->pipeline = gst_element_factory_make(player_element_name, "play");
+	if (!p->pipeline) {
 		Log_error("gstreamer", "Can not initialize '%s'; "
 			  "gstreamer installation with plugins complete ?",
 			  player_element_name);
-		return 1;
+		free(p->prefetch);
+		free(p);
+		return NULL;
 	}
 
         /* set buffer size */
@@ -523,7 +1320,7 @@ static int output_gstreamer_init(void)
                 Log_info("gstreamer",
                          "Setting buffer duration to %" PRId64 "ms",
                          buffer_duration_ns / 1000000);
-                g_object_set(G_OBJECT(player_),
+                g_object_set(G_OBJECT(p->pipeline),
                              "buffer-duration",
                              buffer_duration_ns,
                              NULL);
@@ -532,35 +1329,41 @@ static int output_gstreamer_init(void)
 			 "Buffering disabled (--gstout-buffer-duration)");
         }
 
-	bus = gst_pipeline_get_bus(GST_PIPELINE(player_));
-	gst_bus_add_watch(bus, my_bus_callback, NULL);
-	gst_object_unref(bus);
-
-	if (audio_sink != NULL && audio_pipe != NULL) {
-		Log_error("gstreamer", "--gstout-audosink and --gstout-audiopipe are mutually exclusive.");
-		return 1;
-	}
-	if (video_sink != NULL && video_pipe != NULL) {
-		Log_error("gstreamer", "--gstout-videosink and --gstout-videopipe are mutually exclusive.");
-		return 1;
+	if (ring_buffer_mb > 0) {
+		// The ring buffer is used for progressive download.
+		static const guint kPlayFlagDownload = (1 << 7);
+		guint flags = 0;
+		g_object_get(G_OBJECT(p->pipeline), "flags", &flags, NULL);
+		g_object_set(G_OBJECT(p->pipeline),
+			     "flags", flags | kPlayFlagDownload,
+			     "ring-buffer-max-size",
+			     (guint64) ring_buffer_mb * 1024 * 1024,
+			     NULL);
+		Log_info("gstreamer", "Using a %dMB ring buffer", ring_buffer_mb);
 	}
+	g_signal_connect(G_OBJECT(p->pipeline), "source-setup",
+			 G_CALLBACK(setup_source), NULL);
+	use_sync_clock(p);
+
+	bus = gst_pipeline_get_bus(GST_PIPELINE(p->pipeline));
+	gst_bus_add_watch(bus, my_bus_callback, p);
+	gst_object_unref(bus);
 
-	if (audio_sink != NULL) {
+	if (sink_name != NULL) {
 		GstElement *sink = NULL;
 		Log_info("gstreamer", "Setting audio sink to %s; device=%s\n",
-			 audio_sink, audio_device ? audio_device : "");
-		sink = gst_element_factory_make (audio_sink, "sink");
+			 sink_name, device ? device : "");
+		sink = gst_element_factory_make (sink_name, "sink");
 		if (sink == NULL) {
 		  Log_error("gstreamer", "Couldn't create sink '%s'",
-			    audio_sink);
+			    sink_name);
 		} else {
-		  if (audio_device != NULL) {
-		    g_object_set (G_OBJECT(sink), "device", audio_device, NULL);
+		  if (device != NULL) {
+		    g_object_set (G_OBJECT(sink), "device", device, NULL);
 		  }
-		  g_object_set (G_OBJECT (player_), "audio-sink", sink, NULL);
+		  g_object_set (G_OBJECT (p->pipeline), "audio-sink", sink, NULL);
 		}
-	}
-	if (audio_pipe != NULL) {
+	} else if (audio_pipe != NULL) {
 		GstElement *sink = NULL;
 		Log_info("gstreamer", "Setting audio sink-pipeline to %s\n",audio_pipe);
 		sink = gst_parse_bin_from_description(audio_pipe, TRUE, NULL);
@@ -568,14 +1371,14 @@ static int output_gstreamer_init(void)
 		if (sink == NULL) {
 			Log_error("gstreamer", "Could not create pipeline.");
 		} else {
-			g_object_set (G_OBJECT (player_), "audio-sink", sink, NULL);
+			g_object_set (G_OBJECT (p->pipeline), "audio-sink", sink, NULL);
 		}
 	}
 	if (video_sink != NULL) {
 		GstElement *sink = NULL;
 		Log_info("gstreamer", "Setting video sink to %s", video_sink);
 		sink = gst_element_factory_make (video_sink, "sink");
-		g_object_set (G_OBJECT (player_), "video-sink", sink, NULL);
+		g_object_set (G_OBJECT (p->pipeline), "video-sink", sink, NULL);
 	}
 	if (video_pipe != NULL) {
 		GstElement *sink = NULL;
@@ -585,23 +1388,23 @@ static int output_gstreamer_init(void)
 		if (sink == NULL) {
 			Log_error("gstreamer", "Could not create pipeline.");
 		} else {
-			g_object_set (G_OBJECT (player_), "video-sink", sink, NULL);
+			g_object_set (G_OBJECT (p->pipeline), "video-sink", sink, NULL);
 		}
 	}
 
-	if (gst_element_set_state(player_, GST_STATE_READY) ==
+	if (gst_element_set_state(p->pipeline, GST_STATE_READY) ==
 	    GST_STATE_CHANGE_FAILURE) {
 		Log_error("gstreamer", "Error: pipeline doesn't become ready.");
 	}
 
-	g_signal_connect(G_OBJECT(player_), "about-to-finish",
-			 G_CALLBACK(prepare_next_stream), NULL);
-	output_gstreamer_set_mute(0);
+	g_signal_connect(G_OBJECT(p->pipeline), "about-to-finish",
+			 G_CALLBACK(prepare_next_stream), p);
+	output_gstreamer_set_mute(p, 0);
 	if (initial_db < 0) {
-		output_gstreamer_set_volume(exp(initial_db / 20 * log(10)));
+		output_gstreamer_set_volume(p, exp(initial_db / 20 * log(10)));
 	}
 
-	return 0;
+	return p;
 }
 
 struct output_module gstreamer_output = {
@@ -610,12 +1413,15 @@ struct output_module gstreamer_output = {
 	.add_options = output_gstreamer_add_options,
 
 	.init        = output_gstreamer_init,
+	.create      = output_gstreamer_create,
 	.set_uri     = output_gstreamer_set_uri,
 	.set_next_uri= output_gstreamer_set_next_uri,
 	.play        = output_gstreamer_play,
 	.stop        = output_gstreamer_stop,
 	.pause       = output_gstreamer_pause,
 	.seek        = output_gstreamer_seek,
+	.set_loop    = output_gstreamer_set_loop,
+	.restart     = output_gstreamer_restart,
 
 	.get_position = output_gstreamer_get_position,
 	.get_volume  = output_gstreamer_get_volume,
@@ -31,21 +31,28 @@ struct output_module {
         const char *description;
 	int (*add_options)(GOptionContext *ctx);
 
-	// Commands.
+	// Commands. All but init() and create() are for the player returned
+	// by create().
 	int (*init)(void);
-	void (*set_uri)(const char *uri, output_update_meta_cb_t meta_info);
-	void (*set_next_uri)(const char *uri);
-	int (*play)(output_transition_cb_t transition_callback);
-	int (*stop)(void);
-	int (*pause)(void);
-	int (*seek)(gint64 position_nanos);
+	void *(*create)(const char *audio_sink, const char *audio_device);
+	void (*set_uri)(void *player, const char *uri,
+			output_update_meta_cb_t meta_info, void *userdata);
+	void (*set_next_uri)(void *player, const char *uri);
+	int (*play)(void *player, output_transition_cb_t transition_callback,
+		    void *userdata);
+	int (*stop)(void *player);
+	int (*pause)(void *player);
+	int (*seek)(void *player, gint64 position_nanos);
+	int (*set_loop)(void *player, int enable);  // optional
+	int (*restart)(void *player);               // optional
 
 	// parameters
-	int (*get_position)(gint64 *track_duration, gint64 *track_pos);
-	int (*get_volume)(float *);
-	int (*set_volume)(float);
-	int (*get_mute)(int *);
-	int (*set_mute)(int);
+	int (*get_position)(void *player,
+			    gint64 *track_duration, gint64 *track_pos);
+	int (*get_volume)(void *player, float *);
+	int (*set_volume)(void *player, float);
+	int (*get_mute)(void *player, int *);
+	int (*set_mute)(void *player, int);
 };
 
 #endif
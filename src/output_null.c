@@ -0,0 +1,181 @@
+/* output_null.c - Output module that discards everything.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+// This output does not play anything, it merely keeps track of the state
+// and a virtual play position. Useful for testing and benchmarking the
+// UPnP side without audio hardware.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logging.h"
+#include "upnp_connmgr.h"
+#include "output_module.h"
+#include "output_null.h"
+
+// Every stream pretends to be that long.
+static const gint64 kStreamDurationNanos = 180LL * 1000000000LL;
+
+struct null_player {
+	char *uri;
+	char *next_uri;
+	int playing;
+	gint64 position_nanos;     // Position when we last stopped.
+	gint64 play_start_nanos;   // Clock when we started playing.
+	float volume;
+	int mute;
+};
+
+static gint64 now_nanos(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (gint64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static gint64 current_position(const struct null_player *p) {
+	gint64 pos = p->position_nanos;
+	if (p->playing)
+		pos += now_nanos() - p->play_start_nanos;
+	return pos < kStreamDurationNanos ? pos : kStreamDurationNanos;
+}
+
+static int output_null_init(void) {
+	register_mime_type("audio/*");
+	register_mime_type("audio/mpeg");
+	register_mime_type("audio/x-flac");
+	register_mime_type("audio/x-wav");
+	return 0;
+}
+
+static void *output_null_create(const char *audio_sink,
+				const char *audio_device) {
+	(void)audio_sink;
+	(void)audio_device;
+	struct null_player *p = (struct null_player*) calloc(1, sizeof(*p));
+	p->volume = 1.0;
+	return p;
+}
+
+static void output_null_set_uri(void *player, const char *uri,
+				output_update_meta_cb_t meta_cb,
+				void *userdata) {
+	struct null_player *p = (struct null_player*) player;
+	(void)meta_cb;
+	(void)userdata;
+	Log_info("null", "Set uri to '%s'", uri);
+	free(p->uri);
+	p->uri = (uri && *uri) ? strdup(uri) : NULL;
+	p->position_nanos = 0;
+	p->play_start_nanos = now_nanos();
+}
+
+static void output_null_set_next_uri(void *player, const char *uri) {
+	struct null_player *p = (struct null_player*) player;
+	free(p->next_uri);
+	p->next_uri = (uri && *uri) ? strdup(uri) : NULL;
+}
+
+static int output_null_play(void *player, output_transition_cb_t callback,
+			    void *userdata) {
+	struct null_player *p = (struct null_player*) player;
+	(void)callback;
+	(void)userdata;
+	if (p->uri == NULL)
+		return -1;
+	if (!p->playing) {
+		p->play_start_nanos = now_nanos();
+		p->playing = 1;
+	}
+	return 0;
+}
+
+static int output_null_stop(void *player) {
+	struct null_player *p = (struct null_player*) player;
+	p->playing = 0;
+	p->position_nanos = 0;
+	return 0;
+}
+
+static int output_null_pause(void *player) {
+	struct null_player *p = (struct null_player*) player;
+	p->position_nanos = current_position(p);
+	p->playing = 0;
+	return 0;
+}
+
+static int output_null_seek(void *player, gint64 position_nanos) {
+	struct null_player *p = (struct null_player*) player;
+	p->position_nanos = position_nanos;
+	p->play_start_nanos = now_nanos();
+	return 0;
+}
+
+static int output_null_get_position(void *player, gint64 *track_duration,
+				    gint64 *track_pos) {
+	const struct null_player *p = (struct null_player*) player;
+	*track_duration = p->uri ? kStreamDurationNanos : 0;
+	*track_pos = p->uri ? current_position(p) : 0;
+	return 0;
+}
+
+static int output_null_get_volume(void *player, float *v) {
+	*v = ((struct null_player*) player)->volume;
+	return 0;
+}
+static int output_null_set_volume(void *player, float value) {
+	((struct null_player*) player)->volume = value;
+	return 0;
+}
+static int output_null_get_mute(void *player, int *m) {
+	*m = ((struct null_player*) player)->mute;
+	return 0;
+}
+static int output_null_set_mute(void *player, int m) {
+	((struct null_player*) player)->mute = m;
+	return 0;
+}
+
+struct output_module null_output = {
+	.shortname = "null",
+	.description = "Discard output; only keep track of state",
+
+	.init        = output_null_init,
+	.create      = output_null_create,
+	.set_uri     = output_null_set_uri,
+	.set_next_uri= output_null_set_next_uri,
+	.play        = output_null_play,
+	.stop        = output_null_stop,
+	.pause       = output_null_pause,
+	.seek        = output_null_seek,
+
+	.get_position = output_null_get_position,
+	.get_volume  = output_null_get_volume,
+	.set_volume  = output_null_set_volume,
+	.get_mute    = output_null_get_mute,
+	.set_mute    = output_null_set_mute,
+};
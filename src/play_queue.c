@@ -0,0 +1,374 @@
+/* play_queue.c - Tracks to play, held by the renderer.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include "play_queue.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <upnp.h>
+#include <upnptools.h>
+
+#include "logging.h"
+#include "song-meta-data.h"
+#include "xmldoc.h"
+
+struct play_queue {
+	pthread_mutex_t mutex;
+	// Guarded by mutex
+	struct play_queue_entry *entries;
+	int length;
+	int capacity;
+	int current;
+	unsigned int last_id;
+
+	play_queue_listener_t listener;
+	void *listener_userdata;
+};
+
+// Call without holding q->mutex.
+static void notify_listener(struct play_queue *q) {
+	if (q->listener != NULL)
+		q->listener(q->listener_userdata);
+}
+
+static const char kDidlHeader[] = "<DIDL-Lite "
+	"xmlns=\"urn:schemas-upnp-org:metadata-1-0/DIDL-Lite/\" "
+	"xmlns:dc=\"http://purl.org/dc/elements/1.1/\" "
+	"xmlns:upnp=\"urn:schemas-upnp-org:metadata-1-0/upnp/\" "
+	"xmlns:dlna=\"urn:schemas-dlna-org:metadata-1-0/\">";
+static const char kDidlFooter[] = "</DIDL-Lite>";
+
+void PlayQueue_entry_clear(struct play_queue_entry *entry) {
+	free(entry->uri);
+	entry->uri = NULL;
+	free(entry->meta);
+	entry->meta = NULL;
+}
+
+static void clear_locked(struct play_queue *q) {
+	for (int i = 0; i < q->length; ++i)
+		PlayQueue_entry_clear(&q->entries[i]);
+	q->length = 0;
+	q->current = -1;
+}
+
+// Takes ownership of uri and meta. Needs q->mutex.
+static unsigned int insert_locked(struct play_queue *q, int index,
+				  char *uri, char *meta) {
+	if (q->length == q->capacity) {
+		q->capacity = q->capacity ? 2 * q->capacity : 16;
+		q->entries = (struct play_queue_entry*)
+			realloc(q->entries, q->capacity * sizeof(*q->entries));
+	}
+	memmove(&q->entries[index + 1], &q->entries[index],
+		(q->length - index) * sizeof(*q->entries));
+	++q->length;
+	if (q->current >= index)
+		++q->current;
+	struct play_queue_entry *entry = &q->entries[index];
+	entry->id = ++q->last_id;
+	entry->uri = uri;
+	entry->meta = meta ? meta : strdup("");
+	return entry->id;
+}
+
+static int index_of_locked(struct play_queue *q, unsigned int id) {
+	for (int i = 0; i < q->length; ++i) {
+		if (q->entries[i].id == id)
+			return i;
+	}
+	return -1;
+}
+
+struct play_queue *PlayQueue_new(void) {
+	struct play_queue *q = (struct play_queue*) calloc(1, sizeof(*q));
+	pthread_mutex_init(&q->mutex, NULL);
+	q->current = -1;
+	return q;
+}
+
+void PlayQueue_clear(struct play_queue *q) {
+	pthread_mutex_lock(&q->mutex);
+	clear_locked(q);
+	pthread_mutex_unlock(&q->mutex);
+	notify_listener(q);
+}
+
+unsigned int PlayQueue_insert(struct play_queue *q, unsigned int after_id,
+			      const char *uri, const char *meta) {
+	unsigned int id = 0;
+	pthread_mutex_lock(&q->mutex);
+	const int after = after_id == 0 ? -1 : index_of_locked(q, after_id);
+	if (after_id == 0 || after >= 0) {
+		id = insert_locked(q, after + 1, strdup(uri),
+				   meta ? strdup(meta) : NULL);
+	}
+	pthread_mutex_unlock(&q->mutex);
+	if (id != 0)
+		notify_listener(q);
+	return id;
+}
+
+int PlayQueue_delete(struct play_queue *q, unsigned int id) {
+	pthread_mutex_lock(&q->mutex);
+	const int index = index_of_locked(q, id);
+	if (index >= 0) {
+		PlayQueue_entry_clear(&q->entries[index]);
+		memmove(&q->entries[index], &q->entries[index + 1],
+			(q->length - index - 1) * sizeof(*q->entries));
+		--q->length;
+		if (q->current == index)
+			q->current = -1;
+		else if (q->current > index)
+			--q->current;
+	}
+	pthread_mutex_unlock(&q->mutex);
+	if (index < 0)
+		return -1;
+	notify_listener(q);
+	return 0;
+}
+
+int PlayQueue_length(struct play_queue *q) {
+	pthread_mutex_lock(&q->mutex);
+	const int result = q->length;
+	pthread_mutex_unlock(&q->mutex);
+	return result;
+}
+
+int PlayQueue_get(struct play_queue *q, int index,
+		  struct play_queue_entry *entry) {
+	int result = -1;
+	pthread_mutex_lock(&q->mutex);
+	if (index >= 0 && index < q->length) {
+		entry->id = q->entries[index].id;
+		entry->uri = strdup(q->entries[index].uri);
+		entry->meta = strdup(q->entries[index].meta);
+		result = 0;
+	}
+	pthread_mutex_unlock(&q->mutex);
+	return result;
+}
+
+int PlayQueue_ids(struct play_queue *q, unsigned int **ids) {
+	pthread_mutex_lock(&q->mutex);
+	const int result = q->length;
+	*ids = (unsigned int*) malloc((q->length + 1) * sizeof(**ids));
+	for (int i = 0; i < q->length; ++i)
+		(*ids)[i] = q->entries[i].id;
+	pthread_mutex_unlock(&q->mutex);
+	return result;
+}
+
+int PlayQueue_index_of(struct play_queue *q, unsigned int id) {
+	pthread_mutex_lock(&q->mutex);
+	const int result = index_of_locked(q, id);
+	pthread_mutex_unlock(&q->mutex);
+	return result;
+}
+
+int PlayQueue_current(struct play_queue *q) {
+	pthread_mutex_lock(&q->mutex);
+	const int result = q->current;
+	pthread_mutex_unlock(&q->mutex);
+	return result;
+}
+
+void PlayQueue_set_current(struct play_queue *q, int index) {
+	pthread_mutex_lock(&q->mutex);
+	q->current = (index >= 0 && index < q->length) ? index : -1;
+	pthread_mutex_unlock(&q->mutex);
+	notify_listener(q);
+}
+
+void PlayQueue_register_listener(struct play_queue *q,
+				 play_queue_listener_t listener,
+				 void *userdata) {
+	q->listener = listener;
+	q->listener_userdata = userdata;
+}
+
+// -- Playlist parsing. Needs q->mutex.
+
+static void append_locked(struct play_queue *q, const char *base_uri,
+			  const char *uri, const char *title) {
+	char *absolute = NULL;
+	if (strstr(uri, "://") != NULL
+	    || UpnpResolveURL2(base_uri, uri, &absolute) != UPNP_E_SUCCESS) {
+		absolute = strdup(uri);
+	}
+	char *meta = NULL;
+	if (title != NULL && *title) {
+		struct SongMetaData song;
+		SongMetaData_init(&song);
+		song.title = title;
+		meta = SongMetaData_to_DIDL(&song, NULL);
+	}
+	insert_locked(q, q->length, absolute, meta);
+}
+
+// Returns the line starting at "*pos" with whitespace trimmed, advancing
+// "*pos" to the next line; NULL at the end. Modifies the content.
+static char *next_line(char **pos) {
+	if (**pos == '\0')
+		return NULL;
+	char *line = *pos;
+	char *end = line + strcspn(line, "\r\n");
+	*pos = end + strspn(end, "\r\n");
+	*end = '\0';
+	while (isspace((unsigned char) *line))
+		++line;
+	while (end > line && isspace((unsigned char) end[-1]))
+		*--end = '\0';
+	return line;
+}
+
+static void load_m3u_locked(struct play_queue *q, const char *base_uri,
+			    char *content) {
+	const char *title = NULL;
+	char *line;
+	while ((line = next_line(&content)) != NULL) {
+		if (strncmp(line, "#EXTINF:", 8) == 0) {
+			title = strchr(line, ',');
+			if (title != NULL)
+				++title;
+		} else if (*line != '\0' && *line != '#') {
+			append_locked(q, base_uri, line, title);
+			title = NULL;
+		}
+	}
+}
+
+static void load_pls_locked(struct play_queue *q, const char *base_uri,
+			    char *content) {
+	// Entries are FileN=, TitleN= ...; with titles typically after files.
+	const int first = q->length;
+	int *numbers = NULL;
+	char *line;
+	while ((line = next_line(&content)) != NULL) {
+		int number, offset = 0;
+		if (sscanf(line, "File%d=%n", &number, &offset) == 1
+		    && offset > 0) {
+			append_locked(q, base_uri, line + offset, NULL);
+			numbers = (int*) realloc(numbers, (q->length - first)
+						 * sizeof(int));
+			numbers[q->length - first - 1] = number;
+		} else if (sscanf(line, "Title%d=%n", &number, &offset) == 1
+			   && offset > 0) {
+			for (int i = 0; i < q->length - first; ++i) {
+				if (numbers[i] != number)
+					continue;
+				struct SongMetaData song;
+				SongMetaData_init(&song);
+				song.title = line + offset;
+				free(q->entries[first + i].meta);
+				q->entries[first + i].meta =
+					SongMetaData_to_DIDL(&song, NULL);
+			}
+		}
+	}
+	free(numbers);
+}
+
+static void load_didl_locked(struct play_queue *q, const char *content) {
+	struct xmldoc *doc = xmldoc_parsexml(content);
+	if (doc == NULL)
+		return;
+	struct xmlelement *didl = find_element_in_doc(doc, "DIDL-Lite");
+	struct xmlelement *item = (didl != NULL
+				   ? find_element_in_element(didl, "item")
+				   : NULL);
+	for (/**/; item != NULL; item = find_next_element(item, "item")) {
+		struct xmlelement *res = find_element_in_element(item, "res");
+		if (res == NULL)
+			continue;
+		char *uri = get_node_value(res);
+		char *item_xml = xmlelement_tostring(item);
+		char *meta = NULL;
+		if (asprintf(&meta, "%s%s%s", kDidlHeader, item_xml,
+			     kDidlFooter) < 0) {
+			meta = NULL;
+		}
+		free(item_xml);
+		if (*uri) {
+			insert_locked(q, q->length, uri, meta);
+		} else {
+			free(uri);
+			free(meta);
+		}
+	}
+	xmldoc_free(doc);
+}
+
+int PlayQueue_load(struct play_queue *q, const char *base_uri,
+		   const char *content) {
+	char *copy = strdup(content);
+	pthread_mutex_lock(&q->mutex);
+	clear_locked(q);
+	if (strstr(copy, "<DIDL-Lite") != NULL) {
+		load_didl_locked(q, copy);
+	} else if (strncasecmp(copy + strspn(copy, " \t\r\n"),
+			       "[playlist]", 10) == 0) {
+		load_pls_locked(q, base_uri, copy);
+	} else {
+		load_m3u_locked(q, base_uri, copy);
+	}
+	const int result = q->length;
+	pthread_mutex_unlock(&q->mutex);
+	free(copy);
+	notify_listener(q);
+	Log_info("queue", "Loaded %d entries from %s", result, base_uri);
+	return result;
+}
+
+// Checks the path of the uri, ignoring query and fragment.
+static int has_extension(const char *uri, const char *ext) {
+	const size_t path_len = strcspn(uri, "?#");
+	const size_t ext_len = strlen(ext);
+	return path_len > ext_len
+		&& strncasecmp(uri + path_len - ext_len, ext, ext_len) == 0;
+}
+
+int PlayQueue_is_playlist(const char *uri, const char *meta) {
+	if (has_extension(uri, ".m3u") || has_extension(uri, ".pls"))
+		return 1;
+	if (meta == NULL)
+		return 0;
+	return strstr(meta, "audio/x-mpegurl") != NULL
+		|| strstr(meta, "audio/mpegurl") != NULL
+		|| strstr(meta, "audio/x-scpls") != NULL
+		|| strstr(meta, "object.container") != NULL;
+}
@@ -0,0 +1,94 @@
+/* play_queue.h - Tracks to play, held by the renderer.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#ifndef _PLAY_QUEUE_H
+#define _PLAY_QUEUE_H
+
+// The list of tracks the renderer plays by itself, so that a controller
+// doesn't have to hand over every next track. Can be loaded from a playlist
+// (m3u, pls or DIDL-Lite). Each zone has its own queue; all functions are
+// thread-safe.
+//
+// Each entry has an id that stays the same while it is in the queue, and
+// is never reused. Ids are > 0.
+
+// Entry returned by PlayQueue_get(), to be freed with
+// PlayQueue_entry_clear().
+struct play_queue_entry {
+	unsigned int id;
+	char *uri;
+	char *meta;  // DIDL-Lite; can be empty.
+};
+
+void PlayQueue_entry_clear(struct play_queue_entry *entry);
+
+struct play_queue;
+struct play_queue *PlayQueue_new(void);
+
+// Remove all entries.
+void PlayQueue_clear(struct play_queue *q);
+
+// Replace the queue with the playlist "content", fetched from "base_uri"
+// (relative entries are resolved against it). Returns the number of
+// entries found.
+int PlayQueue_load(struct play_queue *q, const char *base_uri,
+		   const char *content);
+
+// Insert after the entry with "after_id" (0: at the start). Returns the new
+// id, or 0 if there is no such entry.
+unsigned int PlayQueue_insert(struct play_queue *q, unsigned int after_id,
+			      const char *uri, const char *meta);
+
+// Remove the entry with the given id. Returns 0 if found.
+int PlayQueue_delete(struct play_queue *q, unsigned int id);
+
+int PlayQueue_length(struct play_queue *q);
+
+// Copy entry at "index" into "entry". Returns 0 if there is one.
+int PlayQueue_get(struct play_queue *q, int index,
+		  struct play_queue_entry *entry);
+
+// Sets "*ids" to a newly allocated array (to be free()'d) with the ids of
+// all entries in order. Returns the number of entries.
+int PlayQueue_ids(struct play_queue *q, unsigned int **ids);
+
+// Index of the entry with the id, or -1.
+int PlayQueue_index_of(struct play_queue *q, unsigned int id);
+
+// The entry being played; -1 if none. Kept pointing to the same entry
+// while entries are inserted or deleted around it.
+int PlayQueue_current(struct play_queue *q);
+void PlayQueue_set_current(struct play_queue *q, int index);
+
+// Register a function to be called after entries were added or removed,
+// or the current entry changed. It is called without holding the queue
+// lock, but possibly with the lock of the service changing the queue.
+typedef void (*play_queue_listener_t)(void *userdata);
+void PlayQueue_register_listener(struct play_queue *q,
+				 play_queue_listener_t listener,
+				 void *userdata);
+
+// Returns if "uri" points to a playlist to be loaded with PlayQueue_load(),
+// as far as we can tell from the URI or the DIDL-Lite meta data.
+int PlayQueue_is_playlist(const char *uri, const char *meta);
+
+#endif  // _PLAY_QUEUE_H
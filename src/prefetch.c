@@ -0,0 +1,322 @@
+/* prefetch.c - Download the next track ahead of time.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "prefetch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <upnp.h>
+#include <upnptools.h>
+
+#include "logging.h"
+#include "metrics.h"
+
+#define FILE_PREFIX "gmediarender-next-"
+
+static const int kHttpTimeoutSec = 10;
+static const int kMaxResumes = 5;
+
+struct prefetch_job {
+	char *uri;
+	char *path;
+	// Guarded by mutex_
+	int dropped;   // No longer wanted; the thread cleans up.
+	int finished;  // Thread is done.
+	int complete;  // File has all of the track.
+};
+
+// The downloads of one player.
+struct prefetch {
+	// Guarded by mutex_
+	struct prefetch_job *next;
+	struct prefetch_job *previous;
+};
+
+static pthread_mutex_t mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static char *dir_ = NULL;
+static int64_t max_bytes_ = 0;
+static unsigned int job_count_ = 0;
+
+static void job_free(struct prefetch_job *job) {
+	unlink(job->path);
+	free(job->uri);
+	g_free(job->path);
+	free(job);
+}
+
+static int is_dropped(struct prefetch_job *job) {
+	pthread_mutex_lock(&mutex_);
+	const int dropped = job->dropped;
+	pthread_mutex_unlock(&mutex_);
+	return dropped;
+}
+
+// Free the job now, or have its thread do it once done. Needs mutex_.
+static void drop_locked(struct prefetch_job *job) {
+	if (job == NULL)
+		return;
+	if (job->finished)
+		job_free(job);  // Only unlink()s and frees; fine under the lock.
+	else
+		job->dropped = 1;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		const ssize_t w = write(fd, buf, len);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 0;
+}
+
+// Fetch the track from byte "*have" on and append it to fd. Returns 1 if
+// the file is complete, 0 if worth resuming, -1 to give up.
+static int fetch(struct prefetch_job *job, int fd, int64_t *have) {
+	void *handle = NULL;
+	char *content_type = NULL;
+	int content_length = 0;
+	int status = 0;
+	int rc;
+	if (*have == 0) {
+		rc = UpnpOpenHttpGet(job->uri, &handle, &content_type,
+				     &content_length, &status,
+				     kHttpTimeoutSec);
+	} else {
+		rc = UpnpOpenHttpGetEx(job->uri, &handle, &content_type,
+				       &content_length, &status,
+				       (int) *have, INT_MAX, kHttpTimeoutSec);
+	}
+	if (rc != UPNP_E_SUCCESS) {
+		Log_info("prefetch", "%s: %s", job->uri,
+			 UpnpGetErrorMessage(rc));
+		return 0;
+	}
+
+	int result = 0;
+	if (status == 200 && *have > 0) {
+		// Server doesn't do ranges; start over.
+		if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+			result = -1;
+			goto done;
+		}
+		*have = 0;
+	} else if (status != 200 && status != 206) {
+		Log_info("prefetch", "%s: HTTP status %d", job->uri, status);
+		result = -1;
+		goto done;
+	}
+	// Negative for chunked or until-close responses.
+	const int64_t expected = (content_length >= 0
+				  ? *have + content_length : -1);
+	if (expected > max_bytes_) {
+		Log_info("prefetch", "%s: %" G_GINT64_FORMAT " bytes is "
+			 "too big", job->uri, expected);
+		result = -1;
+		goto done;
+	}
+
+	char buf[16384];
+	for (;;) {
+		if (is_dropped(job)) {
+			result = -1;
+			break;
+		}
+#if UPNP_VERSION >= 10800
+		size_t size = sizeof(buf);
+#else
+		unsigned int size = sizeof(buf);
+#endif
+		rc = UpnpReadHttpGet(handle, buf, &size, kHttpTimeoutSec);
+		if (rc != UPNP_E_SUCCESS)
+			break;  // Resume from here.
+		if (size == 0) {
+			result = (expected < 0 || *have == expected) ? 1 : 0;
+			break;
+		}
+		if (*have + (int64_t) size > max_bytes_) {
+			Log_info("prefetch", "%s: too big", job->uri);
+			result = -1;
+			break;
+		}
+		if (write_all(fd, buf, size) < 0) {
+			Log_error("prefetch", "%s: %s", job->path,
+				  strerror(errno));
+			result = -1;
+			break;
+		}
+		*have += size;
+	}
+
+done:
+	UpnpCloseHttpGet(handle);
+	return result;
+}
+
+static void *download_thread(void *userdata) {
+	struct prefetch_job *job = (struct prefetch_job*) userdata;
+	const int64_t start_us = Metrics_now_us();
+	int result = -1;
+	int64_t have = 0;
+	const int fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			    0600);
+	if (fd < 0) {
+		Log_error("prefetch", "%s: %s", job->path, strerror(errno));
+	} else {
+		result = 0;
+		for (int i = 0; result == 0 && i <= kMaxResumes; ++i) {
+			if (i > 0) {
+				sleep(1);
+				Log_info("prefetch", "%s: resuming at byte "
+					 "%" G_GINT64_FORMAT, job->uri, have);
+			}
+			result = fetch(job, fd, &have);
+		}
+		close(fd);
+	}
+
+	pthread_mutex_lock(&mutex_);
+	job->finished = 1;
+	job->complete = (result == 1);
+	const int dropped = job->dropped;
+	pthread_mutex_unlock(&mutex_);
+
+	if (dropped) {
+		job_free(job);
+	} else if (result == 1) {
+		Log_info("prefetch", "%s: got %" G_GINT64_FORMAT " bytes in "
+			 "%" G_GINT64_FORMAT "ms", job->uri, have,
+			 (Metrics_now_us() - start_us) / 1000);
+	} else {
+		Log_info("prefetch", "%s: giving up; will play from network",
+			 job->uri);
+		unlink(job->path);
+	}
+	return NULL;
+}
+
+// Remove files of earlier runs, but not of other live processes sharing
+// the directory.
+static void remove_leftovers(const char *dir) {
+	GDir *d = g_dir_open(dir, 0, NULL);
+	if (d == NULL)
+		return;
+	const char *name;
+	while ((name = g_dir_read_name(d)) != NULL) {
+		int pid;
+		if (sscanf(name, FILE_PREFIX "%d-", &pid) != 1)
+			continue;
+		if (pid == getpid() || kill(pid, 0) == 0 || errno != ESRCH)
+			continue;
+		char *path = g_build_filename(dir, name, NULL);
+		unlink(path);
+		g_free(path);
+	}
+	g_dir_close(d);
+}
+
+int Prefetch_init(const char *dir, int64_t max_bytes) {
+	if (!g_path_is_absolute(dir)) {
+		Log_error("prefetch", "Need an absolute path, got '%s'", dir);
+		return -1;
+	}
+	if (g_mkdir_with_parents(dir, 0700) < 0) {
+		Log_error("prefetch", "Can't create '%s': %s", dir,
+			  strerror(errno));
+		return -1;
+	}
+	remove_leftovers(dir);
+	dir_ = strdup(dir);
+	max_bytes_ = max_bytes;
+	Log_info("prefetch", "Downloading next tracks to %s", dir);
+	return 0;
+}
+
+struct prefetch *Prefetch_new(void) {
+	return (struct prefetch*) calloc(1, sizeof(struct prefetch));
+}
+
+void Prefetch_start(struct prefetch *p, const char *uri) {
+	if (dir_ == NULL)
+		return;
+	struct prefetch_job *job = NULL;
+	if (uri != NULL && strncmp(uri, "http://", 7) == 0) {
+		job = (struct prefetch_job*) calloc(1, sizeof(*job));
+		job->uri = strdup(uri);
+	}
+
+	pthread_mutex_lock(&mutex_);
+	if (job != NULL) {
+		job->path = g_strdup_printf("%s/" FILE_PREFIX "%d-%u", dir_,
+					    (int) getpid(), ++job_count_);
+	}
+	drop_locked(p->previous);
+	p->previous = p->next;
+	p->next = job;
+	pthread_mutex_unlock(&mutex_);
+
+	if (job == NULL)
+		return;
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, download_thread, job) != 0) {
+		Log_error("prefetch", "Can't start download thread");
+		pthread_mutex_lock(&mutex_);
+		job->finished = 1;
+		if (p->next == job)
+			p->next = NULL;
+		drop_locked(job);
+		pthread_mutex_unlock(&mutex_);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+char *Prefetch_get_local_uri(struct prefetch *p, const char *uri) {
+	char *result = NULL;
+	pthread_mutex_lock(&mutex_);
+	const struct prefetch_job *next = p->next;
+	if (next != NULL && next->complete && strcmp(next->uri, uri) == 0)
+		result = g_filename_to_uri(next->path, NULL, NULL);
+	pthread_mutex_unlock(&mutex_);
+	return result;
+}
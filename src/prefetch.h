@@ -0,0 +1,50 @@
+/* prefetch.h - Download the next track ahead of time.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+#ifndef _PREFETCH_H
+#define _PREFETCH_H
+
+#include <stdint.h>
+
+// Downloads the next track into a local directory (best on a tmpfs) while
+// the current one plays, so that the transition does not depend on the
+// server or network. Interrupted downloads resume with a Range request.
+// Only plain http:// URIs are fetched.
+
+// Use "dir" for downloads of at most "max_bytes". Removes what earlier runs
+// left behind. Returns 0 on success.
+int Prefetch_init(const char *dir, int64_t max_bytes);
+
+// The downloads of one player; each zone has its own.
+struct prefetch;
+struct prefetch *Prefetch_new(void);
+
+// Start downloading "uri" (may be NULL) in the background. The download
+// before the previous one is dropped; the previous one is kept, as it might
+// be playing right now. No-op if not initialized.
+void Prefetch_start(struct prefetch *p, const char *uri);
+
+// If "uri" was downloaded completely, returns a newly allocated file:// URI
+// of the copy (to be g_free()d), otherwise NULL.
+char *Prefetch_get_local_uri(struct prefetch *p, const char *uri);
+
+#endif  // _PREFETCH_H
@@ -0,0 +1,193 @@
+/* trace.c - Lightweight tracing of spans, exported as Chrome trace JSON.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_EVENTS_PER_THREAD 4096   // Power of two.
+#define TRACE_NAME_SIZE 48
+
+struct trace_event {
+	int64_t start_us;
+	int64_t duration_us;
+	const char *category;
+	char name[TRACE_NAME_SIZE];
+};
+
+// Each thread only writes to its own buffer, so recording needs no locks.
+// Buffers are never freed, as the trace is written after threads are gone.
+struct trace_buffer {
+	int thread_id;
+	unsigned long pos;  // Number of events ever written.
+	struct trace_buffer *next;
+	struct trace_event events[TRACE_EVENTS_PER_THREAD];
+};
+
+static int enabled_ = 0;
+static FILE *trace_file_ = NULL;
+static pthread_mutex_t buffers_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer *buffers_ = NULL;
+static int thread_count_ = 0;
+static __thread struct trace_buffer *thread_buffer_ = NULL;
+
+static int64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct trace_buffer *get_thread_buffer(void) {
+	if (thread_buffer_ != NULL)
+		return thread_buffer_;
+	struct trace_buffer *buffer = calloc(1, sizeof(struct trace_buffer));
+	if (buffer == NULL)
+		return NULL;
+	pthread_mutex_lock(&buffers_mutex_);
+	buffer->thread_id = ++thread_count_;
+	buffer->next = buffers_;
+	buffers_ = buffer;
+	pthread_mutex_unlock(&buffers_mutex_);
+	thread_buffer_ = buffer;
+	return buffer;
+}
+
+int Trace_init(const char *filename) {
+	trace_file_ = fopen(filename, "w");
+	if (trace_file_ == NULL) {
+		perror("Cannot open trace file");
+		return 0;
+	}
+	enabled_ = 1;
+	atexit(Trace_write);
+	return 1;
+}
+
+int64_t Trace_begin(void) {
+	return enabled_ ? now_us() : 0;
+}
+
+void Trace_end(const char *category, const char *name, int64_t start) {
+	if (start == 0)
+		return;
+	const int64_t end = now_us();
+	struct trace_buffer *buffer = get_thread_buffer();
+	if (buffer == NULL)
+		return;
+	struct trace_event *event
+		= &buffer->events[buffer->pos & (TRACE_EVENTS_PER_THREAD - 1)];
+	event->start_us = start;
+	event->duration_us = end - start;
+	event->category = category;
+	strncpy(event->name, name ? name : "", TRACE_NAME_SIZE - 1);
+	event->name[TRACE_NAME_SIZE - 1] = '\0';
+	__atomic_store_n(&buffer->pos, buffer->pos + 1, __ATOMIC_RELEASE);
+}
+
+static void write_json_string(FILE *out, const char *str) {
+	fputc('"', out);
+	for (/**/; *str; ++str) {
+		if (*str == '"' || *str == '\\') {
+			fprintf(out, "\\%c", *str);
+		} else if ((unsigned char)*str < 0x20) {
+			fprintf(out, "\\u%04x", (unsigned char)*str);
+		} else {
+			fputc(*str, out);
+		}
+	}
+	fputc('"', out);
+}
+
+// Copies the recent events of a buffer into "out", which needs space for
+// TRACE_EVENTS_PER_THREAD events. Returns number of events copied.
+static int copy_events(struct trace_buffer *buffer, struct trace_event *out) {
+	const unsigned long end
+		= __atomic_load_n(&buffer->pos, __ATOMIC_ACQUIRE);
+	unsigned long begin = (end > TRACE_EVENTS_PER_THREAD
+			       ? end - TRACE_EVENTS_PER_THREAD : 0);
+	for (unsigned long p = begin; p < end; ++p) {
+		out[p - begin] = buffer->events[p & (TRACE_EVENTS_PER_THREAD-1)];
+	}
+	// The thread might have continued writing while we copied; events
+	// it overwrote in the meantime are not consistent anymore.
+	const unsigned long now = __atomic_load_n(&buffer->pos,
+						  __ATOMIC_ACQUIRE);
+	unsigned long valid_begin = begin;
+	if (now >= TRACE_EVENTS_PER_THREAD
+	    && now - TRACE_EVENTS_PER_THREAD + 1 > valid_begin) {
+		valid_begin = now - TRACE_EVENTS_PER_THREAD + 1;
+	}
+	if (valid_begin >= end)
+		return 0;
+	const int skip = valid_begin - begin;
+	const int count = end - valid_begin;
+	memmove(out, out + skip, count * sizeof(struct trace_event));
+	return count;
+}
+
+void Trace_write(void) {
+	if (trace_file_ == NULL)
+		return;
+	struct trace_event *events = malloc(TRACE_EVENTS_PER_THREAD
+					    * sizeof(struct trace_event));
+	if (events == NULL)
+		return;
+	const int pid = getpid();
+	int first = 1;
+	FILE *out = trace_file_;
+	rewind(out);
+	fprintf(out, "{\"traceEvents\":[\n");
+	pthread_mutex_lock(&buffers_mutex_);
+	for (struct trace_buffer *b = buffers_; b != NULL; b = b->next) {
+		const int count = copy_events(b, events);
+		for (int i = 0; i < count; ++i) {
+			const struct trace_event *e = &events[i];
+			fprintf(out, "%s{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+				"\"ts\":%lld,\"dur\":%lld,\"cat\":",
+				first ? "" : ",\n", pid, b->thread_id,
+				(long long)e->start_us,
+				(long long)e->duration_us);
+			write_json_string(out, e->category);
+			fprintf(out, ",\"name\":");
+			write_json_string(out, e->name);
+			fputc('}', out);
+			first = 0;
+		}
+	}
+	pthread_mutex_unlock(&buffers_mutex_);
+	fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fflush(out);
+	if (ftruncate(fileno(out), ftell(out)) != 0) {
+		// Only matters if the file was larger before; ignore.
+	}
+	free(events);
+}
@@ -0,0 +1,46 @@
+/* trace.h - Lightweight tracing of spans, exported as Chrome trace JSON.
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+// Enable tracing. Spans are recorded in per-thread ring buffers (keeping
+// the most recent ones) and written to "filename" at exit in the Chrome
+// trace event format, which can be loaded in chrome://tracing or Perfetto.
+// Returns 0 if the file can't be opened.
+int Trace_init(const char *filename);
+
+// Returns the start time of a span, or 0 if tracing is disabled.
+int64_t Trace_begin(void);
+
+// Record a span that started at "start", as returned by Trace_begin(); does
+// nothing if that was 0. The "category" must be a string constant, the
+// "name" is copied (and possibly truncated).
+void Trace_end(const char *category, const char *name, int64_t start);
+
+// Write all spans recorded so far to the trace file. Called at exit.
+void Trace_write(void);
+
+#endif /* _TRACE_H */
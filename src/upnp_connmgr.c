@@ -56,6 +56,8 @@
 #define CONNMGR_SCPD_URL "/upnp/renderconnmgrSCPD.xml"
 #define CONNMGR_CONTROL_URL "/upnp/control/renderconnmgr1"
 #define CONNMGR_EVENT_URL "/upnp/event/renderconnmgr1"
+#define CONNMGR_INSTANCE_CONTROL_URL "/upnp/control/renderconnmgr%d"
+#define CONNMGR_INSTANCE_EVENT_URL "/upnp/event/renderconnmgr%d"
 
 typedef enum {
 	CONNMGR_VAR_AAT_CONN_MGR,
@@ -143,39 +145,35 @@ static const char *direction_values[] = {
 
 static pthread_mutex_t connmgr_mutex;
 
-static GSList* supported_types_list;
+// While output modules register their types, we collect them in a hash set;
+// connmgr_init() applies the filters and freezes the result into a sorted
+// array that is used for the protocol info and for lookups.
+static GHashTable *registered_types_ = NULL;
+static char **supported_types_ = NULL;   // sorted; NULL terminated.
+static int supported_types_count_ = 0;
+// Generic types such as "audio/*" are only announced, never matched
+// against: they'd let anything of the category through.
+static GSList *wildcard_types_ = NULL;
 
 static bool add_mime_type(const char* mime_type)
 {
-	// Check for duplicate MIME type
-	if (g_slist_find_custom(supported_types_list, mime_type, (GCompareFunc) strcmp) != NULL)
+	if (registered_types_ == NULL) {
+		registered_types_ = g_hash_table_new_full(g_str_hash,
+							  g_str_equal,
+							  free, NULL);
+	}
+	if (g_hash_table_lookup(registered_types_, mime_type) != NULL)
 		return false;
-
-	// Sorted insert into list
-	supported_types_list = g_slist_insert_sorted(supported_types_list, strdup(mime_type), (GCompareFunc) strcmp);
-
+	char *type = strdup(mime_type);
+	g_hash_table_insert(registered_types_, type, type);
 	return true;
 }
 
 static bool remove_mime_type(const char* mime_type)
 {
-	// Check that the list exists
-	if (supported_types_list == NULL)
+	if (registered_types_ == NULL)
 		return false;
-
-	// Search for the MIME type
-	GSList* entry = g_slist_find_custom(supported_types_list, mime_type, (GCompareFunc) strcmp);
-	if (entry != NULL)
-	{
-		// Free the string pointer
-		free(entry->data);
-
-		// Free the list entry
-		supported_types_list = g_slist_delete_link(supported_types_list, entry);
-		return true;
-	}
-
-	return false;
+	return g_hash_table_remove(registered_types_, mime_type);
 }
 
 static gint g_compare_mime_root(gconstpointer a, gconstpointer b)
@@ -287,25 +285,102 @@ static mime_type_filters_t connmgr_parse_mime_filter_string(const char* filter_s
 	return mime_filter;
 }
 
+static gboolean g_not_in_allowed_roots(gpointer key, gpointer value,
+				       gpointer user_data)
+{
+	const GSList *allowed_roots = (const GSList*) user_data;
+	return g_slist_find_custom((GSList*) allowed_roots, key,
+				   g_compare_mime_root) == NULL;
+}
+
 static void connmgr_filter_mime_type_root(const mime_type_filters_t* mime_filter)
 {
 	if (mime_filter == NULL || mime_filter->allowed_roots == NULL)
 		return;
+	if (registered_types_ == NULL)
+		return;
 
-	// Iterate through the supported types and filter by root
-	GSList* entry = supported_types_list;
-	while (entry != NULL)
-	{
-		GSList* next = entry->next;
+	g_hash_table_foreach_remove(registered_types_, g_not_in_allowed_roots,
+				    mime_filter->allowed_roots);
+}
 
-		if (g_slist_find_custom(mime_filter->allowed_roots, entry->data, g_compare_mime_root) == NULL)
-		{
-			// Free matching MIME type and remove the entry
-			free(entry->data);
-			supported_types_list = g_slist_delete_link(supported_types_list, entry);
+static bool is_wildcard_type(const char *mime_type)
+{
+	const char *slash = strchr(mime_type, '/');
+	return slash != NULL && strcmp(slash, "/*") == 0;
+}
+
+static int compare_mime_ptr(const void *a, const void *b)
+{
+	return strcmp(*(const char *const*) a, *(const char *const*) b);
+}
+
+// Move the registered types into the sorted supported_types_ array, and
+// the generic ones into wildcard_types_.
+static void freeze_supported_types(void)
+{
+	GHashTableIter it;
+	gpointer key;
+
+	const int count = registered_types_
+		? g_hash_table_size(registered_types_) : 0;
+	supported_types_ = (char**) malloc((count + 1) * sizeof(char*));
+	supported_types_count_ = 0;
+	if (registered_types_ != NULL) {
+		g_hash_table_iter_init(&it, registered_types_);
+		while (g_hash_table_iter_next(&it, &key, NULL)) {
+			if (is_wildcard_type(key)) {
+				wildcard_types_ = g_slist_insert_sorted(
+					wildcard_types_, key,
+					(GCompareFunc) strcmp);
+			} else {
+				supported_types_[supported_types_count_++] = key;
+			}
+			g_hash_table_iter_steal(&it);  // ownership moves.
 		}
-		entry = next;
+		g_hash_table_destroy(registered_types_);
+		registered_types_ = NULL;
+	}
+	supported_types_[supported_types_count_] = NULL;
+	qsort(supported_types_, supported_types_count_, sizeof(char*),
+	      compare_mime_ptr);
+}
+
+static bool is_supported_exact(const char *mime_type)
+{
+	if (supported_types_ == NULL)
+		return false;
+	return bsearch(&mime_type, supported_types_, supported_types_count_,
+		       sizeof(char*), compare_mime_ptr) != NULL;
+}
+
+int connmgr_is_mime_type_supported(const char *mime_type)
+{
+	if (mime_type == NULL || *mime_type == '\0')
+		return 0;
+
+	// Compare in lowercase without parameters, e.g.
+	// "Audio/MPEG; charset=foo" -> "audio/mpeg".
+	char type[128];
+	size_t len = 0;
+	while (mime_type[len] && mime_type[len] != ';'
+	       && len < sizeof(type) - 1) {
+		type[len] = g_ascii_tolower(mime_type[len]);
+		len++;
 	}
+	while (len > 0 && type[len-1] == ' ')
+		len--;
+	type[len] = '\0';
+
+	// Some types are registered with parameters, so check the full
+	// string first.
+	return is_supported_exact(mime_type) || is_supported_exact(type);
+}
+
+const char *connmgr_get_sink_protocol_info(void)
+{
+	return VariableContainer_get(upnp_connmgr_get_service()->variable_container,
+				     CONNMGR_VAR_SINK_PROTO_INFO, NULL);
 }
 
 int connmgr_init(const char* mime_filter_string) {
@@ -324,11 +399,21 @@ int connmgr_init(const char* mime_filter_string) {
 	// Manually remove specific MIME types
 	g_slist_foreach(mime_filter.removed_types, g_remove_mime_type, NULL);
 
+	freeze_supported_types();
+
+	// Build the SinkProtocolInfo once; it does not change after this.
 	GString* protoInfo = g_string_new(NULL);
-	for (GSList* entry = supported_types_list; entry != NULL; entry = g_slist_next(entry))
-	{
-		Log_info("connmgr", "Registering support for '%s'", (const char*) entry->data);
-		g_string_append_printf(protoInfo, "http-get:*:%s:*,", (const char*) entry->data);
+	for (GSList *w = wildcard_types_; w != NULL; w = w->next) {
+		Log_info("connmgr", "Registering support for '%s'",
+			 (const char*) w->data);
+		g_string_append_printf(protoInfo, "http-get:*:%s:*,",
+				       (const char*) w->data);
+	}
+	for (int i = 0; i < supported_types_count_; ++i) {
+		Log_info("connmgr", "Registering support for '%s'",
+			 supported_types_[i]);
+		g_string_append_printf(protoInfo, "http-get:*:%s:*,",
+				       supported_types_[i]);
 	}
 
 	if (protoInfo->len > 0) {
@@ -342,7 +427,6 @@ int connmgr_init(const char* mime_filter_string) {
 	g_string_free(protoInfo, TRUE);
 
 	// Free all lists that were generated
-	g_slist_free_full(supported_types_list, free);
 	g_slist_free_full(mime_filter.allowed_roots, free);
 	g_slist_free_full(mime_filter.added_types, free);
 	g_slist_free_full(mime_filter.removed_types, free);
@@ -453,3 +537,15 @@ struct service *upnp_connmgr_get_service(void) {
 	}
 	return &connmgr_service_;
 }
+
+struct service *upnp_connmgr_new_service(int instance) {
+	struct service *srv = malloc(sizeof(*srv));
+	*srv = *upnp_connmgr_get_service();
+	if (instance > 1) {
+		srv->control_url = g_strdup_printf(CONNMGR_INSTANCE_CONTROL_URL,
+						   instance);
+		srv->event_url = g_strdup_printf(CONNMGR_INSTANCE_EVENT_URL,
+						 instance);
+	}
+	return srv;
+}
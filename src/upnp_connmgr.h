@@ -34,8 +34,21 @@ typedef struct mime_type_filters_t
 } mime_type_filters_t;
 
 struct service *upnp_connmgr_get_service(void);
+// The ConnectionManager of renderer number "instance" (1, 2, ..). They
+// only differ in their URLs; all share the variables.
+struct service *upnp_connmgr_new_service(int instance);
 int connmgr_init(const char* mime_filter);
 
 void register_mime_type(const char *mime_type);
 
+// Returns 1 if the given mime type is in the set of supported types.
+// Generic types such as "audio/*" are announced in the SinkProtocolInfo but
+// don't match here. Parameters such as ";charset=..." are ignored. Only
+// valid after connmgr_init().
+int connmgr_is_mime_type_supported(const char *mime_type);
+
+// Returns the SinkProtocolInfo, e.g. "http-get:*:audio/mpeg:*,...". Only
+// valid after connmgr_init(); it doesn't change after that.
+const char *connmgr_get_sink_protocol_info(void);
+
 #endif /* _UPNP_CONNMGR_H */
@@ -37,15 +37,19 @@
 #include <math.h>
 #include <string.h>
 
+#include <glib.h>
 #include <upnp.h>
 #include <pthread.h>
 
+#include "lockprof.h"
 #include "logging.h"
+#include "metrics.h"
 #include "webserver.h"
 #include "upnp_service.h"
 #include "upnp_device.h"
 #include "output.h"
 #include "xmlescape.h"
+#include "trace.h"
 #include "variable-container.h"
 
 #define CONTROL_TYPE "urn:schemas-upnp-org:service:RenderingControl:1"
@@ -56,8 +60,9 @@
 #define CONTROL_SERVICE_ID "urn:upnp-org:serviceId:RenderingControl"
 //#define CONTROL_SERVICE_ID CONTROL_TYPE
 #define CONTROL_SCPD_URL "/upnp/rendercontrolSCPD.xml"
-#define CONTROL_CONTROL_URL "/upnp/control/rendercontrol1"
-#define CONTROL_EVENT_URL "/upnp/event/rendercontrol1"
+// With the number of the renderer; zones share the SCPD only.
+#define CONTROL_CONTROL_URL "/upnp/control/rendercontrol%d"
+#define CONTROL_EVENT_URL "/upnp/event/rendercontrol%d"
 
 // Namespace, see UPnP-av-RenderingControl-v3-Service-20101231.pdf page 19
 #define CONTROL_EVENT_XML_NS "urn:schemas-upnp-org:metadata-1-0/RCS/"
@@ -176,28 +181,44 @@ typedef enum {
 	CONTROL_VAR_COUNT
 } control_variable_t;
 
-static variable_container_t *state_variables_ = NULL;
+// One RenderingControl per renderer.
+struct upnp_control {
+	// First, so that actions get back to us from event->service.
+	struct service service;
+	pthread_mutex_t mutex;  // Protects the state variables.
+	variable_container_t *state_variables;
+	struct output *output;
+};
 
-static pthread_mutex_t control_mutex;
+static struct upnp_control *control_of(struct action_event *event)
+{
+	return (struct upnp_control *) event->service;
+}
 
-static void service_lock(void)
+// Locks the service; "call_site" shows up in the lock profile.
+static void service_lock_at(struct upnp_control *c, const char *call_site)
 {
-	pthread_mutex_lock(&control_mutex);
+	const int64_t trace_start = Trace_begin();
+	const int64_t start = Metrics_now_us();
+	LockProfile_lock(c->service.lock_profile, &c->mutex, call_site);
+	Metrics_lock_wait(METRIC_LOCK_CONTROL, Metrics_now_us() - start);
+	Trace_end("lock", "control lock wait", trace_start);
 	struct upnp_last_change_collector*
-		collector = upnp_control_get_service()->last_change;
+		collector = c->service.last_change;
 	if (collector) {
 		UPnPLastChangeCollector_start(collector);
 	}
 }
+#define service_lock(c) service_lock_at(c, __func__)
 
-static void service_unlock(void)
+static void service_unlock(struct upnp_control *c)
 {
 	struct upnp_last_change_collector*
-		collector = upnp_control_get_service()->last_change;
+		collector = c->service.last_change;
 	if (collector) {
 		UPnPLastChangeCollector_finish(collector);
 	}
-	pthread_mutex_unlock(&control_mutex);
+	LockProfile_unlock(c->service.lock_profile, &c->mutex);
 }
 
 static struct argument arguments_list_presets[] = {
@@ -429,13 +450,15 @@ static struct argument *argument_list[] = {
 
 
 // Replace given variable without sending an state-change event.
-static void replace_var(control_variable_t varnum, const char *new_value) {
-	VariableContainer_change(state_variables_, varnum, new_value);
+static void replace_var(struct upnp_control *c, control_variable_t varnum,
+			const char *new_value) {
+	VariableContainer_change(c->state_variables, varnum, new_value);
 }
 
-static void change_volume(const char *volume, const char *db_volume) {
-	replace_var(CONTROL_VAR_VOLUME, volume);
-	replace_var(CONTROL_VAR_VOLUME_DB, db_volume);
+static void change_volume(struct upnp_control *c, const char *volume,
+			  const char *db_volume) {
+	replace_var(c, CONTROL_VAR_VOLUME, volume);
+	replace_var(c, CONTROL_VAR_VOLUME_DB, db_volume);
 }
 
 static int cmd_obtain_variable(struct action_event *event,
@@ -537,18 +560,19 @@ static int get_mute(struct action_event *event)
 	return cmd_obtain_variable(event, CONTROL_VAR_MUTE, "CurrentMute");
 }
 
-static void set_mute_toggle(int do_mute) {
-	replace_var(CONTROL_VAR_MUTE, do_mute ? "1" : "0");
-	output_set_mute(do_mute);
+static void set_mute_toggle(struct upnp_control *c, int do_mute) {
+	replace_var(c, CONTROL_VAR_MUTE, do_mute ? "1" : "0");
+	output_set_mute(c->output, do_mute);
 }
 
 static int set_mute(struct action_event *event) {
+	struct upnp_control *c = control_of(event);
 	const char *value = upnp_get_string(event, "DesiredMute");
-	service_lock();
+	service_lock(c);
 	const int do_mute = atoi(value);
-	set_mute_toggle(do_mute);
-	replace_var(CONTROL_VAR_MUTE, do_mute ? "1" : "0");
-	service_unlock();
+	set_mute_toggle(c, do_mute);
+	replace_var(c, CONTROL_VAR_MUTE, do_mute ? "1" : "0");
+	service_unlock(c);
 	return 0;
 }
 
@@ -588,7 +612,7 @@ static int volume_decibel_to_level(float decibel) {
 
 // Change volume variables from the given decibel. Quantize value according to
 // our ranges.
-static float change_volume_decibel(float raw_decibel) {
+static float change_volume_decibel(struct upnp_control *c, float raw_decibel) {
 	int volume_level = volume_decibel_to_level(raw_decibel);
 	// Since we quantize it to the level, lets calculate the
 	// actual level.
@@ -602,25 +626,27 @@ static float change_volume_decibel(float raw_decibel) {
 	Log_info("control", "Setting volume-db to %.2fdb == #%d",
 		decibel, volume_level);
 
-	change_volume(volume, db_volume);
+	change_volume(c, volume, db_volume);
 	return decibel;
 }
 
 static int set_volume_db(struct action_event *event) {
+	struct upnp_control *c = control_of(event);
 	const char *str_decibel_in = upnp_get_string(event, "DesiredVolume");
-	service_lock();
+	service_lock(c);
 	float raw_decibel_in = atof(str_decibel_in);
-	float decibel = change_volume_decibel(raw_decibel_in);
+	float decibel = change_volume_decibel(c, raw_decibel_in);
 
-	output_set_volume(exp(decibel / 20 * log(10)));
-	service_unlock();
+	output_set_volume(c->output, exp(decibel / 20 * log(10)));
+	service_unlock(c);
 
 	return 0;
 }
 
 static int set_volume(struct action_event *event) {
+	struct upnp_control *c = control_of(event);
 	const char *volume = upnp_get_string(event, "DesiredVolume");
-	service_lock();
+	service_lock(c);
 	int volume_level = atoi(volume);  // range 0..100
 	if (volume_level < volume_range.min) volume_level = volume_range.min;
 	if (volume_level > volume_range.max) volume_level = volume_range.max;
@@ -631,10 +657,10 @@ static int set_volume(struct action_event *event) {
 
 	const double fraction = exp(decibel / 20 * log(10));
 
-	change_volume(volume, db_volume);
-	output_set_volume(fraction);
-	set_mute_toggle(volume_level == 0);
-	service_unlock();
+	change_volume(c, volume, db_volume);
+	output_set_volume(c->output, fraction);
+	set_mute_toggle(c, volume_level == 0);
+	service_unlock(c);
 
 	return 0;
 }
@@ -703,22 +729,7 @@ static struct action control_actions[] = {
 	[CONTROL_CMD_COUNT] =			{NULL, NULL}
 };
 
-struct service *upnp_control_get_service(void) {
-	static struct service control_service_ = {
-		.service_mutex =       &control_mutex,
-		.service_id =	       CONTROL_SERVICE_ID,
-		.service_type =	       CONTROL_TYPE,
-		.scpd_url =            CONTROL_SCPD_URL,
-		.control_url =         CONTROL_CONTROL_URL,
-		.event_url =           CONTROL_EVENT_URL,
-		.event_xml_ns =        CONTROL_EVENT_XML_NS,
-		.actions =	       control_actions,
-		.action_arguments =    argument_list,
-		.variable_container =  NULL,  // set later.
-		.last_change =         NULL,
-		.command_count =       CONTROL_CMD_COUNT,
-	};
-
+struct upnp_control *upnp_control_new(int instance, struct output *out) {
 	static struct var_meta control_var_meta[] = {
 		{CONTROL_VAR_LAST_CHANGE, "LastChange", "<Event xmlns = \"urn:schemas-upnp-org:metadata-1-0/RCS/\"/>",
 		 EV_YES, DATATYPE_STRING, NULL, NULL },
@@ -766,25 +777,42 @@ struct service *upnp_control_get_service(void) {
 		{CONTROL_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
 	};
 
-	if (control_service_.variable_container == NULL) {
-		state_variables_ =
-			VariableContainer_new(CONTROL_VAR_COUNT,
-					      control_var_meta);
-		control_service_.variable_container = state_variables_;
-	}
+	struct upnp_control *c = calloc(1, sizeof(*c));
+	pthread_mutex_init(&c->mutex, NULL);
+	c->state_variables = VariableContainer_new(CONTROL_VAR_COUNT,
+						   control_var_meta);
+	c->output = out;
+
+	struct service *service = &c->service;
+	service->service_mutex = &c->mutex;
+	service->service_id = CONTROL_SERVICE_ID;
+	service->service_type = CONTROL_TYPE;
+	service->scpd_url = CONTROL_SCPD_URL;
+	service->control_url = g_strdup_printf(CONTROL_CONTROL_URL, instance);
+	service->event_url = g_strdup_printf(CONTROL_EVENT_URL, instance);
+	service->event_xml_ns = CONTROL_EVENT_XML_NS;
+	service->actions = control_actions;
+	service->action_arguments = argument_list;
+	service->variable_container = c->state_variables;
+	service->last_change = NULL;
+	service->command_count = CONTROL_CMD_COUNT;
+	service->lock_profile = LockProfile_new("control");
+	return c;
+}
 
-	return &control_service_;
+struct service *upnp_control_get_service(struct upnp_control *c) {
+	return &c->service;
 }
 
-void upnp_control_init(struct upnp_device *device) {
-	struct service *service = upnp_control_get_service();
+void upnp_control_init(struct upnp_control *c, struct upnp_device *device) {
+	struct service *service = &c->service;
 
 	// Set initial volume.
 	float volume_fraction = 0;
-	if (output_get_volume(&volume_fraction) == 0) {
+	if (output_get_volume(c->output, &volume_fraction) == 0) {
 		Log_info("control", "Output initial volume is %f; setting "
 			 "control variables accordingly.", volume_fraction);
-		change_volume_decibel(20 * log(volume_fraction) / log(10));
+		change_volume_decibel(c, 20 * log(volume_fraction) / log(10));
 	}
 
 	assert(service->last_change == NULL);
@@ -803,7 +831,8 @@ void upnp_control_init(struct upnp_device *device) {
 					   CONTROL_VAR_AAT_PRESET_NAME);
 }
 
-void upnp_control_register_variable_listener(variable_change_listener_t cb,
+void upnp_control_register_variable_listener(struct upnp_control *c,
+					     variable_change_listener_t cb,
 					     void *userdata) {
-	VariableContainer_register_callback(state_variables_, cb, userdata);
+	VariableContainer_register_callback(c->state_variables, cb, userdata);
 }
@@ -25,11 +25,18 @@
 
 #include "variable-container.h"
 
+struct output;
+struct service;
+struct upnp_control;
 struct upnp_device;
 
-void upnp_control_init(struct upnp_device *device);
-struct service *upnp_control_get_service(void);
-void upnp_control_register_variable_listener(variable_change_listener_t cb,
+// The RenderingControl of renderer number "instance" (1, 2, ..), setting
+// the volume of "out".
+struct upnp_control *upnp_control_new(int instance, struct output *out);
+struct service *upnp_control_get_service(struct upnp_control *c);
+void upnp_control_init(struct upnp_control *c, struct upnp_device *device);
+void upnp_control_register_variable_listener(struct upnp_control *c,
+					     variable_change_listener_t cb,
 					     void *userdata);
 
 #endif /* _UPNP_CONTROL_H */
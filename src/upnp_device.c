@@ -37,12 +37,18 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
 
 #include <upnp.h>
 #include <pthread.h>
 #include <upnptools.h>
 
+#include "lockprof.h"
 #include "logging.h"
+#include "metrics.h"
+#include "netwatch.h"
+#include "trace.h"
 
 #include "xmlescape.h"
 #include "webserver.h"
@@ -54,10 +60,15 @@
 // Enable logging of action requests.
 //#define ENABLE_ACTION_LOGGING
 
+// Longest subscription we grant; control points renew before it runs out.
+// Also how long the active-subscriptions gauge counts one.
+static const int kMaxSubscriptionTimeoutSec = 1800;
+
 struct upnp_device {
 	struct upnp_device_descriptor *upnp_device_descriptor;
 	pthread_mutex_t device_mutex;
         UpnpDevice_Handle device_handle;
+	struct upnp_device *next;  // In devices_.
 };
 
 int upnp_add_response(struct action_event *event,
@@ -98,13 +109,14 @@ void upnp_append_variable(struct action_event *event,
 	assert(event != NULL);
 	assert(paramname != NULL);
 
-	pthread_mutex_lock(service->service_mutex);
+	LockProfile_lock(service->lock_profile, service->service_mutex,
+			 __func__);
 
 	value = VariableContainer_get(service->variable_container, varnum, NULL);
 	assert(value != NULL);   // triggers on invalid variable.
 	upnp_add_response(event, paramname, value);
 
-	pthread_mutex_unlock(service->service_mutex);
+	LockProfile_unlock(service->lock_profile, service->service_mutex);
 }
 
 void upnp_set_error(struct action_event *event, int error_code,
@@ -178,49 +190,72 @@ static int handle_subscription_request(struct upnp_device *priv,
 			serviceId);
 		return -1;
 	}
+	Metrics_add(METRIC_SUBSCRIPTIONS, 1);
 
 	int result = -1;
 	pthread_mutex_lock(&(priv->device_mutex));
 
-	// There is really only one variable evented: LastChange
-	const char *eventvar_names[] = {
-		"LastChange",
-		NULL
-	};
-	const char *eventvar_values[] = {
-		NULL, NULL
-	};
-
-	// Build the current state of the variables as one gigantic initial
-	// LastChange update.
-	pthread_mutex_lock(srv->service_mutex);
-	const int var_count =
-		VariableContainer_get_num_vars(srv->variable_container);
-	// TODO(hzeller): maybe use srv->last_change directly ?
-	upnp_last_change_builder_t *builder = UPnPLastChangeBuilder_new(srv->event_xml_ns);
+	// Services using LastChange only event that one variable; the initial
+	// update is the current state of all others as one gigantic LastChange.
+	// Services without it (ConnectionManager, OpenHome) event each of
+	// their evented variables by itself.
+	LockProfile_lock(srv->lock_profile, srv->service_mutex, __func__);
+	int var_count;
+	const struct var_meta *meta =
+		VariableContainer_get_meta(srv->variable_container, &var_count);
+	const char **eventvar_names = g_new0(const char*, var_count + 1);
+	char **eventvar_values = g_new0(char*, var_count + 1);
+	int event_count = 0;
+	int has_last_change = 0;
 	for (int i = 0; i < var_count; ++i) {
-		const char *name;
-		const char *value =
-			VariableContainer_get(srv->variable_container, i, &name);
-		// Send over all variables except "LastChange" itself. Also all
-		// A_ARG_TYPE variables are not evented.
-		if (value && strcmp("LastChange", name) != 0
-		    && strncmp("A_ARG_TYPE_", name, strlen("A_ARG_TYPE_")) != 0) {
-			UPnPLastChangeBuilder_add(builder, name, value);
+		if (strcmp("LastChange", meta[i].name) == 0)
+			has_last_change = 1;
+	}
+	if (has_last_change) {
+		// TODO(hzeller): maybe use srv->last_change directly ?
+		upnp_last_change_builder_t *builder =
+			UPnPLastChangeBuilder_new(srv->event_xml_ns);
+		for (int i = 0; i < var_count; ++i) {
+			const char *name;
+			const char *value = VariableContainer_get(
+				srv->variable_container, i, &name);
+			// Send over all variables except "LastChange" itself.
+			// Also all A_ARG_TYPE variables are not evented.
+			if (value && strcmp("LastChange", name) != 0
+			    && strncmp("A_ARG_TYPE_", name,
+				       strlen("A_ARG_TYPE_")) != 0) {
+				UPnPLastChangeBuilder_add(builder, name, value);
+			}
+		}
+		char *xml_value = UPnPLastChangeBuilder_to_xml(builder);
+		UPnPLastChangeBuilder_delete(builder);
+		Log_info("upnp", "Initial variable sync: %s", xml_value);
+		eventvar_names[0] = "LastChange";
+		eventvar_values[0] = xmlescape(xml_value, 0);
+		event_count = 1;
+		free(xml_value);
+	} else {
+		for (int i = 0; i < var_count; ++i) {
+			const char *value = VariableContainer_get(
+				srv->variable_container, i, NULL);
+			if (value == NULL || meta[i].sendevents != EV_YES)
+				continue;
+			eventvar_names[event_count] = meta[i].name;
+			eventvar_values[event_count] = xmlescape(value, 0);
+			++event_count;
 		}
 	}
-	pthread_mutex_unlock(srv->service_mutex);
-	char *xml_value = UPnPLastChangeBuilder_to_xml(builder);
-	Log_info("upnp", "Initial variable sync: %s", xml_value);
-	eventvar_values[0] = xmlescape(xml_value, 0);
-	free(xml_value);
-	UPnPLastChangeBuilder_delete(builder);
+	LockProfile_unlock(srv->lock_profile, srv->service_mutex);
 
 	const char *sid = UpnpSubscriptionRequest_get_SID_cstr(sr_event);
-	rc = UpnpAcceptSubscription(priv->device_handle,
+	rc = UpnpAcceptSubscription(__atomic_load_n(&priv->device_handle,
+						    __ATOMIC_ACQUIRE),
 				    udn, serviceId,
-				    eventvar_names, eventvar_values, 1, sid);
+				    eventvar_names,
+				    (const char **) eventvar_values,
+				    event_count, sid);
 	if (rc == UPNP_E_SUCCESS) {
+		Metrics_subscribed(priv, sid, kMaxSubscriptionTimeoutSec);
 		result = 0;
 	} else {
 		Log_error("upnp", "Accept Subscription Error: %s (%d)",
@@ -229,7 +264,10 @@ static int handle_subscription_request(struct upnp_device *priv,
 
 	pthread_mutex_unlock(&(priv->device_mutex));
 
-	free((char*)eventvar_values[0]);
+	for (int i = 0; i < event_count; ++i)
+		free(eventvar_values[i]);
+	g_free(eventvar_values);
+	g_free(eventvar_names);
 
 	return result;
 }
@@ -239,9 +277,17 @@ int upnp_device_notify(struct upnp_device *device,
                        const char **varnames,
                        const char **varvalues, int varcount)
 {
-        UpnpNotify(device->device_handle,
+	// Offline, or re-registering after an address change.
+	const UpnpDevice_Handle handle =
+		__atomic_load_n(&device->device_handle, __ATOMIC_ACQUIRE);
+	if (handle < 0) {
+		return 0;  // Nobody to notify.
+	}
+	const int64_t start = Trace_begin();
+        UpnpNotify(handle,
                    device->upnp_device_descriptor->udn, serviceID,
 		   varnames, varvalues, varcount);
+	Trace_end("event", "UpnpNotify", start);
 
 	return 0;
 }
@@ -258,7 +304,7 @@ static int handle_var_request(struct upnp_device *priv,
 		return -1;
 	}
 
-	pthread_mutex_lock(srv->service_mutex);
+	LockProfile_lock(srv->lock_profile, srv->service_mutex, __func__);
 
 	char *result = NULL;
 	const int var_count =
@@ -273,7 +319,7 @@ static int handle_var_request(struct upnp_device *priv,
 		}
 	}
 
-	pthread_mutex_unlock(srv->service_mutex);
+	LockProfile_unlock(srv->lock_profile, srv->service_mutex);
 
 	UpnpStateVarRequest_set_CurrentVal(event, result);
 	int errCode = (result == NULL) ? UPNP_SOAP_E_INVALID_VAR : UPNP_E_SUCCESS;
@@ -314,9 +360,11 @@ static int handle_action_request(struct upnp_device *priv,
 	// It would be good to enqueue the upnp_device_notify() after
 	// the action event is finished.
 	if (event_service->last_change) {
-		pthread_mutex_lock(event_service->service_mutex);
+		LockProfile_lock(event_service->lock_profile,
+				 event_service->service_mutex, __func__);
 		UPnPLastChangeCollector_start(event_service->last_change);
-		pthread_mutex_unlock(event_service->service_mutex);
+		LockProfile_unlock(event_service->lock_profile,
+				   event_service->service_mutex);
 	}
 
 #ifdef ENABLE_ACTION_LOGGING
@@ -383,19 +431,38 @@ static int handle_action_request(struct upnp_device *priv,
 	}
 
 	if (event_service->last_change) {   // See comment above.
-		pthread_mutex_lock(event_service->service_mutex);
+		LockProfile_lock(event_service->lock_profile,
+				 event_service->service_mutex, __func__);
 		UPnPLastChangeCollector_finish(event_service->last_change);
-		pthread_mutex_unlock(event_service->service_mutex);
+		LockProfile_unlock(event_service->lock_profile,
+				   event_service->service_mutex);
 	}
 	return 0;
 }
 
+int upnp_device_handle_action(struct upnp_device *device,
+			      UpnpActionRequest *ar_event)
+{
+	const int64_t trace_start = Trace_begin();
+	const int64_t start = Metrics_now_us();
+	const int rc = handle_action_request(device, ar_event);
+	if (rc == 0) {
+		const int failed = (UpnpActionRequest_get_ErrCode(ar_event)
+				    != UPNP_E_SUCCESS);
+		Metrics_action(UpnpActionRequest_get_ActionName_cstr(ar_event),
+			       Metrics_now_us() - start, failed);
+	}
+	Trace_end("action", UpnpActionRequest_get_ActionName_cstr(ar_event),
+		  trace_start);
+	return rc;
+}
+
 static UPNP_CALLBACK(event_handler, EventType, event, userdata)
 {
 	struct upnp_device *priv = (struct upnp_device *) userdata;
 	switch (EventType) {
 	case UPNP_CONTROL_ACTION_REQUEST:
-		handle_action_request(priv, (UpnpActionRequest*)event);
+		upnp_device_handle_action(priv, (UpnpActionRequest*)event);
 		break;
 
 	case UPNP_CONTROL_GET_VAR_REQUEST:
@@ -414,26 +481,43 @@ static UPNP_CALLBACK(event_handler, EventType, event, userdata)
 	return 0;
 }
 
-static gboolean initialize_device(struct upnp_device_descriptor *device_def,
-				  struct upnp_device *result_device,
-				  const char *interface_name,
-				  unsigned short port)
+static gboolean network_initialized_ = FALSE;
+static char *interface_name_ = NULL;    // As configured; might be NULL.
+static unsigned short port_ = 0;        // The port we actually got.
+static volatile gboolean shutting_down_ = FALSE;
+
+// The devices registered with libupnp. They all share its port.
+static struct upnp_device *devices_ = NULL;
+static gboolean address_watch_started_ = FALSE;
+static pthread_mutex_t devices_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+
+int upnp_device_network_init(const char *interface_name,
+			     unsigned short port)
 {
 	int rc;
-	char *buf;
 
+	// Watch for addresses from before the first attempt, so that we
+	// don't miss the interface coming up in between.
+	struct netwatch *watch = NetWatch_open(interface_name);
 	rc = UpnpInit2(interface_name, port);
 	/* There have been situations reported in which UPNP had issues
 	 * initializing right after network came up. #129
+	 * Retry as soon as an address shows up; otherwise back off
+	 * exponentially, up to about a minute in total.
 	 */
-	int retries_left = 60;
-	static const int kRetryTimeMs = 1000;
-	while (rc != UPNP_E_SUCCESS && retries_left--) {
-		usleep(kRetryTimeMs * 1000);
-		Log_error("upnp", "UpnpInit2(interface=%s, port=%d) Error: %s (%d). Retrying... (%ds)",
-			  interface_name, port, UpnpGetErrorMessage(rc), rc, retries_left);
+	static const int kMaxRetryTimeMs = 60000;
+	int retry_time_ms = 0;
+	int delay_ms = 100;
+	while (rc != UPNP_E_SUCCESS && retry_time_ms < kMaxRetryTimeMs) {
+		Log_error("upnp", "UpnpInit2(interface=%s, port=%d) Error: %s (%d). Retrying in %dms or when an address shows up.",
+			  interface_name, port, UpnpGetErrorMessage(rc), rc, delay_ms);
+		const int64_t wait_start = Metrics_now_us();
+		NetWatch_wait(watch, delay_ms);
+		retry_time_ms += (Metrics_now_us() - wait_start) / 1000;
+		delay_ms = delay_ms * 2 > 8000 ? 8000 : delay_ms * 2;
 		rc = UpnpInit2(interface_name, port);
 	}
+	NetWatch_close(watch);
 	if (UPNP_E_SUCCESS != rc) {
 		Log_error("upnp", "UpnpInit2(interface=%s, port=%d) Error: %s (%d). Giving up.",
 			  interface_name, port, UpnpGetErrorMessage(rc), rc);
@@ -461,21 +545,62 @@ static gboolean initialize_device(struct upnp_device_descriptor *device_def,
 			  UpnpGetErrorMessage(rc), rc);
 		return FALSE;
 	}
+	rc = UpnpAddVirtualDir("/metrics");
+	if (UPNP_E_SUCCESS != rc) {
+		// Not essential for rendering; just complain.
+		Log_error("upnp", "UpnpAddVirtualDir(/metrics) Error: %s (%d)",
+			  UpnpGetErrorMessage(rc), rc);
+	}
+
+	if (interface_name != interface_name_) {
+		free(interface_name_);
+		interface_name_ = interface_name ? strdup(interface_name) : NULL;
+	}
+	port_ = UpnpGetServerPort();
+	network_initialized_ = TRUE;
+	return TRUE;
+}
 
-       	buf = upnp_create_device_desc(device_def);
-	rc = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
-				     buf, strlen(buf), 1,
-				     &event_handler, result_device,
-				     &(result_device->device_handle));
-	free(buf);
+// Register with libupnp and announce the device on the network.
+static gboolean register_device(struct upnp_device_descriptor *device_def,
+				struct upnp_device *result_device)
+{
+	int rc;
+	char *buf;
+	UpnpDevice_Handle handle;
+
+	if (device_def->description_path == NULL) {
+		// The description contains our address in the URLBase, so
+		// this needs to be generated each time we register.
+		buf = upnp_create_device_desc(device_def);
+		rc = UpnpRegisterRootDevice2(UPNPREG_BUF_DESC,
+					     buf, strlen(buf), 1,
+					     &event_handler, result_device,
+					     &handle);
+		free(buf);
+	} else {
+		// libupnp only has one /description.xml of its own; the
+		// others are in our webserver, and it fetches them from there.
+		buf = g_strdup_printf("http://%s:%d%s",
+				      UpnpGetServerIpAddress(),
+				      UpnpGetServerPort(),
+				      device_def->description_path);
+		rc = UpnpRegisterRootDevice(buf, &event_handler, result_device,
+					    &handle);
+		g_free(buf);
+	}
 
 	if (UPNP_E_SUCCESS != rc) {
-		Log_error("upnp", "UpnpRegisterRootDevice2() Error: %s (%d)",
-			  UpnpGetErrorMessage(rc), rc);
+		Log_error("upnp", "Registering %s Error: %s (%d)",
+			  device_def->udn, UpnpGetErrorMessage(rc), rc);
 		return FALSE;
 	}
 
-	rc = UpnpSendAdvertisement(result_device->device_handle, 100);
+	__atomic_store_n(&result_device->device_handle, handle,
+			 __ATOMIC_RELEASE);
+	UpnpSetMaxSubscriptionTimeOut(handle, kMaxSubscriptionTimeoutSec);
+
+	rc = UpnpSendAdvertisement(handle, 100);
 	if (UPNP_E_SUCCESS != rc) {
 		Log_error("unpp", "Error sending advertisements: %s (%d)",
 			  UpnpGetErrorMessage(rc), rc);
@@ -485,9 +610,97 @@ static gboolean initialize_device(struct upnp_device_descriptor *device_def,
 	return TRUE;
 }
 
-struct upnp_device *upnp_device_init(struct upnp_device_descriptor *device_def,
-				     const char *interface_name,
-				     unsigned short port)
+// The first IPv4 address of the interface, chosen the same way libupnp does.
+// Returns FALSE if there is none.
+static gboolean get_current_address(char *buf, size_t size)
+{
+	struct ifaddrs *addrs;
+	if (getifaddrs(&addrs) < 0)
+		return FALSE;
+	gboolean found = FALSE;
+	for (struct ifaddrs *ifa = addrs; ifa && !found; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != AF_INET
+		    || !(ifa->ifa_flags & IFF_UP))
+			continue;
+		if (interface_name_ != NULL
+		    ? strcmp(ifa->ifa_name, interface_name_) != 0
+		    : (ifa->ifa_flags & IFF_LOOPBACK) != 0)
+			continue;
+		struct sockaddr_in *sin = (struct sockaddr_in*) ifa->ifa_addr;
+		found = inet_ntop(AF_INET, &sin->sin_addr, buf, size) != NULL;
+	}
+	freeifaddrs(addrs);
+	return found;
+}
+
+// Move the devices over to a new address. libupnp binds all its sockets to
+// the address at init time, so that means tearing it down and bringing it up
+// again. The devices themselves, with the state of their services, stay, and
+// the outputs are not touched, so playback continues. Control points need to
+// subscribe again, and will do so once they see our new advertisement.
+static void reregister_devices(const char *new_address)
+{
+	Log_info("upnp", "Address changed from %s to %s; re-registering.",
+		 UpnpGetServerIpAddress(), new_address);
+	pthread_mutex_lock(&devices_mutex_);
+	for (struct upnp_device *it = devices_; it; it = it->next) {
+		const UpnpDevice_Handle old_handle =
+			__atomic_exchange_n(&it->device_handle, -1,
+					    __ATOMIC_ACQ_REL);
+		if (old_handle >= 0) {
+			UpnpUnRegisterRootDevice(old_handle);  // Says byebye.
+			Metrics_unsubscribe_all(it);
+		}
+	}
+	UpnpFinish();
+	network_initialized_ = FALSE;
+	// Keep the port, so that URLs control points have stay valid.
+	if (!upnp_device_network_init(interface_name_, port_)) {
+		UpnpFinish();
+		if (!upnp_device_network_init(interface_name_, 0)) {
+			Log_error("upnp", "Could not bring up network again.");
+			pthread_mutex_unlock(&devices_mutex_);
+			return;
+		}
+	}
+	for (struct upnp_device *it = devices_; it; it = it->next) {
+		if (!register_device(it->upnp_device_descriptor, it)) {
+			Log_error("upnp", "Could not re-register %s.",
+				  it->upnp_device_descriptor->udn);
+		}
+	}
+	pthread_mutex_unlock(&devices_mutex_);
+}
+
+static void *address_watch_thread(void *userdata)
+{
+	(void)userdata;
+	struct netwatch *watch = NetWatch_open(interface_name_);
+	if (watch == NULL)
+		return NULL;  // Not supported here.
+	static const int kSettleTimeMs = 2000;
+	while (!shutting_down_) {
+		if (!NetWatch_wait(watch, 60000))
+			continue;
+		// Changes come in bursts (e.g. DHCP removing the old
+		// address, adding the new one); wait until things settle.
+		while (NetWatch_wait(watch, kSettleTimeMs))
+			;
+		char address[INET_ADDRSTRLEN];
+		if (shutting_down_ || !get_current_address(address,
+							   sizeof(address)))
+			continue;  // Address gone; wait for the next one.
+		const char *current = UpnpGetServerIpAddress();
+		if (current != NULL && strcmp(current, address) == 0)
+			continue;  // Still the one we serve on.
+		reregister_devices(address);
+	}
+	NetWatch_close(watch);
+	return NULL;
+}
+
+// Runs the device's init function and registers the files to be served.
+static struct upnp_device *create_device(struct upnp_device_descriptor *device_def)
 {
 	int rc;
 	char *buf;
@@ -519,17 +732,90 @@ struct upnp_device *upnp_device_init(struct upnp_device_descriptor *device_def,
 		webserver_register_buf(srv->scpd_url, buf, "text/xml");
 	}
 
-	if (!initialize_device(device_def, result_device, interface_name, port)) {
+	if (device_def->description_path != NULL) {
+		// Without our address, so it stays valid.
+		buf = upnp_create_device_desc(device_def);
+		webserver_register_buf(device_def->description_path, buf,
+				       "text/xml");
+	}
+
+	webserver_register_generator("/metrics", Metrics_to_text,
+				     "text/plain; version=0.0.4");
+	return result_device;
+}
+
+struct upnp_device *upnp_device_init(struct upnp_device_descriptor *device_def,
+				     const char *interface_name,
+				     unsigned short port)
+{
+	if (!network_initialized_ &&
+	    !upnp_device_network_init(interface_name, port)) {
+		UpnpFinish();
+		return NULL;
+	}
+
+	struct upnp_device *result_device = create_device(device_def);
+	if (result_device == NULL) {
 		UpnpFinish();
+		return NULL;
+	}
+
+	pthread_mutex_lock(&devices_mutex_);
+	if (!register_device(device_def, result_device)) {
+		if (devices_ == NULL)
+			UpnpFinish();
+		pthread_mutex_unlock(&devices_mutex_);
 		free(result_device);
 		return NULL;
 	}
+	result_device->next = devices_;
+	devices_ = result_device;
+	const gboolean start_watch = !address_watch_started_;
+	address_watch_started_ = TRUE;
+	pthread_mutex_unlock(&devices_mutex_);
+
+	pthread_t thread;
+	if (start_watch && pthread_create(&thread, NULL, address_watch_thread,
+					  NULL) == 0) {
+		pthread_detach(thread);
+	}
 
 	return result_device;
 }
 
+struct upnp_device *upnp_device_init_offline(struct upnp_device_descriptor *device_def)
+{
+	struct upnp_device *result_device = create_device(device_def);
+	if (result_device != NULL) {
+		result_device->device_handle = -1;
+		result_device->next = NULL;
+	}
+	return result_device;
+}
+
 void upnp_device_shutdown(struct upnp_device *device) {
-	UpnpFinish();
+	pthread_mutex_lock(&devices_mutex_);
+	struct upnp_device **it = &devices_;
+	while (*it != NULL && *it != device)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = device->next;
+	const gboolean last = (devices_ == NULL);
+	if (last)
+		shutting_down_ = TRUE;
+	pthread_mutex_unlock(&devices_mutex_);
+
+	if (last) {
+		UpnpFinish();
+		return;
+	}
+	const UpnpDevice_Handle handle =
+		__atomic_exchange_n(&device->device_handle, -1,
+				    __ATOMIC_ACQ_REL);
+	if (handle >= 0) {
+		UpnpUnRegisterRootDevice(handle);
+		Metrics_unsubscribe_all(device);
+	}
 }
 
 struct service *find_service(struct upnp_device_descriptor *device_def,
@@ -24,6 +24,8 @@
 #ifndef _UPNP_DEVICE_H
 #define _UPNP_DEVICE_H
 
+#include "upnp_compat.h"
+
 
 struct upnp_device_descriptor {
 	int (*init_function) (void);
@@ -42,16 +44,40 @@ struct upnp_device_descriptor {
 	const char *mime_filter;
 	struct icon **icons;
 	struct service **services;
+	// Where our webserver serves the description, e.g.
+	// "/upnp/description2.xml". NULL: libupnp serves it as
+	// /description.xml, which only one device can do.
+	const char *description_path;
 };
 
 // ..  and this 'device'. This is an opaque type containing internals.
 struct upnp_device;
 struct action_event;
 
+// Bring up libupnp and its webserver. Retries for a while if the network
+// is not up yet; returns 0 if that fails. Can be called ahead of
+// upnp_device_init(), e.g. while the output initializes in parallel;
+// otherwise upnp_device_init() calls it.
+int upnp_device_network_init(const char *interface_name,
+			     unsigned short port);
+
+// Register the device with libupnp and announce it. Several devices can
+// be registered; they share libupnp and its port.
 struct upnp_device *upnp_device_init(struct upnp_device_descriptor *device_def,
 				     const char *interface_name,
 				     unsigned short port);
 
+// Create the device without bringing up libupnp, so it is not visible on
+// the network and does not send events. Actions can be fed to it with
+// upnp_device_handle_action(). Meant for benchmarks and tests.
+struct upnp_device *upnp_device_init_offline(struct upnp_device_descriptor *device_def);
+
+// Handle an action request as if it came from the network. Returns 0 if
+// the action was dispatched (it might still have set an error code).
+int upnp_device_handle_action(struct upnp_device *device,
+			      UpnpActionRequest *request);
+
+// Say goodbye for this device; libupnp goes down with the last one.
 void upnp_device_shutdown(struct upnp_device *device);
 
 int upnp_add_response(struct action_event *event,
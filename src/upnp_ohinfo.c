@@ -0,0 +1,292 @@
+/* upnp_ohinfo.c - OpenHome Info service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "upnp_ohinfo.h"
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <upnp.h>
+#include <pthread.h>
+
+#include "lockprof.h"
+#include "upnp_service.h"
+#include "upnp_device.h"
+#include "upnp_transport.h"
+#include "variable-container.h"
+
+#define INFO_TYPE "urn:av-openhome-org:service:Info:1"
+#define INFO_SERVICE_ID "urn:av-openhome-org:serviceId:Info"
+
+#define INFO_SCPD_URL "/upnp/ohinfoSCPD.xml"
+#define INFO_CONTROL_URL "/upnp/control/ohinfo1"
+#define INFO_EVENT_URL "/upnp/event/ohinfo1"
+
+enum {
+	INFO_CMD_COUNTERS,
+	INFO_CMD_TRACK,
+	INFO_CMD_DETAILS,
+	INFO_CMD_METATEXT,
+	INFO_CMD_COUNT
+};
+
+typedef enum {
+	INFO_VAR_TRACK_COUNT,
+	INFO_VAR_DETAILS_COUNT,
+	INFO_VAR_METATEXT_COUNT,
+	INFO_VAR_URI,
+	INFO_VAR_METADATA,
+	INFO_VAR_DURATION,
+	INFO_VAR_BIT_RATE,
+	INFO_VAR_BIT_DEPTH,
+	INFO_VAR_SAMPLE_RATE,
+	INFO_VAR_LOSSLESS,
+	INFO_VAR_CODEC_NAME,
+	INFO_VAR_METATEXT,
+	INFO_VAR_COUNT
+} info_variable_t;
+
+static struct argument arguments_counters[] = {
+	{ "TrackCount", PARAM_DIR_OUT, INFO_VAR_TRACK_COUNT },
+	{ "DetailsCount", PARAM_DIR_OUT, INFO_VAR_DETAILS_COUNT },
+	{ "MetatextCount", PARAM_DIR_OUT, INFO_VAR_METATEXT_COUNT },
+	{ NULL }
+};
+static struct argument arguments_track[] = {
+	{ "Uri", PARAM_DIR_OUT, INFO_VAR_URI },
+	{ "Metadata", PARAM_DIR_OUT, INFO_VAR_METADATA },
+	{ NULL }
+};
+static struct argument arguments_details[] = {
+	{ "Duration", PARAM_DIR_OUT, INFO_VAR_DURATION },
+	{ "BitRate", PARAM_DIR_OUT, INFO_VAR_BIT_RATE },
+	{ "BitDepth", PARAM_DIR_OUT, INFO_VAR_BIT_DEPTH },
+	{ "SampleRate", PARAM_DIR_OUT, INFO_VAR_SAMPLE_RATE },
+	{ "Lossless", PARAM_DIR_OUT, INFO_VAR_LOSSLESS },
+	{ "CodecName", PARAM_DIR_OUT, INFO_VAR_CODEC_NAME },
+	{ NULL }
+};
+static struct argument arguments_metatext[] = {
+	{ "Value", PARAM_DIR_OUT, INFO_VAR_METATEXT },
+	{ NULL }
+};
+
+static struct argument *argument_list[] = {
+	[INFO_CMD_COUNTERS] = arguments_counters,
+	[INFO_CMD_TRACK] =    arguments_track,
+	[INFO_CMD_DETAILS] =  arguments_details,
+	[INFO_CMD_METATEXT] = arguments_metatext,
+	[INFO_CMD_COUNT] =    NULL
+};
+
+static variable_container_t *state_variables_ = NULL;
+
+// Set when a new track started, until its meta data arrived. Meta data
+// changing after that comes from the stream.
+static int awaiting_track_meta_ = 0;
+
+/* protects state_variables_ and awaiting_track_meta_. To be taken after
+   the transport lock, if both are needed. */
+static pthread_mutex_t info_mutex;
+
+static void service_lock_at(const char *call_site)
+{
+	LockProfile_lock(upnp_ohinfo_get_service()->lock_profile,
+			 &info_mutex, call_site);
+}
+#define service_lock() service_lock_at(__func__)
+
+static void service_unlock(void)
+{
+	LockProfile_unlock(upnp_ohinfo_get_service()->lock_profile,
+			   &info_mutex);
+}
+
+static int replace_var(info_variable_t varnum, const char *new_value) {
+	return VariableContainer_change(state_variables_, varnum, new_value);
+}
+
+static void increment_var(info_variable_t varnum) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%lu", 1 + strtoul(
+		      VariableContainer_get(state_variables_, varnum, NULL),
+		      NULL, 10));
+	replace_var(varnum, buf);
+}
+
+// Called by the transport service, with its lock held.
+static void update_from_transport(void *userdata,
+				  int var_num, const char *var_name,
+				  const char *old_value,
+				  const char *new_value) {
+	(void)userdata;
+	(void)var_num;
+	(void)old_value;
+	if (strcmp(var_name, "CurrentTrackURI") == 0) {
+		service_lock();
+		replace_var(INFO_VAR_URI, new_value);
+		replace_var(INFO_VAR_METATEXT, "");
+		if (strlen(new_value) > 0)
+			awaiting_track_meta_ = 1;
+		service_unlock();
+	} else if (strcmp(var_name, "CurrentTrackMetaData") == 0) {
+		service_lock();
+		if (awaiting_track_meta_) {
+			replace_var(INFO_VAR_METADATA, new_value);
+			awaiting_track_meta_ = 0;
+		} else if (replace_var(INFO_VAR_METATEXT, new_value)) {
+			increment_var(INFO_VAR_METATEXT_COUNT);
+		}
+		service_unlock();
+	} else if (strcmp(var_name, "CurrentTrackDuration") == 0) {
+		int hour = 0, minute = 0, second = 0;
+		sscanf(new_value, "%d:%02d:%02d", &hour, &minute, &second);
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%d",
+			 hour * 3600 + minute * 60 + second);
+		service_lock();
+		if (replace_var(INFO_VAR_DURATION, buf))
+			increment_var(INFO_VAR_DETAILS_COUNT);
+		service_unlock();
+	}
+}
+
+// Called by the transport service, with its lock held.
+static void count_track(void *userdata) {
+	(void)userdata;
+	service_lock();
+	increment_var(INFO_VAR_TRACK_COUNT);
+	service_unlock();
+}
+
+/* UPnP action handlers */
+
+static int get_counters(struct action_event *event) {
+	upnp_append_variable(event, INFO_VAR_TRACK_COUNT, "TrackCount");
+	upnp_append_variable(event, INFO_VAR_DETAILS_COUNT, "DetailsCount");
+	upnp_append_variable(event, INFO_VAR_METATEXT_COUNT, "MetatextCount");
+	return 0;
+}
+
+static int get_track(struct action_event *event) {
+	upnp_append_variable(event, INFO_VAR_URI, "Uri");
+	upnp_append_variable(event, INFO_VAR_METADATA, "Metadata");
+	return 0;
+}
+
+static int get_details(struct action_event *event) {
+	upnp_append_variable(event, INFO_VAR_DURATION, "Duration");
+	upnp_append_variable(event, INFO_VAR_BIT_RATE, "BitRate");
+	upnp_append_variable(event, INFO_VAR_BIT_DEPTH, "BitDepth");
+	upnp_append_variable(event, INFO_VAR_SAMPLE_RATE, "SampleRate");
+	upnp_append_variable(event, INFO_VAR_LOSSLESS, "Lossless");
+	upnp_append_variable(event, INFO_VAR_CODEC_NAME, "CodecName");
+	return 0;
+}
+
+static int get_metatext(struct action_event *event) {
+	upnp_append_variable(event, INFO_VAR_METATEXT, "Value");
+	return 0;
+}
+
+static struct action info_actions[] = {
+	[INFO_CMD_COUNTERS] = {"Counters", get_counters},
+	[INFO_CMD_TRACK] =    {"Track", get_track},
+	[INFO_CMD_DETAILS] =  {"Details", get_details},
+	[INFO_CMD_METATEXT] = {"Metatext", get_metatext},
+	[INFO_CMD_COUNT] =    {NULL, NULL}
+};
+
+struct service *upnp_ohinfo_get_service(void) {
+	static struct service info_service_ = {
+		.service_mutex =        &info_mutex,
+		.service_id =           INFO_SERVICE_ID,
+		.service_type =         INFO_TYPE,
+		.scpd_url =		INFO_SCPD_URL,
+		.control_url =		INFO_CONTROL_URL,
+		.event_url =		INFO_EVENT_URL,
+		.event_xml_ns =         NULL,  // Not using LastChange.
+		.actions =              info_actions,
+		.action_arguments =     argument_list,
+		.variable_container =   NULL, // set later.
+		.last_change =          NULL,
+		.command_count =        INFO_CMD_COUNT,
+	};
+
+	// The output doesn't tell us about the codec; these details stay
+	// unknown (0).
+	static struct var_meta info_var_meta[] = {
+		{ INFO_VAR_TRACK_COUNT, "TrackCount", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_DETAILS_COUNT, "DetailsCount", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_METATEXT_COUNT, "MetatextCount", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_URI, "Uri", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ INFO_VAR_METADATA, "Metadata", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ INFO_VAR_DURATION, "Duration", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_BIT_RATE, "BitRate", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_BIT_DEPTH, "BitDepth", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_SAMPLE_RATE, "SampleRate", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ INFO_VAR_LOSSLESS, "Lossless", "false",
+		  EV_YES, DATATYPE_BOOLEAN, NULL, NULL },
+		{ INFO_VAR_CODEC_NAME, "CodecName", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ INFO_VAR_METATEXT, "Metatext", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+
+		{ INFO_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
+	};
+
+	if (info_service_.variable_container == NULL) {
+		state_variables_ = VariableContainer_new(INFO_VAR_COUNT,
+							 info_var_meta);
+		info_service_.variable_container = state_variables_;
+		info_service_.lock_profile = LockProfile_new("ohinfo");
+	}
+	return &info_service_;
+}
+
+void upnp_ohinfo_init(struct upnp_device *device,
+		      struct upnp_transport *transport) {
+	struct service *service = upnp_ohinfo_get_service();
+	UPnPVariableEventer_new(service->variable_container, device,
+				INFO_SERVICE_ID);
+	upnp_transport_register_variable_listener(transport,
+						  update_from_transport, NULL);
+	upnp_transport_register_track_listener(transport, count_track, NULL);
+}
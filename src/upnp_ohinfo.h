@@ -0,0 +1,40 @@
+/* upnp_ohinfo.h - OpenHome Info service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _UPNP_OHINFO_H
+#define _UPNP_OHINFO_H
+
+// The OpenHome Info service: evented uri and meta data of the current
+// track, and the meta data a stream (e.g. a radio station) sends while
+// it plays. Taken from the AVTransport service.
+
+struct service;
+struct upnp_device;
+struct upnp_transport;
+
+// There is only one; OpenHome is not offered with zones.
+struct service *upnp_ohinfo_get_service(void);
+void upnp_ohinfo_init(struct upnp_device *,
+		      struct upnp_transport *transport);
+
+#endif /* _UPNP_OHINFO_H */
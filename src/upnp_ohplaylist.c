@@ -0,0 +1,680 @@
+/* upnp_ohplaylist.c - OpenHome Playlist service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "upnp_ohplaylist.h"
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <glib.h>
+
+#include <upnp.h>
+#include <pthread.h>
+
+#include "lockprof.h"
+#include "play_queue.h"
+#include "upnp_connmgr.h"
+#include "upnp_service.h"
+#include "upnp_device.h"
+#include "upnp_transport.h"
+#include "variable-container.h"
+#include "xmldoc.h"
+
+#define PLAYLIST_TYPE "urn:av-openhome-org:service:Playlist:1"
+#define PLAYLIST_SERVICE_ID "urn:av-openhome-org:serviceId:Playlist"
+
+#define PLAYLIST_SCPD_URL "/upnp/ohplaylistSCPD.xml"
+#define PLAYLIST_CONTROL_URL "/upnp/control/ohplaylist1"
+#define PLAYLIST_EVENT_URL "/upnp/event/ohplaylist1"
+
+// More is fine for us, but controllers read the whole list.
+#define PLAYLIST_TRACKS_MAX 1000
+
+enum {
+	PLAYLIST_CMD_PLAY,
+	PLAYLIST_CMD_PAUSE,
+	PLAYLIST_CMD_STOP,
+	PLAYLIST_CMD_NEXT,
+	PLAYLIST_CMD_PREVIOUS,
+	PLAYLIST_CMD_SETREPEAT,
+	PLAYLIST_CMD_REPEAT,
+	PLAYLIST_CMD_SETSHUFFLE,
+	PLAYLIST_CMD_SHUFFLE,
+	PLAYLIST_CMD_SEEKSECONDABSOLUTE,
+	PLAYLIST_CMD_SEEKSECONDRELATIVE,
+	PLAYLIST_CMD_SEEKID,
+	PLAYLIST_CMD_SEEKINDEX,
+	PLAYLIST_CMD_TRANSPORTSTATE,
+	PLAYLIST_CMD_ID,
+	PLAYLIST_CMD_READ,
+	PLAYLIST_CMD_READLIST,
+	PLAYLIST_CMD_INSERT,
+	PLAYLIST_CMD_DELETEID,
+	PLAYLIST_CMD_DELETEALL,
+	PLAYLIST_CMD_TRACKSMAX,
+	PLAYLIST_CMD_IDARRAY,
+	PLAYLIST_CMD_IDARRAYCHANGED,
+	PLAYLIST_CMD_PROTOCOLINFO,
+
+	PLAYLIST_CMD_COUNT
+};
+
+// Error codes as used by OpenHome devices.
+enum OHPlaylistError {
+	OH_PLAYLIST_E_INVALID_ID	= 800,
+	OH_PLAYLIST_E_PLAYLIST_FULL	= 801,
+	OH_PLAYLIST_E_INVALID_INDEX	= 802,
+};
+
+static const char *transport_states[] = {
+	"Playing",
+	"Paused",
+	"Stopped",
+	"Buffering",
+	NULL
+};
+
+typedef enum {
+	PLAYLIST_VAR_TRANSPORT_STATE,
+	PLAYLIST_VAR_REPEAT,
+	PLAYLIST_VAR_SHUFFLE,
+	PLAYLIST_VAR_ID,
+	PLAYLIST_VAR_ID_ARRAY,
+	PLAYLIST_VAR_TRACKS_MAX,
+	PLAYLIST_VAR_PROTOCOL_INFO,
+	PLAYLIST_VAR_AARG_URI,
+	PLAYLIST_VAR_AARG_METADATA,
+	PLAYLIST_VAR_AARG_RELATIVE,
+	PLAYLIST_VAR_AARG_ABSOLUTE,
+	PLAYLIST_VAR_AARG_INDEX,
+	PLAYLIST_VAR_AARG_ID_ARRAY_TOKEN,
+	PLAYLIST_VAR_AARG_ID_ARRAY_CHANGED,
+	PLAYLIST_VAR_AARG_ID_LIST,
+	PLAYLIST_VAR_AARG_TRACK_LIST,
+	PLAYLIST_VAR_COUNT
+} playlist_variable_t;
+
+static struct argument arguments_value_repeat_in[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_REPEAT },
+	{ NULL }
+};
+static struct argument arguments_value_repeat_out[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_REPEAT },
+	{ NULL }
+};
+static struct argument arguments_value_shuffle_in[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_SHUFFLE },
+	{ NULL }
+};
+static struct argument arguments_value_shuffle_out[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_SHUFFLE },
+	{ NULL }
+};
+static struct argument arguments_seek_second_absolute[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_AARG_ABSOLUTE },
+	{ NULL }
+};
+static struct argument arguments_seek_second_relative[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_AARG_RELATIVE },
+	{ NULL }
+};
+static struct argument arguments_value_id_in[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_ID },
+	{ NULL }
+};
+static struct argument arguments_value_id_out[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_ID },
+	{ NULL }
+};
+static struct argument arguments_seek_index[] = {
+	{ "Value", PARAM_DIR_IN, PLAYLIST_VAR_AARG_INDEX },
+	{ NULL }
+};
+static struct argument arguments_transport_state[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_TRANSPORT_STATE },
+	{ NULL }
+};
+static struct argument arguments_read[] = {
+	{ "Id", PARAM_DIR_IN, PLAYLIST_VAR_ID },
+	{ "Uri", PARAM_DIR_OUT, PLAYLIST_VAR_AARG_URI },
+	{ "Metadata", PARAM_DIR_OUT, PLAYLIST_VAR_AARG_METADATA },
+	{ NULL }
+};
+static struct argument arguments_read_list[] = {
+	{ "IdList", PARAM_DIR_IN, PLAYLIST_VAR_AARG_ID_LIST },
+	{ "TrackList", PARAM_DIR_OUT, PLAYLIST_VAR_AARG_TRACK_LIST },
+	{ NULL }
+};
+static struct argument arguments_insert[] = {
+	{ "AfterId", PARAM_DIR_IN, PLAYLIST_VAR_ID },
+	{ "Uri", PARAM_DIR_IN, PLAYLIST_VAR_AARG_URI },
+	{ "Metadata", PARAM_DIR_IN, PLAYLIST_VAR_AARG_METADATA },
+	{ "NewId", PARAM_DIR_OUT, PLAYLIST_VAR_ID },
+	{ NULL }
+};
+static struct argument arguments_tracks_max[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_TRACKS_MAX },
+	{ NULL }
+};
+static struct argument arguments_id_array[] = {
+	{ "Token", PARAM_DIR_OUT, PLAYLIST_VAR_AARG_ID_ARRAY_TOKEN },
+	{ "Array", PARAM_DIR_OUT, PLAYLIST_VAR_ID_ARRAY },
+	{ NULL }
+};
+static struct argument arguments_id_array_changed[] = {
+	{ "Token", PARAM_DIR_IN, PLAYLIST_VAR_AARG_ID_ARRAY_TOKEN },
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_AARG_ID_ARRAY_CHANGED },
+	{ NULL }
+};
+static struct argument arguments_protocol_info[] = {
+	{ "Value", PARAM_DIR_OUT, PLAYLIST_VAR_PROTOCOL_INFO },
+	{ NULL }
+};
+
+// Actions without arguments have none here.
+static struct argument *argument_list[] = {
+	[PLAYLIST_CMD_SETREPEAT] =          arguments_value_repeat_in,
+	[PLAYLIST_CMD_REPEAT] =             arguments_value_repeat_out,
+	[PLAYLIST_CMD_SETSHUFFLE] =         arguments_value_shuffle_in,
+	[PLAYLIST_CMD_SHUFFLE] =            arguments_value_shuffle_out,
+	[PLAYLIST_CMD_SEEKSECONDABSOLUTE] = arguments_seek_second_absolute,
+	[PLAYLIST_CMD_SEEKSECONDRELATIVE] = arguments_seek_second_relative,
+	[PLAYLIST_CMD_SEEKID] =             arguments_value_id_in,
+	[PLAYLIST_CMD_SEEKINDEX] =          arguments_seek_index,
+	[PLAYLIST_CMD_TRANSPORTSTATE] =     arguments_transport_state,
+	[PLAYLIST_CMD_ID] =                 arguments_value_id_out,
+	[PLAYLIST_CMD_READ] =               arguments_read,
+	[PLAYLIST_CMD_READLIST] =           arguments_read_list,
+	[PLAYLIST_CMD_INSERT] =             arguments_insert,
+	[PLAYLIST_CMD_DELETEID] =           arguments_value_id_in,
+	[PLAYLIST_CMD_TRACKSMAX] =          arguments_tracks_max,
+	[PLAYLIST_CMD_IDARRAY] =            arguments_id_array,
+	[PLAYLIST_CMD_IDARRAYCHANGED] =     arguments_id_array_changed,
+	[PLAYLIST_CMD_PROTOCOLINFO] =       arguments_protocol_info,
+	[PLAYLIST_CMD_COUNT] = NULL
+};
+
+static variable_container_t *state_variables_ = NULL;
+
+// The renderer's transport, which plays its queue.
+static struct upnp_transport *transport_ = NULL;
+static struct play_queue *queue_ = NULL;
+
+// Changes with every change of the IdArray, so that controllers can check
+// with IdArrayChanged() if they need to read it again.
+static unsigned int id_array_token_ = 0;
+
+/* protects state_variables_ and id_array_token_. To be taken after the
+   transport lock, if both are needed. */
+static pthread_mutex_t playlist_mutex;
+
+static void service_lock_at(const char *call_site)
+{
+	LockProfile_lock(upnp_ohplaylist_get_service()->lock_profile,
+			 &playlist_mutex, call_site);
+}
+#define service_lock() service_lock_at(__func__)
+
+static void service_unlock(void)
+{
+	LockProfile_unlock(upnp_ohplaylist_get_service()->lock_profile,
+			   &playlist_mutex);
+}
+
+static int replace_var(playlist_variable_t varnum, const char *new_value) {
+	return VariableContainer_change(state_variables_, varnum, new_value);
+}
+
+static const char *get_var(playlist_variable_t varnum) {
+	return VariableContainer_get(state_variables_, varnum, NULL);
+}
+
+static int parse_bool(const char *value) {
+	return (strcmp(value, "1") == 0 || strcasecmp(value, "true") == 0
+		|| strcasecmp(value, "yes") == 0);
+}
+
+// Sets an error if there is one. Returns what to return from the action.
+static int transport_result(struct action_event *event, int rc) {
+	if (rc == 0)
+		return 0;
+	upnp_set_error(event, rc, "Not possible right now");
+	return -1;
+}
+
+// -- Following the play queue and the transport.
+
+// Called by the play queue whenever it changed.
+static void update_from_queue(void *userdata) {
+	(void)userdata;
+	unsigned int *ids;
+	const int count = PlayQueue_ids(queue_, &ids);
+	// The IdArray is the ids as 32 bit big endian numbers, base64 encoded.
+	guchar *buffer = (guchar*) malloc(4 * count + 1);
+	for (int i = 0; i < count; ++i) {
+		buffer[4*i + 0] = (ids[i] >> 24) & 0xff;
+		buffer[4*i + 1] = (ids[i] >> 16) & 0xff;
+		buffer[4*i + 2] = (ids[i] >> 8) & 0xff;
+		buffer[4*i + 3] = ids[i] & 0xff;
+	}
+	gchar *id_array = g_base64_encode(buffer, 4 * count);
+	free(buffer);
+
+	const int current = PlayQueue_current(queue_);
+	char id[16];
+	snprintf(id, sizeof(id), "%u",
+		 current >= 0 && current < count ? ids[current] : 0);
+	free(ids);
+
+	service_lock();
+	if (replace_var(PLAYLIST_VAR_ID_ARRAY, id_array))
+		++id_array_token_;
+	replace_var(PLAYLIST_VAR_ID, id);
+	service_unlock();
+	g_free(id_array);
+}
+
+// Called by the transport service, with its lock held.
+static void update_from_transport(void *userdata,
+				  int var_num, const char *var_name,
+				  const char *old_value,
+				  const char *new_value) {
+	(void)userdata;
+	(void)var_num;
+	(void)old_value;
+	if (strcmp(var_name, "CurrentPlayMode") == 0) {
+		service_lock();
+		replace_var(PLAYLIST_VAR_REPEAT,
+			    strcmp(new_value, "REPEAT_ALL") == 0
+			    ? "true" : "false");
+		service_unlock();
+		return;
+	}
+	if (strcmp(var_name, "TransportState") != 0)
+		return;
+	const char *state = "Stopped";
+	if (strcmp(new_value, "PLAYING") == 0)
+		state = "Playing";
+	else if (strcmp(new_value, "PAUSED_PLAYBACK") == 0)
+		state = "Paused";
+	else if (strcmp(new_value, "TRANSITIONING") == 0)
+		state = "Buffering";
+	service_lock();
+	replace_var(PLAYLIST_VAR_TRANSPORT_STATE, state);
+	service_unlock();
+}
+
+/* UPnP action handlers */
+
+static int play(struct action_event *event) {
+	return transport_result(event,
+				upnp_transport_queue_play(transport_, -1));
+}
+
+static int pause_stream(struct action_event *event) {
+	return transport_result(event, upnp_transport_pause(transport_));
+}
+
+static int stop(struct action_event *event) {
+	return transport_result(event, upnp_transport_stop(transport_));
+}
+
+static int next(struct action_event *event) {
+	return transport_result(event,
+				upnp_transport_queue_skip(transport_, 1));
+}
+
+static int previous(struct action_event *event) {
+	return transport_result(event,
+				upnp_transport_queue_skip(transport_, -1));
+}
+
+// Repeat is the transport's REPEAT_ALL play mode; our variable follows it.
+static int set_repeat(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	return transport_result(event, upnp_transport_set_play_mode(transport_,
+					parse_bool(value) ? "REPEAT_ALL"
+					: "NORMAL"));
+}
+
+static int get_repeat(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_REPEAT, "Value");
+	return 0;
+}
+
+// We always play in order, so Shuffle stays false; turning it off is fine.
+static int set_shuffle(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	if (parse_bool(value)) {
+		upnp_set_error(event, UPNP_SOAP_E_ACTION_FAILED,
+			       "Shuffle not supported");
+		return -1;
+	}
+	return 0;
+}
+
+static int get_shuffle(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_SHUFFLE, "Value");
+	return 0;
+}
+
+static int seek_second(struct action_event *event, int relative) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	return transport_result(event, upnp_transport_seek_seconds(transport_,
+					atol(value), relative));
+}
+
+static int seek_second_absolute(struct action_event *event) {
+	return seek_second(event, 0);
+}
+
+static int seek_second_relative(struct action_event *event) {
+	return seek_second(event, 1);
+}
+
+static int seek_id(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	const int index = PlayQueue_index_of(queue_, strtoul(value, NULL, 10));
+	if (index < 0) {
+		upnp_set_error(event, OH_PLAYLIST_E_INVALID_ID,
+			       "Id %s not found", value);
+		return -1;
+	}
+	return transport_result(event,
+				upnp_transport_queue_play(transport_, index));
+}
+
+static int seek_index(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	const int index = atoi(value);
+	if (index < 0 || index >= PlayQueue_length(queue_)) {
+		upnp_set_error(event, OH_PLAYLIST_E_INVALID_INDEX,
+			       "Index %s out of range", value);
+		return -1;
+	}
+	return transport_result(event,
+				upnp_transport_queue_play(transport_, index));
+}
+
+static int get_transport_state(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_TRANSPORT_STATE, "Value");
+	return 0;
+}
+
+static int get_id(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_ID, "Value");
+	return 0;
+}
+
+static int read_entry(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Id");
+	if (value == NULL)
+		return -1;
+	struct play_queue_entry entry;
+	const int index = PlayQueue_index_of(queue_, strtoul(value, NULL, 10));
+	if (index < 0 || PlayQueue_get(queue_, index, &entry) != 0) {
+		upnp_set_error(event, OH_PLAYLIST_E_INVALID_ID,
+			       "Id %s not found", value);
+		return -1;
+	}
+	upnp_add_response(event, "Uri", entry.uri);
+	upnp_add_response(event, "Metadata", entry.meta);
+	PlayQueue_entry_clear(&entry);
+	return 0;
+}
+
+// Returns <TrackList><Entry><Id/><Uri/><Metadata/></Entry>...</TrackList>
+// for the space separated ids. Ids not in the queue are left out.
+static int read_list(struct action_event *event) {
+	const char *value = upnp_get_string(event, "IdList");
+	if (value == NULL)
+		return -1;
+	struct xmldoc *doc = xmldoc_new();
+	struct xmlelement *top = xmldoc_new_topelement(doc, "TrackList", NULL);
+	char *end;
+	for (;;) {
+		const unsigned long id = strtoul(value, &end, 10);
+		if (end == value)
+			break;
+		value = end;
+		struct play_queue_entry entry;
+		const int index = PlayQueue_index_of(queue_, id);
+		if (index < 0 || PlayQueue_get(queue_, index, &entry) != 0)
+			continue;
+		struct xmlelement *track = xmlelement_new(doc, "Entry");
+		add_value_element_long(doc, track, "Id", entry.id);
+		add_value_element(doc, track, "Uri", entry.uri);
+		add_value_element(doc, track, "Metadata", entry.meta);
+		xmlelement_add_element(doc, top, track);
+		PlayQueue_entry_clear(&entry);
+	}
+	char *track_list = xmlelement_tostring(top);
+	upnp_add_response(event, "TrackList", track_list);
+	free(track_list);
+	xmldoc_free(doc);
+	return 0;
+}
+
+static int insert(struct action_event *event) {
+	const char *after_id = upnp_get_string(event, "AfterId");
+	const char *uri = upnp_get_string(event, "Uri");
+	const char *meta = upnp_get_string(event, "Metadata");
+	if (after_id == NULL || uri == NULL || meta == NULL)
+		return -1;
+	if (PlayQueue_length(queue_) >= PLAYLIST_TRACKS_MAX) {
+		upnp_set_error(event, OH_PLAYLIST_E_PLAYLIST_FULL,
+			       "Playlist full");
+		return -1;
+	}
+	const unsigned int id = PlayQueue_insert(queue_,
+						 strtoul(after_id, NULL, 10),
+						 uri, meta);
+	if (id == 0) {
+		upnp_set_error(event, OH_PLAYLIST_E_INVALID_ID,
+			       "Id %s not found", after_id);
+		return -1;
+	}
+	upnp_transport_queue_changed(transport_);
+	char new_id[16];
+	snprintf(new_id, sizeof(new_id), "%u", id);
+	upnp_add_response(event, "NewId", new_id);
+	return 0;
+}
+
+static int delete_id(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	// Deleting an id that is gone already is fine; a controller might
+	// just not have seen the change yet.
+	if (PlayQueue_delete(queue_, strtoul(value, NULL, 10)) == 0)
+		upnp_transport_queue_changed(transport_);
+	return 0;
+}
+
+static int delete_all(struct action_event *event) {
+	(void)event;
+	PlayQueue_clear(queue_);
+	upnp_transport_queue_changed(transport_);
+	return 0;
+}
+
+static int get_tracks_max(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_TRACKS_MAX, "Value");
+	return 0;
+}
+
+static int get_id_array(struct action_event *event) {
+	char token[16];
+	service_lock();
+	snprintf(token, sizeof(token), "%u", id_array_token_);
+	upnp_add_response(event, "Token", token);
+	upnp_add_response(event, "Array", get_var(PLAYLIST_VAR_ID_ARRAY));
+	service_unlock();
+	return 0;
+}
+
+static int id_array_changed(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Token");
+	if (value == NULL)
+		return -1;
+	service_lock();
+	const int changed = (strtoul(value, NULL, 10) != id_array_token_);
+	service_unlock();
+	upnp_add_response(event, "Value", changed ? "true" : "false");
+	return 0;
+}
+
+static int get_protocol_info(struct action_event *event) {
+	upnp_append_variable(event, PLAYLIST_VAR_PROTOCOL_INFO, "Value");
+	return 0;
+}
+
+static struct action playlist_actions[] = {
+	[PLAYLIST_CMD_PLAY] =               {"Play", play},
+	[PLAYLIST_CMD_PAUSE] =              {"Pause", pause_stream},
+	[PLAYLIST_CMD_STOP] =               {"Stop", stop},
+	[PLAYLIST_CMD_NEXT] =               {"Next", next},
+	[PLAYLIST_CMD_PREVIOUS] =           {"Previous", previous},
+	[PLAYLIST_CMD_SETREPEAT] =          {"SetRepeat", set_repeat},
+	[PLAYLIST_CMD_REPEAT] =             {"Repeat", get_repeat},
+	[PLAYLIST_CMD_SETSHUFFLE] =         {"SetShuffle", set_shuffle},
+	[PLAYLIST_CMD_SHUFFLE] =            {"Shuffle", get_shuffle},
+	[PLAYLIST_CMD_SEEKSECONDABSOLUTE] = {"SeekSecondAbsolute", seek_second_absolute},
+	[PLAYLIST_CMD_SEEKSECONDRELATIVE] = {"SeekSecondRelative", seek_second_relative},
+	[PLAYLIST_CMD_SEEKID] =             {"SeekId", seek_id},
+	[PLAYLIST_CMD_SEEKINDEX] =          {"SeekIndex", seek_index},
+	[PLAYLIST_CMD_TRANSPORTSTATE] =     {"TransportState", get_transport_state},
+	[PLAYLIST_CMD_ID] =                 {"Id", get_id},
+	[PLAYLIST_CMD_READ] =               {"Read", read_entry},
+	[PLAYLIST_CMD_READLIST] =           {"ReadList", read_list},
+	[PLAYLIST_CMD_INSERT] =             {"Insert", insert},
+	[PLAYLIST_CMD_DELETEID] =           {"DeleteId", delete_id},
+	[PLAYLIST_CMD_DELETEALL] =          {"DeleteAll", delete_all},
+	[PLAYLIST_CMD_TRACKSMAX] =          {"TracksMax", get_tracks_max},
+	[PLAYLIST_CMD_IDARRAY] =            {"IdArray", get_id_array},
+	[PLAYLIST_CMD_IDARRAYCHANGED] =     {"IdArrayChanged", id_array_changed},
+	[PLAYLIST_CMD_PROTOCOLINFO] =       {"ProtocolInfo", get_protocol_info},
+
+	[PLAYLIST_CMD_COUNT] =              {NULL, NULL}
+};
+
+struct service *upnp_ohplaylist_get_service(void) {
+	static struct service playlist_service_ = {
+		.service_mutex =        &playlist_mutex,
+		.service_id =           PLAYLIST_SERVICE_ID,
+		.service_type =         PLAYLIST_TYPE,
+		.scpd_url =		PLAYLIST_SCPD_URL,
+		.control_url =		PLAYLIST_CONTROL_URL,
+		.event_url =		PLAYLIST_EVENT_URL,
+		.event_xml_ns =         NULL,  // Not using LastChange.
+		.actions =              playlist_actions,
+		.action_arguments =     argument_list,
+		.variable_container =   NULL, // set later.
+		.last_change =          NULL,
+		.command_count =        PLAYLIST_CMD_COUNT,
+	};
+
+	static struct var_meta playlist_var_meta[] = {
+		{ PLAYLIST_VAR_TRANSPORT_STATE, "TransportState", "Stopped",
+		  EV_YES, DATATYPE_STRING, transport_states, NULL },
+		{ PLAYLIST_VAR_REPEAT, "Repeat", "false",
+		  EV_YES, DATATYPE_BOOLEAN, NULL, NULL },
+		{ PLAYLIST_VAR_SHUFFLE, "Shuffle", "false",
+		  EV_YES, DATATYPE_BOOLEAN, NULL, NULL },
+		{ PLAYLIST_VAR_ID, "Id", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ PLAYLIST_VAR_ID_ARRAY, "IdArray", "",
+		  EV_YES, DATATYPE_BIN_BASE64, NULL, NULL },
+		{ PLAYLIST_VAR_TRACKS_MAX, "TracksMax", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ PLAYLIST_VAR_PROTOCOL_INFO, "ProtocolInfo", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_URI, "A_ARG_Uri", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_METADATA, "A_ARG_Metadata", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_RELATIVE, "A_ARG_Relative", "0",
+		  EV_NO, DATATYPE_I4, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_ABSOLUTE, "A_ARG_Absolute", "0",
+		  EV_NO, DATATYPE_UI4, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_INDEX, "A_ARG_Index", "0",
+		  EV_NO, DATATYPE_UI4, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_ID_ARRAY_TOKEN, "A_ARG_IdArrayToken", "0",
+		  EV_NO, DATATYPE_UI4, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_ID_ARRAY_CHANGED, "A_ARG_IdArrayChanged",
+		  "false", EV_NO, DATATYPE_BOOLEAN, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_ID_LIST, "A_ARG_IdList", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+		{ PLAYLIST_VAR_AARG_TRACK_LIST, "A_ARG_TrackList", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+
+		{ PLAYLIST_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
+	};
+
+	if (playlist_service_.variable_container == NULL) {
+		state_variables_ = VariableContainer_new(PLAYLIST_VAR_COUNT,
+							 playlist_var_meta);
+		playlist_service_.variable_container = state_variables_;
+		playlist_service_.lock_profile = LockProfile_new("ohplaylist");
+	}
+	return &playlist_service_;
+}
+
+void upnp_ohplaylist_init(struct upnp_device *device,
+			  struct upnp_transport *transport) {
+	struct service *service = upnp_ohplaylist_get_service();
+	transport_ = transport;
+	queue_ = upnp_transport_get_queue(transport);
+	char tracks_max[16];
+	snprintf(tracks_max, sizeof(tracks_max), "%d", PLAYLIST_TRACKS_MAX);
+	replace_var(PLAYLIST_VAR_TRACKS_MAX, tracks_max);
+	replace_var(PLAYLIST_VAR_PROTOCOL_INFO,
+		    connmgr_get_sink_protocol_info());
+	UPnPVariableEventer_new(service->variable_container, device,
+				PLAYLIST_SERVICE_ID);
+
+	PlayQueue_register_listener(queue_, update_from_queue, NULL);
+	upnp_transport_register_variable_listener(transport_,
+						  update_from_transport, NULL);
+	update_from_queue(NULL);
+}
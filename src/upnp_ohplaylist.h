@@ -0,0 +1,41 @@
+/* upnp_ohplaylist.h - OpenHome Playlist service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _UPNP_OHPLAYLIST_H
+#define _UPNP_OHPLAYLIST_H
+
+// The OpenHome Playlist service: controllers edit the play queue and
+// tell us to play from it, instead of handing over one track at a time
+// via AVTransport. Changes to the list, the current track and the
+// transport state are evented, so controllers don't need to poll.
+
+struct service;
+struct upnp_device;
+struct upnp_transport;
+
+// There is only one; OpenHome is not offered with zones.
+struct service *upnp_ohplaylist_get_service(void);
+void upnp_ohplaylist_init(struct upnp_device *,
+			  struct upnp_transport *transport);
+
+#endif /* _UPNP_OHPLAYLIST_H */
@@ -0,0 +1,441 @@
+/* upnp_ohproduct.c - OpenHome Product service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "upnp_ohproduct.h"
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <upnp.h>
+#include <pthread.h>
+
+#include "lockprof.h"
+#include "upnp_service.h"
+#include "upnp_device.h"
+#include "upnp_transport.h"
+#include "variable-container.h"
+
+#define PRODUCT_TYPE "urn:av-openhome-org:service:Product:1"
+#define PRODUCT_SERVICE_ID "urn:av-openhome-org:serviceId:Product"
+
+#define PRODUCT_SCPD_URL "/upnp/ohproductSCPD.xml"
+#define PRODUCT_CONTROL_URL "/upnp/control/ohproduct1"
+#define PRODUCT_EVENT_URL "/upnp/event/ohproduct1"
+
+// Our only source is the Playlist.
+#define SOURCE_NAME "Playlist"
+#define SOURCE_TYPE "Playlist"
+#define SOURCE_XML "<SourceList><Source><Name>" SOURCE_NAME "</Name>" \
+	"<Type>" SOURCE_TYPE "</Type><Visible>true</Visible></Source>"	\
+	"</SourceList>"
+
+enum {
+	PRODUCT_CMD_MANUFACTURER,
+	PRODUCT_CMD_MODEL,
+	PRODUCT_CMD_PRODUCT,
+	PRODUCT_CMD_STANDBY,
+	PRODUCT_CMD_SETSTANDBY,
+	PRODUCT_CMD_SOURCECOUNT,
+	PRODUCT_CMD_SOURCEXML,
+	PRODUCT_CMD_SOURCEINDEX,
+	PRODUCT_CMD_SETSOURCEINDEX,
+	PRODUCT_CMD_SETSOURCEINDEXBYNAME,
+	PRODUCT_CMD_SOURCE,
+	PRODUCT_CMD_ATTRIBUTES,
+	PRODUCT_CMD_SOURCEXMLCHANGECOUNT,
+	PRODUCT_CMD_COUNT
+};
+
+// Error codes as used by OpenHome devices.
+enum OHProductError {
+	OH_PRODUCT_E_INVALID_SOURCE	= 800,
+};
+
+typedef enum {
+	PRODUCT_VAR_MANUFACTURER_NAME,
+	PRODUCT_VAR_MANUFACTURER_INFO,
+	PRODUCT_VAR_MANUFACTURER_URL,
+	PRODUCT_VAR_MANUFACTURER_IMAGE_URI,
+	PRODUCT_VAR_MODEL_NAME,
+	PRODUCT_VAR_MODEL_INFO,
+	PRODUCT_VAR_MODEL_URL,
+	PRODUCT_VAR_MODEL_IMAGE_URI,
+	PRODUCT_VAR_PRODUCT_ROOM,
+	PRODUCT_VAR_PRODUCT_NAME,
+	PRODUCT_VAR_PRODUCT_INFO,
+	PRODUCT_VAR_PRODUCT_URL,
+	PRODUCT_VAR_PRODUCT_IMAGE_URI,
+	PRODUCT_VAR_STANDBY,
+	PRODUCT_VAR_SOURCE_INDEX,
+	PRODUCT_VAR_SOURCE_COUNT,
+	PRODUCT_VAR_SOURCE_XML,
+	PRODUCT_VAR_ATTRIBUTES,
+	PRODUCT_VAR_AARG_SOURCE_NAME,
+	PRODUCT_VAR_AARG_SOURCE_TYPE,
+	PRODUCT_VAR_AARG_SOURCE_VISIBLE,
+	PRODUCT_VAR_AARG_SOURCE_XML_CHANGE_COUNT,
+	PRODUCT_VAR_COUNT
+} product_variable_t;
+
+static struct argument arguments_manufacturer[] = {
+	{ "Name", PARAM_DIR_OUT, PRODUCT_VAR_MANUFACTURER_NAME },
+	{ "Info", PARAM_DIR_OUT, PRODUCT_VAR_MANUFACTURER_INFO },
+	{ "Url", PARAM_DIR_OUT, PRODUCT_VAR_MANUFACTURER_URL },
+	{ "ImageUri", PARAM_DIR_OUT, PRODUCT_VAR_MANUFACTURER_IMAGE_URI },
+	{ NULL }
+};
+static struct argument arguments_model[] = {
+	{ "Name", PARAM_DIR_OUT, PRODUCT_VAR_MODEL_NAME },
+	{ "Info", PARAM_DIR_OUT, PRODUCT_VAR_MODEL_INFO },
+	{ "Url", PARAM_DIR_OUT, PRODUCT_VAR_MODEL_URL },
+	{ "ImageUri", PARAM_DIR_OUT, PRODUCT_VAR_MODEL_IMAGE_URI },
+	{ NULL }
+};
+static struct argument arguments_product[] = {
+	{ "Room", PARAM_DIR_OUT, PRODUCT_VAR_PRODUCT_ROOM },
+	{ "Name", PARAM_DIR_OUT, PRODUCT_VAR_PRODUCT_NAME },
+	{ "Info", PARAM_DIR_OUT, PRODUCT_VAR_PRODUCT_INFO },
+	{ "Url", PARAM_DIR_OUT, PRODUCT_VAR_PRODUCT_URL },
+	{ "ImageUri", PARAM_DIR_OUT, PRODUCT_VAR_PRODUCT_IMAGE_URI },
+	{ NULL }
+};
+static struct argument arguments_standby[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_STANDBY },
+	{ NULL }
+};
+static struct argument arguments_set_standby[] = {
+	{ "Value", PARAM_DIR_IN, PRODUCT_VAR_STANDBY },
+	{ NULL }
+};
+static struct argument arguments_source_count[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_SOURCE_COUNT },
+	{ NULL }
+};
+static struct argument arguments_source_xml[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_SOURCE_XML },
+	{ NULL }
+};
+static struct argument arguments_source_index[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_SOURCE_INDEX },
+	{ NULL }
+};
+static struct argument arguments_set_source_index[] = {
+	{ "Value", PARAM_DIR_IN, PRODUCT_VAR_SOURCE_INDEX },
+	{ NULL }
+};
+static struct argument arguments_set_source_index_by_name[] = {
+	{ "Value", PARAM_DIR_IN, PRODUCT_VAR_AARG_SOURCE_NAME },
+	{ NULL }
+};
+static struct argument arguments_source[] = {
+	{ "Index", PARAM_DIR_IN, PRODUCT_VAR_SOURCE_INDEX },
+	{ "SystemName", PARAM_DIR_OUT, PRODUCT_VAR_AARG_SOURCE_NAME },
+	{ "Type", PARAM_DIR_OUT, PRODUCT_VAR_AARG_SOURCE_TYPE },
+	{ "Name", PARAM_DIR_OUT, PRODUCT_VAR_AARG_SOURCE_NAME },
+	{ "Visible", PARAM_DIR_OUT, PRODUCT_VAR_AARG_SOURCE_VISIBLE },
+	{ NULL }
+};
+static struct argument arguments_attributes[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_ATTRIBUTES },
+	{ NULL }
+};
+static struct argument arguments_source_xml_change_count[] = {
+	{ "Value", PARAM_DIR_OUT, PRODUCT_VAR_AARG_SOURCE_XML_CHANGE_COUNT },
+	{ NULL }
+};
+
+static struct argument *argument_list[] = {
+	[PRODUCT_CMD_MANUFACTURER] =         arguments_manufacturer,
+	[PRODUCT_CMD_MODEL] =                arguments_model,
+	[PRODUCT_CMD_PRODUCT] =              arguments_product,
+	[PRODUCT_CMD_STANDBY] =              arguments_standby,
+	[PRODUCT_CMD_SETSTANDBY] =           arguments_set_standby,
+	[PRODUCT_CMD_SOURCECOUNT] =          arguments_source_count,
+	[PRODUCT_CMD_SOURCEXML] =            arguments_source_xml,
+	[PRODUCT_CMD_SOURCEINDEX] =          arguments_source_index,
+	[PRODUCT_CMD_SETSOURCEINDEX] =       arguments_set_source_index,
+	[PRODUCT_CMD_SETSOURCEINDEXBYNAME] = arguments_set_source_index_by_name,
+	[PRODUCT_CMD_SOURCE] =               arguments_source,
+	[PRODUCT_CMD_ATTRIBUTES] =           arguments_attributes,
+	[PRODUCT_CMD_SOURCEXMLCHANGECOUNT] = arguments_source_xml_change_count,
+	[PRODUCT_CMD_COUNT] = NULL
+};
+
+static variable_container_t *state_variables_ = NULL;
+
+// Stopped on standby.
+static struct upnp_transport *transport_ = NULL;
+
+/* protects state_variables_ */
+static pthread_mutex_t product_mutex;
+
+static void service_lock_at(const char *call_site)
+{
+	LockProfile_lock(upnp_ohproduct_get_service()->lock_profile,
+			 &product_mutex, call_site);
+}
+#define service_lock() service_lock_at(__func__)
+
+static void service_unlock(void)
+{
+	LockProfile_unlock(upnp_ohproduct_get_service()->lock_profile,
+			   &product_mutex);
+}
+
+static int replace_var(product_variable_t varnum, const char *new_value) {
+	return VariableContainer_change(state_variables_, varnum, new_value);
+}
+
+/* UPnP action handlers */
+
+static int get_manufacturer(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_MANUFACTURER_NAME, "Name");
+	upnp_append_variable(event, PRODUCT_VAR_MANUFACTURER_INFO, "Info");
+	upnp_append_variable(event, PRODUCT_VAR_MANUFACTURER_URL, "Url");
+	upnp_append_variable(event, PRODUCT_VAR_MANUFACTURER_IMAGE_URI,
+			     "ImageUri");
+	return 0;
+}
+
+static int get_model(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_MODEL_NAME, "Name");
+	upnp_append_variable(event, PRODUCT_VAR_MODEL_INFO, "Info");
+	upnp_append_variable(event, PRODUCT_VAR_MODEL_URL, "Url");
+	upnp_append_variable(event, PRODUCT_VAR_MODEL_IMAGE_URI, "ImageUri");
+	return 0;
+}
+
+static int get_product(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_PRODUCT_ROOM, "Room");
+	upnp_append_variable(event, PRODUCT_VAR_PRODUCT_NAME, "Name");
+	upnp_append_variable(event, PRODUCT_VAR_PRODUCT_INFO, "Info");
+	upnp_append_variable(event, PRODUCT_VAR_PRODUCT_URL, "Url");
+	upnp_append_variable(event, PRODUCT_VAR_PRODUCT_IMAGE_URI, "ImageUri");
+	return 0;
+}
+
+static int get_standby(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_STANDBY, "Value");
+	return 0;
+}
+
+// We don't have a standby of our own; going there stops playing.
+static int set_standby(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	const int standby = (strcmp(value, "1") == 0
+			     || strcasecmp(value, "true") == 0);
+	if (standby)
+		upnp_transport_stop(transport_);
+	service_lock();
+	replace_var(PRODUCT_VAR_STANDBY, standby ? "true" : "false");
+	service_unlock();
+	return 0;
+}
+
+static int get_source_count(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_SOURCE_COUNT, "Value");
+	return 0;
+}
+
+static int get_source_xml(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_SOURCE_XML, "Value");
+	return 0;
+}
+
+static int get_source_index(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_SOURCE_INDEX, "Value");
+	return 0;
+}
+
+static int set_source_index(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	if (strcmp(value, "0") != 0) {
+		upnp_set_error(event, OH_PRODUCT_E_INVALID_SOURCE,
+			       "No source %s", value);
+		return -1;
+	}
+	return 0;
+}
+
+static int set_source_index_by_name(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Value");
+	if (value == NULL)
+		return -1;
+	if (strcmp(value, SOURCE_NAME) != 0) {
+		upnp_set_error(event, OH_PRODUCT_E_INVALID_SOURCE,
+			       "No source '%s'", value);
+		return -1;
+	}
+	return 0;
+}
+
+static int get_source(struct action_event *event) {
+	const char *value = upnp_get_string(event, "Index");
+	if (value == NULL)
+		return -1;
+	if (strcmp(value, "0") != 0) {
+		upnp_set_error(event, OH_PRODUCT_E_INVALID_SOURCE,
+			       "No source %s", value);
+		return -1;
+	}
+	upnp_add_response(event, "SystemName", SOURCE_NAME);
+	upnp_add_response(event, "Type", SOURCE_TYPE);
+	upnp_add_response(event, "Name", SOURCE_NAME);
+	upnp_add_response(event, "Visible", "true");
+	return 0;
+}
+
+static int get_attributes(struct action_event *event) {
+	upnp_append_variable(event, PRODUCT_VAR_ATTRIBUTES, "Value");
+	return 0;
+}
+
+static int get_source_xml_change_count(struct action_event *event) {
+	// Our sources never change.
+	upnp_add_response(event, "Value", "0");
+	return 0;
+}
+
+static struct action product_actions[] = {
+	[PRODUCT_CMD_MANUFACTURER] =         {"Manufacturer", get_manufacturer},
+	[PRODUCT_CMD_MODEL] =                {"Model", get_model},
+	[PRODUCT_CMD_PRODUCT] =              {"Product", get_product},
+	[PRODUCT_CMD_STANDBY] =              {"Standby", get_standby},
+	[PRODUCT_CMD_SETSTANDBY] =           {"SetStandby", set_standby},
+	[PRODUCT_CMD_SOURCECOUNT] =          {"SourceCount", get_source_count},
+	[PRODUCT_CMD_SOURCEXML] =            {"SourceXml", get_source_xml},
+	[PRODUCT_CMD_SOURCEINDEX] =          {"SourceIndex", get_source_index},
+	[PRODUCT_CMD_SETSOURCEINDEX] =       {"SetSourceIndex", set_source_index},
+	[PRODUCT_CMD_SETSOURCEINDEXBYNAME] = {"SetSourceIndexByName", set_source_index_by_name},
+	[PRODUCT_CMD_SOURCE] =               {"Source", get_source},
+	[PRODUCT_CMD_ATTRIBUTES] =           {"Attributes", get_attributes},
+	[PRODUCT_CMD_SOURCEXMLCHANGECOUNT] = {"SourceXmlChangeCount", get_source_xml_change_count},
+	[PRODUCT_CMD_COUNT] =                {NULL, NULL}
+};
+
+struct service *upnp_ohproduct_get_service(void) {
+	static struct service product_service_ = {
+		.service_mutex =        &product_mutex,
+		.service_id =           PRODUCT_SERVICE_ID,
+		.service_type =         PRODUCT_TYPE,
+		.scpd_url =		PRODUCT_SCPD_URL,
+		.control_url =		PRODUCT_CONTROL_URL,
+		.event_url =		PRODUCT_EVENT_URL,
+		.event_xml_ns =         NULL,  // Not using LastChange.
+		.actions =              product_actions,
+		.action_arguments =     argument_list,
+		.variable_container =   NULL, // set later.
+		.last_change =          NULL,
+		.command_count =        PRODUCT_CMD_COUNT,
+	};
+
+	static struct var_meta product_var_meta[] = {
+		{ PRODUCT_VAR_MANUFACTURER_NAME, "ManufacturerName", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MANUFACTURER_INFO, "ManufacturerInfo", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MANUFACTURER_URL, "ManufacturerUrl", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MANUFACTURER_IMAGE_URI, "ManufacturerImageUri", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MODEL_NAME, "ModelName", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MODEL_INFO, "ModelInfo", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MODEL_URL, "ModelUrl", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_MODEL_IMAGE_URI, "ModelImageUri", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_PRODUCT_ROOM, "ProductRoom", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_PRODUCT_NAME, "ProductName", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_PRODUCT_INFO, "ProductInfo", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_PRODUCT_URL, "ProductUrl", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_PRODUCT_IMAGE_URI, "ProductImageUri", "",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_STANDBY, "Standby", "false",
+		  EV_YES, DATATYPE_BOOLEAN, NULL, NULL },
+		{ PRODUCT_VAR_SOURCE_INDEX, "SourceIndex", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ PRODUCT_VAR_SOURCE_COUNT, "SourceCount", "1",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ PRODUCT_VAR_SOURCE_XML, "SourceXml", SOURCE_XML,
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		// The other OpenHome services we have.
+		{ PRODUCT_VAR_ATTRIBUTES, "Attributes", "Info Time",
+		  EV_YES, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_AARG_SOURCE_NAME, "A_ARG_SourceName", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_AARG_SOURCE_TYPE, "A_ARG_SourceType", "",
+		  EV_NO, DATATYPE_STRING, NULL, NULL },
+		{ PRODUCT_VAR_AARG_SOURCE_VISIBLE, "A_ARG_SourceVisible", "true",
+		  EV_NO, DATATYPE_BOOLEAN, NULL, NULL },
+		{ PRODUCT_VAR_AARG_SOURCE_XML_CHANGE_COUNT,
+		  "A_ARG_SourceXmlChangeCount", "0",
+		  EV_NO, DATATYPE_UI4, NULL, NULL },
+
+		{ PRODUCT_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
+	};
+
+	if (product_service_.variable_container == NULL) {
+		state_variables_ = VariableContainer_new(PRODUCT_VAR_COUNT,
+							 product_var_meta);
+		product_service_.variable_container = state_variables_;
+		product_service_.lock_profile = LockProfile_new("ohproduct");
+	}
+	return &product_service_;
+}
+
+void upnp_ohproduct_init(struct upnp_device *device,
+			 const struct upnp_device_descriptor *descriptor,
+			 struct upnp_transport *transport) {
+	struct service *service = upnp_ohproduct_get_service();
+	transport_ = transport;
+	replace_var(PRODUCT_VAR_MANUFACTURER_NAME, descriptor->manufacturer);
+	replace_var(PRODUCT_VAR_MANUFACTURER_URL, descriptor->manufacturer_url);
+	replace_var(PRODUCT_VAR_MODEL_NAME, descriptor->model_name);
+	replace_var(PRODUCT_VAR_MODEL_INFO, descriptor->model_description);
+	replace_var(PRODUCT_VAR_MODEL_URL, descriptor->model_url);
+	replace_var(PRODUCT_VAR_PRODUCT_ROOM, descriptor->friendly_name);
+	replace_var(PRODUCT_VAR_PRODUCT_NAME, descriptor->friendly_name);
+	replace_var(PRODUCT_VAR_PRODUCT_INFO, descriptor->model_description);
+	replace_var(PRODUCT_VAR_PRODUCT_URL, descriptor->model_url);
+	UPnPVariableEventer_new(service->variable_container, device,
+				PRODUCT_SERVICE_ID);
+}
@@ -0,0 +1,44 @@
+/* upnp_ohproduct.h - OpenHome Product service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifndef _UPNP_OHPRODUCT_H
+#define _UPNP_OHPRODUCT_H
+
+// The OpenHome Product service. Controllers look for it to find OpenHome
+// renderers; it lists the Playlist as our only source.
+
+struct service;
+struct upnp_device;
+struct upnp_device_descriptor;
+struct upnp_transport;
+
+// There is only one; OpenHome is not offered with zones.
+struct service *upnp_ohproduct_get_service(void);
+
+// Manufacturer and model are taken from the device descriptor; its friendly
+// name is announced as the room. Standby stops "transport".
+void upnp_ohproduct_init(struct upnp_device *,
+			 const struct upnp_device_descriptor *descriptor,
+			 struct upnp_transport *transport);
+
+#endif /* _UPNP_OHPRODUCT_H */
@@ -0,0 +1,200 @@
+/* upnp_ohtime.c - OpenHome Time service
+ *
+ * Copyright (C) 2026 The GMediaRender authors
+ *
+ * This file is part of GMediaRender.
+ *
+ * GMediaRender is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * GMediaRender is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GMediaRender; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "upnp_ohtime.h"
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <upnp.h>
+#include <pthread.h>
+
+#include "lockprof.h"
+#include "upnp_service.h"
+#include "upnp_device.h"
+#include "upnp_transport.h"
+#include "variable-container.h"
+
+#define TIME_TYPE "urn:av-openhome-org:service:Time:1"
+#define TIME_SERVICE_ID "urn:av-openhome-org:serviceId:Time"
+
+#define TIME_SCPD_URL "/upnp/ohtimeSCPD.xml"
+#define TIME_CONTROL_URL "/upnp/control/ohtime1"
+#define TIME_EVENT_URL "/upnp/event/ohtime1"
+
+enum {
+	TIME_CMD_TIME,
+	TIME_CMD_COUNT
+};
+
+typedef enum {
+	TIME_VAR_TRACK_COUNT,
+	TIME_VAR_DURATION,
+	TIME_VAR_SECONDS,
+	TIME_VAR_COUNT
+} time_variable_t;
+
+static struct argument arguments_time[] = {
+	{ "TrackCount", PARAM_DIR_OUT, TIME_VAR_TRACK_COUNT },
+	{ "Duration", PARAM_DIR_OUT, TIME_VAR_DURATION },
+	{ "Seconds", PARAM_DIR_OUT, TIME_VAR_SECONDS },
+	{ NULL }
+};
+
+static struct argument *argument_list[] = {
+	[TIME_CMD_TIME] =  arguments_time,
+	[TIME_CMD_COUNT] = NULL
+};
+
+static variable_container_t *state_variables_ = NULL;
+static unsigned int track_count_ = 0;
+
+/* protects state_variables_ and track_count_. To be taken after the
+   transport lock, if both are needed. */
+static pthread_mutex_t time_mutex;
+
+static void service_lock_at(const char *call_site)
+{
+	LockProfile_lock(upnp_ohtime_get_service()->lock_profile,
+			 &time_mutex, call_site);
+}
+#define service_lock() service_lock_at(__func__)
+
+static void service_unlock(void)
+{
+	LockProfile_unlock(upnp_ohtime_get_service()->lock_profile,
+			   &time_mutex);
+}
+
+// Replace variable with the number of seconds in UPnP time "H:MM:SS".
+static void replace_seconds_var(time_variable_t varnum,
+				const char *upnp_time) {
+	int hour = 0, minute = 0, second = 0;
+	sscanf(upnp_time, "%d:%02d:%02d", &hour, &minute, &second);
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", hour * 3600 + minute * 60 + second);
+	VariableContainer_change(state_variables_, varnum, buf);
+}
+
+// Called by the transport service, with its lock held.
+static void update_from_transport(void *userdata,
+				  int var_num, const char *var_name,
+				  const char *old_value,
+				  const char *new_value) {
+	(void)userdata;
+	(void)var_num;
+	(void)old_value;
+	if (strcmp(var_name, "CurrentTrackDuration") == 0) {
+		service_lock();
+		replace_seconds_var(TIME_VAR_DURATION, new_value);
+		service_unlock();
+	} else if (strcmp(var_name, "RelativeTimePosition") == 0) {
+		service_lock();
+		replace_seconds_var(TIME_VAR_SECONDS, new_value);
+		service_unlock();
+	}
+}
+
+// Called by the transport service, with its lock held.
+static void count_track(void *userdata) {
+	(void)userdata;
+	char buf[16];
+	service_lock();
+	snprintf(buf, sizeof(buf), "%u", ++track_count_);
+	VariableContainer_change(state_variables_, TIME_VAR_TRACK_COUNT, buf);
+	service_unlock();
+}
+
+static int get_time(struct action_event *event) {
+	service_lock();
+	upnp_add_response(event, "TrackCount",
+			  VariableContainer_get(state_variables_,
+						TIME_VAR_TRACK_COUNT, NULL));
+	upnp_add_response(event, "Duration",
+			  VariableContainer_get(state_variables_,
+						TIME_VAR_DURATION, NULL));
+	upnp_add_response(event, "Seconds",
+			  VariableContainer_get(state_variables_,
+						TIME_VAR_SECONDS, NULL));
+	service_unlock();
+	return 0;
+}
+
+static struct action time_actions[] = {
+	[TIME_CMD_TIME] =  {"Time", get_time},
+	[TIME_CMD_COUNT] = {NULL, NULL}
+};
+
+struct service *upnp_ohtime_get_service(void) {
+	static struct service time_service_ = {
+		.service_mutex =        &time_mutex,
+		.service_id =           TIME_SERVICE_ID,
+		.service_type =         TIME_TYPE,
+		.scpd_url =		TIME_SCPD_URL,
+		.control_url =		TIME_CONTROL_URL,
+		.event_url =		TIME_EVENT_URL,
+		.event_xml_ns =         NULL,  // Not using LastChange.
+		.actions =              time_actions,
+		.action_arguments =     argument_list,
+		.variable_container =   NULL, // set later.
+		.last_change =          NULL,
+		.command_count =        TIME_CMD_COUNT,
+	};
+
+	static struct var_meta time_var_meta[] = {
+		{ TIME_VAR_TRACK_COUNT, "TrackCount", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ TIME_VAR_DURATION, "Duration", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+		{ TIME_VAR_SECONDS, "Seconds", "0",
+		  EV_YES, DATATYPE_UI4, NULL, NULL },
+
+		{ TIME_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
+	};
+
+	if (time_service_.variable_container == NULL) {
+		state_variables_ = VariableContainer_new(TIME_VAR_COUNT,
+							 time_var_meta);
+		time_service_.variable_container = state_variables_;
+		time_service_.lock_profile = LockProfile_new("ohtime");
+	}
+	return &time_service_;
+}
+
+void upnp_ohtime_init(struct upnp_device *device,
+		      struct upnp_transport *transport) {
+	struct service *service = upnp_ohtime_get_service();
+	UPnPVariableEventer_new(service->variable_container, device,
+				TIME_SERVICE_ID);
+	upnp_transport_register_variable_listener(transport,
+						  update_from_transport, NULL);
+	upnp_transport_register_track_listener(transport, count_track, NULL);
+}
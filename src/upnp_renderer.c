@@ -49,6 +49,10 @@
 #include "upnp_connmgr.h"
 #include "upnp_control.h"
 #include "upnp_transport.h"
+#include "upnp_ohplaylist.h"
+#include "upnp_ohtime.h"
+#include "upnp_ohinfo.h"
+#include "upnp_ohproduct.h"
 
 #include "upnp_renderer.h"
 #include "git-version.h"
@@ -76,7 +80,8 @@ static struct icon *renderer_icon[] = {
 
 static int upnp_renderer_init(void);
 
-static struct upnp_device_descriptor render_device = {
+// Each renderer starts out with a copy of this.
+static const struct upnp_device_descriptor render_device = {
 	.init_function          = upnp_renderer_init,
         .device_type            = "urn:schemas-upnp-org:device:MediaRenderer:1",
         .friendly_name          = "GMediaRender",
@@ -93,6 +98,14 @@ static struct upnp_device_descriptor render_device = {
         .mime_filter            = NULL,
         .icons                  = renderer_icon,
 	.services               = NULL,  /* set later */
+	.description_path       = NULL,
+};
+
+struct upnp_renderer {
+	struct upnp_device_descriptor descriptor;
+	struct service *services[8];
+	struct upnp_transport *transport;
+	struct upnp_control *control;
 };
 
 void upnp_renderer_dump_connmgr_scpd(void)
@@ -105,40 +118,106 @@ void upnp_renderer_dump_connmgr_scpd(void)
 void upnp_renderer_dump_control_scpd(void)
 {
 	char *buf;
-	buf = upnp_get_scpd(upnp_control_get_service());
+	buf = upnp_get_scpd(upnp_control_get_service(
+				    upnp_control_new(1, NULL)));
 	assert(buf != NULL);
 	fputs(buf, stdout);
 }
 void upnp_renderer_dump_transport_scpd(void)
 {
 	char *buf;
-	buf = upnp_get_scpd(upnp_transport_get_service());
+	buf = upnp_get_scpd(upnp_transport_get_service(
+				    upnp_transport_new(1, NULL)));
 	assert(buf != NULL);
 	fputs(buf, stdout);
 }
 
+static int openhome_ = 0;
+static const char *mime_filter_ = NULL;
+
+void upnp_renderer_enable_openhome(void)
+{
+	openhome_ = 1;
+}
+
+// The supported mime types are the same for all renderers, so this only
+// needs to run for the first one.
 static int upnp_renderer_init(void)
 {
-	static struct service *upnp_services[4];
-	upnp_services[0] = upnp_transport_get_service();
-	upnp_services[1] = upnp_connmgr_get_service();
-	upnp_services[2] = upnp_control_get_service();
-	upnp_services[3] = NULL;
-	render_device.services = upnp_services;
-	return connmgr_init(render_device.mime_filter);
+	static int connmgr_initialized = 0;
+	if (connmgr_initialized)
+		return 0;
+	connmgr_initialized = 1;
+	return connmgr_init(mime_filter_);
 }
 
-struct upnp_device_descriptor *
-upnp_renderer_descriptor(const char *friendly_name,
-			 const char *uuid,
-			 const char* mime_filter)
+struct upnp_renderer *upnp_renderer_new(int instance,
+					const char *friendly_name,
+					const char *uuid,
+					const char *mime_filter,
+					struct output *out)
 {
-	render_device.friendly_name = friendly_name;
-	render_device.mime_filter = mime_filter;
+	struct upnp_renderer *r = calloc(1, sizeof(*r));
+	r->descriptor = render_device;
+	r->descriptor.friendly_name = friendly_name;
+	r->descriptor.mime_filter = mime_filter;
+	mime_filter_ = mime_filter;
 
 	char *udn = NULL;
 	if (asprintf(&udn, "uuid:%s", uuid) > 0) {
-		render_device.udn = udn;
+		r->descriptor.udn = udn;
+	}
+	if (instance > 1) {
+		char *path = NULL;
+		if (asprintf(&path, "/upnp/description%d.xml", instance) < 0) {
+			free(r);
+			return NULL;
+		}
+		r->descriptor.description_path = path;
+	}
+
+	r->transport = upnp_transport_new(instance, out);
+	r->control = upnp_control_new(instance, out);
+	int n = 0;
+	r->services[n++] = upnp_transport_get_service(r->transport);
+	r->services[n++] = upnp_connmgr_new_service(instance);
+	r->services[n++] = upnp_control_get_service(r->control);
+	if (openhome_) {
+		// Only ever offered by a single renderer.
+		r->services[n++] = upnp_ohproduct_get_service();
+		r->services[n++] = upnp_ohplaylist_get_service();
+		r->services[n++] = upnp_ohtime_get_service();
+		r->services[n++] = upnp_ohinfo_get_service();
+	}
+	r->services[n] = NULL;
+	r->descriptor.services = r->services;
+	return r;
+}
+
+struct upnp_device_descriptor *
+upnp_renderer_get_descriptor(struct upnp_renderer *r)
+{
+	return &r->descriptor;
+}
+
+struct upnp_transport *upnp_renderer_get_transport(struct upnp_renderer *r)
+{
+	return r->transport;
+}
+
+struct upnp_control *upnp_renderer_get_control(struct upnp_renderer *r)
+{
+	return r->control;
+}
+
+void upnp_renderer_start(struct upnp_renderer *r, struct upnp_device *device)
+{
+	upnp_transport_init(r->transport, device);
+	upnp_control_init(r->control, device);
+	if (openhome_) {
+		upnp_ohproduct_init(device, &r->descriptor, r->transport);
+		upnp_ohplaylist_init(device, r->transport);
+		upnp_ohtime_init(device, r->transport);
+		upnp_ohinfo_init(device, r->transport);
 	}
-	return &render_device;
 }
@@ -28,9 +28,32 @@ void upnp_renderer_dump_connmgr_scpd(void);
 void upnp_renderer_dump_control_scpd(void);
 void upnp_renderer_dump_transport_scpd(void);
 
-// Returned pointer not owned.
-struct upnp_device_descriptor *upnp_renderer_descriptor(const char *name,
-							const char *uuid,
-							const char* mime_filter);
+// Also offer the OpenHome Product, Playlist, Time and Info services. Needs
+// to be called before the renderer is created; only for a single renderer.
+void upnp_renderer_enable_openhome(void);
+
+struct output;
+struct upnp_control;
+struct upnp_device;
+struct upnp_renderer;
+struct upnp_transport;
+
+// Renderer number "instance" (1, 2, ..), playing on "out". One process can
+// host several; each needs its own uuid. The mime filter is the same for
+// all of them.
+struct upnp_renderer *upnp_renderer_new(int instance,
+					const char *friendly_name,
+					const char *uuid,
+					const char *mime_filter,
+					struct output *out);
+
+// To register with upnp_device_init(). Returned pointer not owned.
+struct upnp_device_descriptor *
+upnp_renderer_get_descriptor(struct upnp_renderer *r);
+struct upnp_transport *upnp_renderer_get_transport(struct upnp_renderer *r);
+struct upnp_control *upnp_renderer_get_control(struct upnp_renderer *r);
+
+// Start the services once the device is registered.
+void upnp_renderer_start(struct upnp_renderer *r, struct upnp_device *device);
 
 #endif /* _UPNP_RENDERER_H */
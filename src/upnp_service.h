@@ -33,6 +33,7 @@ struct service;
 struct action_event;
 struct variable_container;
 struct upnp_last_change_collector;
+struct lock_profile;
 
 struct action {
 	const char *action_name;
@@ -57,6 +58,7 @@ typedef enum {
         DATATYPE_I4,
         DATATYPE_UI2,
         DATATYPE_UI4,
+        DATATYPE_BIN_BASE64,
         DATATYPE_UNKNOWN
 } param_datatype;
 
@@ -103,6 +105,7 @@ struct service {
 	struct variable_container *variable_container;
 	struct upnp_last_change_collector *last_change;
 	int command_count;
+	struct lock_profile *lock_profile;  // NULL unless lock profiling.
 };
 
 struct action_event {
@@ -39,20 +39,29 @@
 #include <glib.h>
 
 #include <upnp.h>
+#include <upnptools.h>
 #include <pthread.h>
 
+#include "lockprof.h"
+#include "logging.h"
+#include "metrics.h"
 #include "output.h"
+#include "play_queue.h"
+#include "upnp_connmgr.h"
 #include "upnp_service.h"
 #include "upnp_device.h"
+#include "trace.h"
 #include "variable-container.h"
+#include "xmldoc.h"
 #include "xmlescape.h"
 
 #define TRANSPORT_TYPE "urn:schemas-upnp-org:service:AVTransport:1"
 #define TRANSPORT_SERVICE_ID "urn:upnp-org:serviceId:AVTransport"
 
 #define TRANSPORT_SCPD_URL "/upnp/rendertransportSCPD.xml"
-#define TRANSPORT_CONTROL_URL "/upnp/control/rendertransport1"
-#define TRANSPORT_EVENT_URL "/upnp/event/rendertransport1"
+// With the number of the renderer; zones share the SCPD only.
+#define TRANSPORT_CONTROL_URL "/upnp/control/rendertransport%d"
+#define TRANSPORT_EVENT_URL "/upnp/event/rendertransport%d"
 
 // Namespace, see UPnP-av-AVTransport-v3-Service-20101231.pdf page 15
 #define TRANSPORT_EVENT_XML_NS "urn:schemas-upnp-org:metadata-1-0/AVT/"
@@ -70,11 +79,9 @@ enum {
 	TRANSPORT_CMD_SETAVTRANSPORTURI,
 	TRANSPORT_CMD_STOP,
 	TRANSPORT_CMD_SETNEXTAVTRANSPORTURI,
-
-	// Not implemented
-	//TRANSPORT_CMD_NEXT,
-	//TRANSPORT_CMD_PREVIOUS,
-	//TRANSPORT_CMD_SETPLAYMODE,
+	TRANSPORT_CMD_NEXT,
+	TRANSPORT_CMD_PREVIOUS,
+	TRANSPORT_CMD_SETPLAYMODE,
 	//TRANSPORT_CMD_RECORD,
 	//TRANSPORT_CMD_SETRECORDQUALITYMODE,
 
@@ -170,11 +177,11 @@ static const char *media[] = {
 static const char *playmodi[] = {
 	"NORMAL",
 	//"SHUFFLE",
-	//"REPEAT_ONE",
+	"REPEAT_ONE",
 	"REPEAT_ALL",
 	//"RANDOM",
 	//"DIRECT_1",
-	"INTRO",
+	//"INTRO",
 	NULL
 };
 
@@ -351,19 +358,19 @@ static struct argument arguments_seek[] = {
         { "Target", PARAM_DIR_IN, TRANSPORT_VAR_AAT_SEEK_TARGET },
 	{ NULL }
 };
-//static struct argument arguments_next[] = {
-//        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
-//	{ NULL }
-//};
-//static struct argument arguments_previous[] = {
-//        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
-//	{ NULL }
-//};
-//static struct argument arguments_setplaymode[] = {
-//        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
-//        { "NewPlayMode", PARAM_DIR_IN, TRANSPORT_VAR_CUR_PLAY_MODE },
-//	{ NULL }
-//};
+static struct argument arguments_next[] = {
+        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
+	{ NULL }
+};
+static struct argument arguments_previous[] = {
+        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
+	{ NULL }
+};
+static struct argument arguments_setplaymode[] = {
+        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
+        { "NewPlayMode", PARAM_DIR_IN, TRANSPORT_VAR_CUR_PLAY_MODE },
+	{ NULL }
+};
 //static struct argument arguments_setrecordqualitymode[] = {
 //        { "InstanceID", PARAM_DIR_IN, TRANSPORT_VAR_AAT_INSTANCE_ID },
 //        { "NewRecordQualityMode", PARAM_DIR_IN, TRANSPORT_VAR_CUR_REC_QUAL_MODE },
@@ -392,41 +399,86 @@ static struct argument *argument_list[] = {
 	[TRANSPORT_CMD_SETNEXTAVTRANSPORTURI] =     arguments_setnextavtransporturi,
 
 	//[TRANSPORT_CMD_RECORD] =                    arguments_record,
-	//[TRANSPORT_CMD_NEXT] =                      arguments_next,
-	//[TRANSPORT_CMD_PREVIOUS] =                  arguments_previous,
-	//[TRANSPORT_CMD_SETPLAYMODE] =               arguments_setplaymode,
+	[TRANSPORT_CMD_NEXT] =                      arguments_next,
+	[TRANSPORT_CMD_PREVIOUS] =                  arguments_previous,
+	[TRANSPORT_CMD_SETPLAYMODE] =               arguments_setplaymode,
 	//[TRANSPORT_CMD_SETRECORDQUALITYMODE] =      arguments_setrecordqualitymode,
 	[TRANSPORT_CMD_COUNT] =	NULL
 };
 
 
-// Our 'instance' variables.
-static enum transport_state transport_state_ = TRANSPORT_STOPPED;
-static variable_container_t *state_variables_ = NULL;
+// If set, SetAVTransportURI rejects URIs whose protocolInfo in the meta
+// data announces a mime type we don't support.
+static int check_mime_type_ = 0;
+
+// Rebuild the output's pipeline if the position does not move for this
+// long while PLAYING. 0: off.
+static int stall_timeout_sec_ = 0;
+
+// Informed about each track change.
+struct track_listener {
+	track_change_listener_t callback;
+	void *userdata;
+	struct track_listener *next;
+};
+
+// Our 'instance' variables; one per renderer.
+struct upnp_transport {
+	// First, so that actions get back to us from event->service.
+	struct service service;
 
-/* protects transport_values, and service-specific state */
+	// Protects the state variables and the rest of this struct.
+	pthread_mutex_t mutex;
+	variable_container_t *state_variables;
+	enum transport_state transport_state;
 
-static pthread_mutex_t transport_mutex;
+	struct output *output;
+	struct play_queue *queue;
+
+	// Set while the AVTransportURI is a playlist, played from the play
+	// queue. The output gets the next entry of the queue as its next
+	// uri, so that we don't need the controller for track changes.
+	int queue_active;
+	int queue_next_fed;  // Output's next uri is from the queue.
+	int output_loop;     // Output repeats the current track.
+
+	// check_for_stall() state.
+	gint64 stall_position;
+	int64_t stall_progress_us;  // Position last moved.
+	int64_t stall_restart_us;   // Rebuilt, not moving yet.
+
+	struct track_listener *track_listeners;
+};
 
-static void service_lock(void)
+static struct upnp_transport *transport_of(struct action_event *event)
 {
-	pthread_mutex_lock(&transport_mutex);
+	return (struct upnp_transport *) event->service;
+}
 
+// Locks the service; "call_site" shows up in the lock profile.
+static void service_lock_at(struct upnp_transport *t, const char *call_site)
+{
+	const int64_t trace_start = Trace_begin();
+	const int64_t start = Metrics_now_us();
+	LockProfile_lock(t->service.lock_profile, &t->mutex, call_site);
+	Metrics_lock_wait(METRIC_LOCK_TRANSPORT, Metrics_now_us() - start);
+	Trace_end("lock", "transport lock wait", trace_start);
 	struct upnp_last_change_collector *
-		collector = upnp_transport_get_service()->last_change;
+		collector = t->service.last_change;
 	if (collector) {
 		UPnPLastChangeCollector_start(collector);
 	}
 }
+#define service_lock(t) service_lock_at(t, __func__)
 
-static void service_unlock(void)
+static void service_unlock(struct upnp_transport *t)
 {
 	struct upnp_last_change_collector *
-		collector = upnp_transport_get_service()->last_change;
+		collector = t->service.last_change;
 	if (collector) {
 		UPnPLastChangeCollector_finish(collector);
 	}
-	pthread_mutex_unlock(&transport_mutex);
+	LockProfile_unlock(t->service.lock_profile, &t->mutex);
 }
 
 static char has_instance_id(struct action_event *event)
@@ -462,54 +514,49 @@ static int get_media_info(struct action_event *event)
 }
 
 // Replace given variable without sending an state-change event.
-static int replace_var(transport_variable_t varnum, const char *new_value) {
-	return VariableContainer_change(state_variables_, varnum, new_value);
+static int replace_var(struct upnp_transport *t, transport_variable_t varnum, const char *new_value) {
+	return VariableContainer_change(t->state_variables, varnum, new_value);
 }
 
-static const char *get_var(transport_variable_t varnum) {
-	return VariableContainer_get(state_variables_, varnum, NULL);
+static const char *get_var(struct upnp_transport *t, transport_variable_t varnum) {
+	return VariableContainer_get(t->state_variables, varnum, NULL);
+}
+
+// We only really want to send back meta data if we didn't get anything
+// useful or if this is an audio item.
+static int wants_stream_meta(const char *meta) {
+	return (strlen(meta) == 0) || strstr(meta, "object.item.audioItem");
 }
 
 // Transport uri always comes in uri/meta pairs. Set these and also the related
 // track uri/meta variables.
 // Returns 1, if this meta-data likely needs to be updated while the stream
 // is playing (e.g. radio broadcast).
-static int replace_transport_uri_and_meta(const char *uri, const char *meta) {
-	replace_var(TRANSPORT_VAR_AV_URI, uri);
-	replace_var(TRANSPORT_VAR_AV_URI_META, meta);
+static int replace_transport_uri_and_meta(struct upnp_transport *t, const char *uri, const char *meta) {
+	replace_var(t, TRANSPORT_VAR_AV_URI, uri);
+	replace_var(t, TRANSPORT_VAR_AV_URI_META, meta);
 
 	// This influences as well the tracks. If there is a non-empty URI,
 	// we have exactly one track.
 	const char *tracks = (uri != NULL && strlen(uri) > 0) ? "1" : "0";
-	replace_var(TRANSPORT_VAR_NR_TRACKS, tracks);
+	replace_var(t, TRANSPORT_VAR_NR_TRACKS, tracks);
 
-	// We only really want to send back meta data if we didn't get anything
-	// useful or if this is an audio item.
-	const int requires_stream_meta_callback = (strlen(meta) == 0)
-		|| strstr(meta, "object.item.audioItem");
-	return requires_stream_meta_callback;
+	return wants_stream_meta(meta);
 }
 
 // Similar to replace_transport_uri_and_meta() above, but current values.
-static void replace_current_uri_and_meta(const char *uri, const char *meta){
+static void replace_current_uri_and_meta(struct upnp_transport *t, const char *uri, const char *meta){
 	const char *tracks = (uri != NULL && strlen(uri) > 0) ? "1" : "0";
-	replace_var(TRANSPORT_VAR_CUR_TRACK, tracks);
-	replace_var(TRANSPORT_VAR_CUR_TRACK_URI, uri);
-	replace_var(TRANSPORT_VAR_CUR_TRACK_META, meta);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK, tracks);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK_URI, uri);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK_META, meta);
 }
 
-static void change_transport_state(enum transport_state new_state) {
-	transport_state_ = new_state;
-	assert(new_state >= TRANSPORT_STOPPED
-	       && new_state < TRANSPORT_NO_MEDIA_PRESENT);
-	if (!replace_var(TRANSPORT_VAR_TRANSPORT_STATE,
-			 transport_states[new_state])) {
-		return;  // no change.
-	}
+static void update_transport_actions(struct upnp_transport *t) {
 	const char *available_actions = NULL;
-	switch (new_state) {
+	switch (t->transport_state) {
 	case TRANSPORT_STOPPED:
-		if (strlen(get_var(TRANSPORT_VAR_AV_URI)) == 0) {
+		if (strlen(get_var(t, TRANSPORT_VAR_AV_URI)) == 0) {
 			available_actions = "PLAY";
 		} else {
 			available_actions = "PLAY,SEEK";
@@ -522,36 +569,301 @@ static void change_transport_state(enum transport_state new_state) {
 		available_actions = "PLAY,STOP,SEEK";
 		break;
 	case TRANSPORT_TRANSITIONING:
+		// Playing, but waiting for the stream to buffer.
+		available_actions = "PAUSE,STOP,SEEK";
+		break;
 	case TRANSPORT_PAUSED_RECORDING:
 	case TRANSPORT_RECORDING:
 	case TRANSPORT_NO_MEDIA_PRESENT:
 		// We should not switch to this state.
 		break;
 	}
-	if (available_actions) {
-		replace_var(TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS,
+	if (available_actions == NULL)
+		return;
+	if (t->queue_active) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%s,NEXT,PREVIOUS",
+			 available_actions);
+		replace_var(t, TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS, buf);
+	} else {
+		replace_var(t, TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS,
 			    available_actions);
 	}
 }
 
+static void change_transport_state(struct upnp_transport *t, enum transport_state new_state) {
+	t->transport_state = new_state;
+	assert(new_state >= TRANSPORT_STOPPED
+	       && new_state < TRANSPORT_NO_MEDIA_PRESENT);
+	if (!replace_var(t, TRANSPORT_VAR_TRANSPORT_STATE,
+			 transport_states[new_state])) {
+		return;  // no change.
+	}
+	update_transport_actions(t);
+}
+
 // Callback from our output if the song meta data changed.
-static void update_meta_from_stream(const struct SongMetaData *meta) {
+static void update_meta_from_stream(const struct SongMetaData *meta,
+				    void *userdata) {
+	struct upnp_transport *t = userdata;
 	if (meta->title == NULL || strlen(meta->title) == 0) {
 		return;
 	}
-	const char *original_xml = get_var(TRANSPORT_VAR_AV_URI_META);
+	service_lock(t);
+	// While playing a queue, the AVTransportURI meta data is the one of
+	// the playlist; only the track changes.
+	const char *original_xml = get_var(t, t->queue_active
+					   ? TRANSPORT_VAR_CUR_TRACK_META
+					   : TRANSPORT_VAR_AV_URI_META);
 	char *didl = SongMetaData_to_DIDL(meta, original_xml);
-	service_lock();
-	replace_var(TRANSPORT_VAR_AV_URI_META, didl);
-	replace_var(TRANSPORT_VAR_CUR_TRACK_META, didl);
-	service_unlock();
+	if (!t->queue_active)
+		replace_var(t, TRANSPORT_VAR_AV_URI_META, didl);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK_META, didl);
+	service_unlock(t);
 	free(didl);
 }
 
+// A track was started or selected. Needs the service lock.
+static void notify_track_change(struct upnp_transport *t) {
+	for (struct track_listener *it = t->track_listeners; it; it = it->next) {
+		it->callback(it->userdata);
+	}
+}
+
+static int play_mode_is(struct upnp_transport *t, const char *mode) {
+	return strcmp(get_var(t, TRANSPORT_VAR_CUR_PLAY_MODE), mode) == 0;
+}
+
+// The output loops the track with REPEAT_ONE, and with REPEAT_ALL unless
+// there is a queue to repeat. Returns 0 or -1 if the output can't loop.
+static int update_output_loop(struct upnp_transport *t) {
+	const int loop = (play_mode_is(t, "REPEAT_ONE")
+			  || (play_mode_is(t, "REPEAT_ALL") && !t->queue_active));
+	if (loop == t->output_loop)
+		return 0;
+	if (output_set_loop(t->output, loop) != 0 && loop)
+		return -1;
+	t->output_loop = loop;
+	return 0;
+}
+
+// -- Playing from the play queue. All need the service lock.
+
+// Index of the queue entry "delta" away from the current one; wraps around
+// with REPEAT_ALL. Returns -1 if there is none.
+static int queue_index_from_current(struct upnp_transport *t, int delta) {
+	const int length = PlayQueue_length(t->queue);
+	int index = PlayQueue_current(t->queue) + delta;
+	if (length > 0 && play_mode_is(t, "REPEAT_ALL"))
+		index = ((index % length) + length) % length;
+	return (index >= 0 && index < length) ? index : -1;
+}
+
+// Hand the entry after the current one to the output as its next uri.
+static void queue_feed_next(struct upnp_transport *t) {
+	struct play_queue_entry entry;
+	if (PlayQueue_get(t->queue, queue_index_from_current(t, 1), &entry) == 0) {
+		output_set_next_uri(t->output, entry.uri);
+		PlayQueue_entry_clear(&entry);
+		t->queue_next_fed = 1;
+	} else if (t->queue_next_fed) {
+		output_set_next_uri(t->output, "");
+		t->queue_next_fed = 0;
+	}
+}
+
+// Make queue entry "index" the current track. If "to_output", also hand it
+// to the output; otherwise it is already playing. Returns 0 if there is
+// such an entry.
+static int queue_select_track(struct upnp_transport *t, int index, int to_output) {
+	struct play_queue_entry entry;
+	if (PlayQueue_get(t->queue, index, &entry) != 0)
+		return -1;
+	PlayQueue_set_current(t->queue, index);
+	char track[16];
+	snprintf(track, sizeof(track), "%d", index + 1);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK, track);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK_URI, entry.uri);
+	replace_var(t, TRANSPORT_VAR_CUR_TRACK_META, entry.meta);
+	if (to_output) {
+		output_set_uri(t->output, entry.uri,
+			       (wants_stream_meta(entry.meta)
+				? update_meta_from_stream : NULL), t);
+	}
+	PlayQueue_entry_clear(&entry);
+	queue_feed_next(t);
+	notify_track_change(t);
+	return 0;
+}
+
+static void queue_update_length(struct upnp_transport *t) {
+	char tracks[16];
+	snprintf(tracks, sizeof(tracks), "%d", PlayQueue_length(t->queue));
+	replace_var(t, TRANSPORT_VAR_NR_TRACKS, tracks);
+}
+
+// Play from the queue from now on. "uri" and "meta" are the AVTransportURI
+// it was loaded from; empty if it was filled by other means.
+static void queue_activate(struct upnp_transport *t, const char *uri, const char *meta) {
+	t->queue_active = 1;
+	replace_var(t, TRANSPORT_VAR_AV_URI, uri);
+	replace_var(t, TRANSPORT_VAR_AV_URI_META, meta);
+	queue_update_length(t);
+	update_transport_actions(t);
+	update_output_loop(t);
+}
+
+// The AVTransportURI "uri" is a playlist, now loaded into the queue.
+static void queue_start(struct upnp_transport *t, const char *uri, const char *meta) {
+	queue_activate(t, uri, meta);
+	queue_select_track(t, 0, 1);
+}
+
+// Back to playing what the controller hands us.
+static void queue_stop(struct upnp_transport *t) {
+	if (!t->queue_active)
+		return;
+	t->queue_active = 0;
+	if (t->queue_next_fed)
+		output_set_next_uri(t->output, "");
+	t->queue_next_fed = 0;
+	PlayQueue_clear(t->queue);
+	update_transport_actions(t);
+	update_output_loop(t);
+}
+
+// Go to track "index" of the queue. Returns 0 or a transport error code.
+static int queue_jump_to_track(struct upnp_transport *t, int index) {
+	if (!t->queue_active || index < 0 || index >= PlayQueue_length(t->queue)) {
+		return UPNP_TRANSPORT_E_ILL_SEEKTARGET;
+	}
+	if (t->transport_state == TRANSPORT_PAUSED_PLAYBACK) {
+		// Would otherwise continue the paused track on Play.
+		output_stop(t->output);
+		change_transport_state(t, TRANSPORT_STOPPED);
+	}
+	replace_var(t, TRANSPORT_VAR_REL_TIME_POS, kZeroTime);
+	queue_select_track(t, index, 1);
+	return 0;
+}
+
+// Returns the playlist to load into the queue for "uri", newly allocated,
+// or NULL if this is not one. Might fetch it from the network, so call
+// without holding the service lock.
+static char *get_playlist(const char *uri, const char *meta) {
+	// A DIDL-Lite with several items is a playlist by itself.
+	const char *item = meta ? strstr(meta, "<item") : NULL;
+	if (item != NULL && strstr(item + 1, "<item") != NULL)
+		return strdup(meta);
+	if (!PlayQueue_is_playlist(uri, meta))
+		return NULL;
+	char *content = NULL;
+	char content_type[LINE_SIZE];
+	const int rc = UpnpDownloadUrlItem(uri, &content, content_type);
+	if (rc != UPNP_E_SUCCESS) {
+		Log_error("transport", "Can't fetch playlist %s: %s", uri,
+			  UpnpGetErrorMessage(rc));
+		return NULL;
+	}
+	return content;
+}
+
+// Returns a newly allocated copy of the content-format (third) field of a
+// protocolInfo string such as "http-get:*:audio/mpeg:*", or NULL.
+static char *protocol_info_mime_type(const char *protocol_info) {
+	const char *start = protocol_info;
+	for (int i = 0; i < 2; ++i) {
+		start = strchr(start, ':');
+		if (start == NULL)
+			return NULL;
+		++start;
+	}
+	const char *end = strchr(start, ':');
+	if (end == NULL)
+		end = start + strlen(start);
+	return strndup(start, end - start);
+}
+
+// Checks if a protocolInfo attribute announces something we can play.
+// Unknown or wildcard formats are given the benefit of the doubt.
+static int is_protocol_info_supported(const char *protocol_info) {
+	char *mime_type = protocol_info_mime_type(protocol_info);
+	if (mime_type == NULL)
+		return 1;
+	const int result = (strcmp(mime_type, "*") == 0
+			    || strlen(mime_type) == 0
+			    || connmgr_is_mime_type_supported(mime_type));
+	free(mime_type);
+	return result;
+}
+
+// Looks at the <res protocolInfo="..."> elements of the DIDL meta data
+// to figure out if we would be able to play "uri". Prefers the resource
+// matching the uri; otherwise any supported resource is good enough.
+// Returns 0 only if the meta data tells us that we can't play the uri; in
+// that case, "mime_type" is set to a newly allocated string with the
+// offending type.
+static int is_uri_playable_by_meta(const char *uri, const char *meta,
+				   char **mime_type) {
+	*mime_type = NULL;
+	if (meta == NULL || strlen(meta) == 0)
+		return 1;
+	struct xmldoc *doc = xmldoc_parsexml(meta);
+	if (doc == NULL)
+		return 1;
+	int result = 1;
+	struct xmlelement *didl_node = find_element_in_doc(doc, "DIDL-Lite");
+	struct xmlelement *item_node = (didl_node != NULL
+					? find_element_in_element(didl_node,
+								  "item")
+					: NULL);
+	struct xmlelement *res_node = (item_node != NULL
+				       ? find_element_in_element(item_node,
+								 "res")
+				       : NULL);
+	int any_supported = 0;
+	char *first_unsupported = NULL;
+	for (/**/; res_node != NULL;
+	     res_node = find_next_element(res_node, "res")) {
+		char *protocol_info = get_attribute_value(res_node,
+							  "protocolInfo");
+		if (protocol_info == NULL)
+			continue;
+		const int supported = is_protocol_info_supported(protocol_info);
+		char *res_uri = get_node_value(res_node);
+		const int is_our_uri = (strcmp(res_uri, uri) == 0);
+		free(res_uri);
+		if (is_our_uri) {
+			// Exact match: this decides.
+			any_supported = supported;
+			free(first_unsupported);
+			first_unsupported = (supported ? NULL
+				   : protocol_info_mime_type(protocol_info));
+			free(protocol_info);
+			break;
+		}
+		if (supported) {
+			any_supported = 1;
+		} else if (first_unsupported == NULL) {
+			first_unsupported = protocol_info_mime_type(protocol_info);
+		}
+		free(protocol_info);
+	}
+	if (!any_supported && first_unsupported != NULL) {
+		result = 0;
+		*mime_type = first_unsupported;
+	} else {
+		free(first_unsupported);
+	}
+	xmldoc_free(doc);
+	return result;
+}
+
 /* UPnP action handlers */
 
 static int set_avtransport_uri(struct action_event *event)
 {
+	struct upnp_transport *t = transport_of(event);
 	if (!has_instance_id(event)) {
 		return -1;
 	}
@@ -560,30 +872,58 @@ static int set_avtransport_uri(struct action_event *event)
 		return -1;
 	}
 
-	service_lock();
 	const char *meta = upnp_get_string(event, "CurrentURIMetaData");
+	if (check_mime_type_) {
+		// Bail out before handing the URI to the output, which would
+		// only find out after connecting and typefinding the stream.
+		char *mime_type = NULL;
+		if (!is_uri_playable_by_meta(uri, meta, &mime_type)) {
+			Log_info("transport", "Rejecting '%s' with unsupported "
+				 "type '%s'", uri, mime_type);
+			upnp_set_error(event, UPNP_TRANSPORT_E_ILLEGAL_MIME,
+				       "Unsupported mime type '%s'",
+				       mime_type);
+			free(mime_type);
+			return -1;
+		}
+	}
+
+	char *playlist = get_playlist(uri, meta);
+
+	service_lock(t);
+	if (playlist != NULL && PlayQueue_load(t->queue, uri, playlist) > 0) {
+		free(playlist);
+		queue_start(t, uri, meta);
+		service_unlock(t);
+		return 0;
+	}
+	free(playlist);
+	queue_stop(t);
+
 	// Transport URI/Meta set now, current URI/Meta when it starts playing.
-	int requires_meta_update = replace_transport_uri_and_meta(uri, meta);
+	int requires_meta_update = replace_transport_uri_and_meta(t, uri, meta);
 
-	if (transport_state_ == TRANSPORT_PLAYING) {
+	if (t->transport_state == TRANSPORT_PLAYING
+	    || t->transport_state == TRANSPORT_TRANSITIONING) {
 		// Uh, wrong state.
 		// Usually, this should not be called while we are PLAYING, only
 		// STOPPED or PAUSED. But if actually some controller sets this
 		// while playing, probably the best is to update the current
 		// current URI/Meta as well to reflect the state best.
-		replace_current_uri_and_meta(uri, meta);
+		replace_current_uri_and_meta(t, uri, meta);
 	}
 
-	output_set_uri(uri, (requires_meta_update
-			     ? update_meta_from_stream
-			     : NULL));
-	service_unlock();
+	output_set_uri(t->output, uri, (requires_meta_update
+					? update_meta_from_stream
+					: NULL), t);
+	service_unlock(t);
 
 	return 0;
 }
 
 static int set_next_avtransport_uri(struct action_event *event)
 {
+	struct upnp_transport *t = transport_of(event);
 	if (!has_instance_id(event)) {
 		return -1;
 	}
@@ -594,19 +934,22 @@ static int set_next_avtransport_uri(struct action_event *event)
 	}
 
 	int rc = 0;
-	service_lock();
+	service_lock(t);
 
-	output_set_next_uri(next_uri);
-	replace_var(TRANSPORT_VAR_NEXT_AV_URI, next_uri);
+	// The controller takes over; we continue with that after the current
+	// track.
+	t->queue_next_fed = 0;
+	output_set_next_uri(t->output, next_uri);
+	replace_var(t, TRANSPORT_VAR_NEXT_AV_URI, next_uri);
 
 	const char *next_uri_meta = upnp_get_string(event, "NextURIMetaData");
 	if (next_uri_meta == NULL) {
 		rc = -1;
 	} else {
-		replace_var(TRANSPORT_VAR_NEXT_AV_URI_META, next_uri_meta);
+		replace_var(t, TRANSPORT_VAR_NEXT_AV_URI_META, next_uri_meta);
 	}
 
-	service_unlock();
+	service_unlock(t);
 
 	return rc;
 }
@@ -642,7 +985,49 @@ static int get_transport_settings(struct action_event *event)
 	if (!has_instance_id(event)) {
 		return -1;
 	}
-	// TODO: what variables to add ?
+	upnp_append_variable(event, TRANSPORT_VAR_CUR_PLAY_MODE, "PlayMode");
+	upnp_append_variable(event, TRANSPORT_VAR_CUR_REC_QUAL_MODE,
+			     "RecQualityMode");
+	return 0;
+}
+
+// Needs the service lock. Returns 0 or a transport error code.
+static int change_play_mode(struct upnp_transport *t, const char *mode) {
+	const char **supported = playmodi;
+	while (*supported != NULL && strcmp(*supported, mode) != 0)
+		++supported;
+	if (*supported == NULL)
+		return UPNP_TRANSPORT_E_PLAYMODE_NS;
+	char *previous = strdup(get_var(t, TRANSPORT_VAR_CUR_PLAY_MODE));
+	replace_var(t, TRANSPORT_VAR_CUR_PLAY_MODE, mode);
+	const int loop_failed = update_output_loop(t);
+	if (loop_failed)
+		replace_var(t, TRANSPORT_VAR_CUR_PLAY_MODE, previous);
+	free(previous);
+	if (loop_failed)
+		return UPNP_TRANSPORT_E_PLAYMODE_NS;
+	if (t->queue_active)
+		queue_feed_next(t);  // Might wrap around now, or not anymore.
+	return 0;
+}
+
+static int set_play_mode(struct action_event *event)
+{
+	struct upnp_transport *t = transport_of(event);
+	if (!has_instance_id(event)) {
+		return -1;
+	}
+	const char *mode = upnp_get_string(event, "NewPlayMode");
+	if (mode == NULL) {
+		return -1;
+	}
+	service_lock(t);
+	const int rc = change_play_mode(t, mode);
+	service_unlock(t);
+	if (rc != 0) {
+		upnp_set_error(event, rc, "Play mode '%s' not supported", mode);
+		return -1;
+	}
 	return 0;
 }
 
@@ -671,29 +1056,69 @@ static gint64 parse_upnp_time(const char *time_string) {
 }
 
 // We constantly update the track time to event about it to our clients.
+// While PLAYING, the position has to move; if it is stuck longer than
+// stall_timeout_sec_, have the output rebuild its pipeline. Needs the
+// service lock.
+static void check_for_stall(struct upnp_transport *t, gint64 position) {
+	const int64_t now = Metrics_now_us();
+	if (t->transport_state != TRANSPORT_PLAYING
+	    || position != t->stall_position) {
+		if (t->stall_restart_us != 0 && position != t->stall_position
+		    && t->transport_state == TRANSPORT_PLAYING) {
+			Log_info("transport", "Playing again %.1fs after "
+				 "rebuilding the stalled pipeline",
+				 (now - t->stall_restart_us) / 1e6);
+		}
+		t->stall_restart_us = 0;
+		t->stall_position = position;
+		t->stall_progress_us = now;
+		return;
+	}
+	if (stall_timeout_sec_ <= 0
+	    || now - t->stall_progress_us < stall_timeout_sec_ * 1000000LL) {
+		return;
+	}
+	const int rc = output_restart(t->output);
+	if (rc == 0) {
+		char tbuf[32];
+		print_upnp_time(tbuf, sizeof(tbuf), position);
+		Log_error("transport", "Stalled at %s for %.1fs%s; rebuilt "
+			  "pipeline", tbuf, (now - t->stall_progress_us) / 1e6,
+			  t->stall_restart_us != 0 ? " (again)" : "");
+		Metrics_add(METRIC_PIPELINE_RESTARTS, 1);
+		if (t->stall_restart_us == 0)
+			t->stall_restart_us = now;
+	} else if (rc < 0) {
+		Log_error("transport", "Stalled for %.1fs; can't rebuild "
+			  "pipeline", (now - t->stall_progress_us) / 1e6);
+	}
+	t->stall_progress_us = now;  // Give it time to get going again.
+}
+
 static void *thread_update_track_time(void *userdata) {
-	(void)userdata;
+	struct upnp_transport *t = userdata;
 	const gint64 one_sec_unit = 1000000000LL;
 	char tbuf[32];
 	gint64 last_duration = -1, last_position = -1;
 	for (;;) {
 		usleep(500000);  // 500ms
-		service_lock();
+		service_lock(t);
 		gint64 duration, position;
-		const int pos_result = output_get_position(&duration, &position);
+		const int pos_result = output_get_position(t->output, &duration, &position);
 		if (pos_result == 0) {
 			if (duration != last_duration) {
 				print_upnp_time(tbuf, sizeof(tbuf), duration);
-				replace_var(TRANSPORT_VAR_CUR_TRACK_DUR, tbuf);
+				replace_var(t, TRANSPORT_VAR_CUR_TRACK_DUR, tbuf);
 				last_duration = duration;
 			}
 			if (position / one_sec_unit != last_position) {
 				print_upnp_time(tbuf, sizeof(tbuf), position);
-				replace_var(TRANSPORT_VAR_REL_TIME_POS, tbuf);
+				replace_var(t, TRANSPORT_VAR_REL_TIME_POS, tbuf);
 				last_position = position / one_sec_unit;
 			}
+			check_for_stall(t, position);
 		}
-		service_unlock();
+		service_unlock(t);
 	}
 	return NULL;  // not reached.
 }
@@ -727,14 +1152,10 @@ static int get_device_caps(struct action_event *event)
 	return 0;
 }
 
-static int stop(struct action_event *event)
-{
-	if (!has_instance_id(event)) {
-		return -1;
-	}
-
-	service_lock();
-	switch (transport_state_) {
+// The state changes behind the Stop, Play and Pause actions. Need the
+// service lock. Return 0 or a transport error code.
+static int stop_playing(struct upnp_transport *t) {
+	switch (t->transport_state) {
 	case TRANSPORT_STOPPED:
 		// nothing to change.
 		break;
@@ -743,55 +1164,24 @@ static int stop(struct action_event *event)
 	case TRANSPORT_PAUSED_RECORDING:
 	case TRANSPORT_RECORDING:
 	case TRANSPORT_PAUSED_PLAYBACK:
-		output_stop();
-		change_transport_state(TRANSPORT_STOPPED);
+		output_stop(t->output);
+		change_transport_state(t, TRANSPORT_STOPPED);
 		break;
 
 	case TRANSPORT_NO_MEDIA_PRESENT:
 		/* action not allowed in these states - error 701 */
-		upnp_set_error(event, UPNP_TRANSPORT_E_TRANSITION_NA,
-			       "Transition to STOP not allowed; allowed=%s",
-			       get_var(TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
-
-		break;
+		return UPNP_TRANSPORT_E_TRANSITION_NA;
 	}
-	service_unlock();
-
 	return 0;
 }
 
-static void inform_play_transition_from_output(enum PlayFeedback fb) {
-	service_lock();
-	switch (fb) {
-	case PLAY_STOPPED:
-		replace_transport_uri_and_meta("", "");
-		replace_current_uri_and_meta("", "");
-		change_transport_state(TRANSPORT_STOPPED);
-		break;
+static void inform_play_transition_from_output(enum PlayFeedback fb,
+					       void *userdata);
 
-	case PLAY_STARTED_NEXT_STREAM: {
-		const char *av_uri = get_var(TRANSPORT_VAR_NEXT_AV_URI);
-		const char *av_meta = get_var(TRANSPORT_VAR_NEXT_AV_URI_META);
-		replace_transport_uri_and_meta(av_uri, av_meta);
-		replace_current_uri_and_meta(av_uri, av_meta);
-		replace_var(TRANSPORT_VAR_NEXT_AV_URI, "");
-		replace_var(TRANSPORT_VAR_NEXT_AV_URI_META, "");
-		break;
-	}
-	}
-	service_unlock();
-}
-
-static int play(struct action_event *event)
-{
-	if (!has_instance_id(event)) {
-		return -1;
-	}
-
-	int rc = 0;
-	service_lock();
-	switch (transport_state_) {
+static int start_playing(struct upnp_transport *t) {
+	switch (t->transport_state) {
 	case TRANSPORT_PLAYING:
+	case TRANSPORT_TRANSITIONING:  // Playing, once buffered.
 		// Nothing to change.
 		break;
 
@@ -800,97 +1190,239 @@ static int play(struct action_event *event)
 		// set the time to zero now; otherwise we will see the old
 		// value of the previous song until it updates some fractions
 		// of a second later.
-		replace_var(TRANSPORT_VAR_REL_TIME_POS, kZeroTime);
+		replace_var(t, TRANSPORT_VAR_REL_TIME_POS, kZeroTime);
 
 		/* >>> fall through */
 
 	case TRANSPORT_PAUSED_PLAYBACK:
-		if (output_play(&inform_play_transition_from_output)) {
-			upnp_set_error(event, 704, "Playing failed");
-			rc = -1;
-		} else {
-			change_transport_state(TRANSPORT_PLAYING);
-			const char *av_uri = get_var(TRANSPORT_VAR_AV_URI);
-			const char *av_meta = get_var(TRANSPORT_VAR_AV_URI_META);
-			replace_current_uri_and_meta(av_uri, av_meta);
+		if (output_play(t->output, &inform_play_transition_from_output,
+				t)) {
+			return UPNP_TRANSPORT_E_PLAY_FORMAT_NS;
+		}
+		replace_var(t, TRANSPORT_VAR_TRANSPORT_STATUS, "OK");
+		const int from_stop = (t->transport_state == TRANSPORT_STOPPED);
+		change_transport_state(t, TRANSPORT_PLAYING);
+		if (!t->queue_active) {
+			const char *av_uri = get_var(t, TRANSPORT_VAR_AV_URI);
+			const char *av_meta = get_var(t, TRANSPORT_VAR_AV_URI_META);
+			replace_current_uri_and_meta(t, av_uri, av_meta);
+			if (from_stop)
+				notify_track_change(t);
 		}
 		break;
 
 	case TRANSPORT_NO_MEDIA_PRESENT:
-	case TRANSPORT_TRANSITIONING:
 	case TRANSPORT_PAUSED_RECORDING:
 	case TRANSPORT_RECORDING:
 		/* action not allowed in these states - error 701 */
-		upnp_set_error(event, UPNP_TRANSPORT_E_TRANSITION_NA,
-			       "Transition to PLAY not allowed; allowed=%s",
-			       get_var(TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
-		rc = -1;
-		break;
+		return UPNP_TRANSPORT_E_TRANSITION_NA;
 	}
-	service_unlock();
-
-	return rc;
+	return 0;
 }
 
-static int pause_stream(struct action_event *event)
-{
-	if (!has_instance_id(event)) {
-		return -1;
-	}
-
-	int rc = 0;
-	service_lock();
-	switch (transport_state_) {
+static int pause_playing(struct upnp_transport *t) {
+	switch (t->transport_state) {
         case TRANSPORT_PAUSED_PLAYBACK:
 		// Nothing to change.
 		break;
 
 	case TRANSPORT_PLAYING:
-		if (output_pause()) {
-			upnp_set_error(event, 704, "Pause failed");
-			rc = -1;
-		} else {
-			change_transport_state(TRANSPORT_PAUSED_PLAYBACK);
+	case TRANSPORT_TRANSITIONING:
+		if (output_pause(t->output)) {
+			return UPNP_TRANSPORT_E_PLAY_FORMAT_NS;
 		}
+		change_transport_state(t, TRANSPORT_PAUSED_PLAYBACK);
 		break;
 
         default:
 		/* action not allowed in these states - error 701 */
+		return UPNP_TRANSPORT_E_TRANSITION_NA;
+        }
+	return 0;
+}
+
+static int stop(struct action_event *event)
+{
+	struct upnp_transport *t = transport_of(event);
+	if (!has_instance_id(event)) {
+		return -1;
+	}
+
+	service_lock(t);
+	if (stop_playing(t) != 0) {
 		upnp_set_error(event, UPNP_TRANSPORT_E_TRANSITION_NA,
+			       "Transition to STOP not allowed; allowed=%s",
+			       get_var(t, TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
+	}
+	service_unlock(t);
+
+	return 0;
+}
+
+static void inform_play_transition_from_output(enum PlayFeedback fb,
+					       void *userdata) {
+	struct upnp_transport *t = userdata;
+	service_lock(t);
+	switch (fb) {
+	case PLAY_STOPPED:
+		if (t->queue_active) {
+			// End of the queue; ready to play it again.
+			output_stop(t->output);
+			change_transport_state(t, TRANSPORT_STOPPED);
+			replace_var(t, TRANSPORT_VAR_REL_TIME_POS, kZeroTime);
+			queue_select_track(t, 0, 1);
+			// Not again if it ended because nothing could be played.
+			if (play_mode_is(t, "REPEAT_ALL")
+			    && strcmp(get_var(t, TRANSPORT_VAR_TRANSPORT_STATUS),
+				      "OK") == 0)
+				start_playing(t);
+			break;
+		}
+		replace_transport_uri_and_meta(t, "", "");
+		replace_current_uri_and_meta(t, "", "");
+		change_transport_state(t, TRANSPORT_STOPPED);
+		break;
+
+	case PLAY_STARTED_NEXT_STREAM: {
+		// The output reports this once the next stream is audible.
+		replace_var(t, TRANSPORT_VAR_REL_TIME_POS, kZeroTime);
+		replace_var(t, TRANSPORT_VAR_TRANSPORT_STATUS, "OK");
+		if (t->queue_next_fed) {
+			queue_select_track(t, queue_index_from_current(t, 1), 0);
+			break;
+		}
+		queue_stop(t);  // Controller set the next uri.
+		const char *av_uri = get_var(t, TRANSPORT_VAR_NEXT_AV_URI);
+		const char *av_meta = get_var(t, TRANSPORT_VAR_NEXT_AV_URI_META);
+		replace_transport_uri_and_meta(t, av_uri, av_meta);
+		replace_current_uri_and_meta(t, av_uri, av_meta);
+		replace_var(t, TRANSPORT_VAR_NEXT_AV_URI, "");
+		replace_var(t, TRANSPORT_VAR_NEXT_AV_URI_META, "");
+		notify_track_change(t);
+		break;
+	}
+
+	case PLAY_BUFFERING:
+		if (t->transport_state == TRANSPORT_PLAYING)
+			change_transport_state(t, TRANSPORT_TRANSITIONING);
+		break;
+
+	case PLAY_BUFFERING_DONE:
+		if (t->transport_state == TRANSPORT_TRANSITIONING)
+			change_transport_state(t, TRANSPORT_PLAYING);
+		break;
+
+	case PLAY_ERROR:
+		// Stays until the next track or Play.
+		replace_var(t, TRANSPORT_VAR_TRANSPORT_STATUS, "ERROR_OCCURRED");
+		break;
+	}
+	service_unlock(t);
+}
+
+static int play(struct action_event *event)
+{
+	struct upnp_transport *t = transport_of(event);
+	if (!has_instance_id(event)) {
+		return -1;
+	}
+
+	service_lock(t);
+	const int rc = start_playing(t);
+	if (rc == UPNP_TRANSPORT_E_TRANSITION_NA) {
+		upnp_set_error(event, rc,
+			       "Transition to PLAY not allowed; allowed=%s",
+			       get_var(t, TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
+	} else if (rc != 0) {
+		upnp_set_error(event, rc, "Playing failed");
+	}
+	service_unlock(t);
+
+	return rc == 0 ? 0 : -1;
+}
+
+static int pause_stream(struct action_event *event)
+{
+	struct upnp_transport *t = transport_of(event);
+	if (!has_instance_id(event)) {
+		return -1;
+	}
+
+	service_lock(t);
+	const int rc = pause_playing(t);
+	if (rc == UPNP_TRANSPORT_E_TRANSITION_NA) {
+		upnp_set_error(event, rc,
 			       "Transition to PAUSE not allowed; allowed=%s",
-			       get_var(TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
-		rc = -1;
-        }
-	service_unlock();
+			       get_var(t, TRANSPORT_VAR_CUR_TRANSPORT_ACTIONS));
+	} else if (rc != 0) {
+		upnp_set_error(event, rc, "Pause failed");
+	}
+	service_unlock(t);
 
-	return rc;
+	return rc == 0 ? 0 : -1;
 }
 
 static int seek(struct action_event *event)
 {
+	struct upnp_transport *t = transport_of(event);
 	if (!has_instance_id(event)) {
 		return -1;
 	}
 
 	const char *unit = upnp_get_string(event, "Unit");
+	const char *target = upnp_get_string(event, "Target");
+	if (unit == NULL || target == NULL) {
+		return -1;
+	}
+
 	if (strcmp(unit, "REL_TIME") == 0) {
-		// This is the only thing we support right now.
-		const char *target = upnp_get_string(event, "Target");
 		gint64 nanos = parse_upnp_time(target);
-		service_lock();
-		if (output_seek(nanos) == 0) {
+		service_lock(t);
+		if (output_seek(t->output, nanos) == 0) {
 			// TODO(hzeller): Seeking might take some time,
 			// pretend to already be there. Should we go into
 			// TRANSITION mode ?
 			// (gstreamer will go into PAUSE, then PLAYING)
-			replace_var(TRANSPORT_VAR_REL_TIME_POS, target);
+			replace_var(t, TRANSPORT_VAR_REL_TIME_POS, target);
+		}
+		service_unlock(t);
+	} else if (strcmp(unit, "TRACK_NR") == 0) {
+		const int track = atoi(target);
+		service_lock(t);
+		const int rc = queue_jump_to_track(t, track - 1);
+		service_unlock(t);
+		if (rc != 0) {
+			upnp_set_error(event, rc, "Illegal seek target");
+			return -1;
 		}
-		service_unlock();
 	}
 
 	return 0;
 }
 
+static int skip_track(struct action_event *event, int delta) {
+	if (!has_instance_id(event)) {
+		return -1;
+	}
+	struct upnp_transport *t = transport_of(event);
+	service_lock(t);
+	const int rc = queue_jump_to_track(t, queue_index_from_current(t, delta));
+	service_unlock(t);
+	if (rc != 0) {
+		upnp_set_error(event, rc, "Illegal seek target");
+		return -1;
+	}
+	return 0;
+}
+
+static int next(struct action_event *event) {
+	return skip_track(event, 1);
+}
+
+static int previous(struct action_event *event) {
+	return skip_track(event, -1);
+}
+
 static struct action transport_actions[] = {
 	[TRANSPORT_CMD_GETCURRENTTRANSPORTACTIONS] = {"GetCurrentTransportActions", get_current_transportactions},
 	[TRANSPORT_CMD_GETDEVICECAPABILITIES] =     {"GetDeviceCapabilities", get_device_caps},
@@ -906,30 +1438,15 @@ static struct action transport_actions[] = {
 	[TRANSPORT_CMD_SETNEXTAVTRANSPORTURI] =     {"SetNextAVTransportURI", set_next_avtransport_uri},
 
 	//[TRANSPORT_CMD_RECORD] =                    {"Record", NULL},	/* optional */
-	//[TRANSPORT_CMD_NEXT] =                      {"Next", next},
-	//[TRANSPORT_CMD_PREVIOUS] =                  {"Previous", previous},
-	//[TRANSPORT_CMD_SETPLAYMODE] =               {"SetPlayMode", NULL},	/* optional */
+	[TRANSPORT_CMD_NEXT] =                      {"Next", next},
+	[TRANSPORT_CMD_PREVIOUS] =                  {"Previous", previous},
+	[TRANSPORT_CMD_SETPLAYMODE] =               {"SetPlayMode", set_play_mode},
 	//[TRANSPORT_CMD_SETRECORDQUALITYMODE] =      {"SetRecordQualityMode", NULL},	/* optional */
 
 	[TRANSPORT_CMD_COUNT] =                  {NULL, NULL}
 };
 
-struct service *upnp_transport_get_service(void) {
-	static struct service transport_service_ = {
-		.service_mutex =        &transport_mutex,
-		.service_id =           TRANSPORT_SERVICE_ID,
-		.service_type =         TRANSPORT_TYPE,
-		.scpd_url =		TRANSPORT_SCPD_URL,
-		.control_url =		TRANSPORT_CONTROL_URL,
-		.event_url =		TRANSPORT_EVENT_URL,
-		.event_xml_ns =         TRANSPORT_EVENT_XML_NS,
-		.actions =              transport_actions,
-		.action_arguments =     argument_list,
-		.variable_container =   NULL, // set later.
-		.last_change =          NULL,
-		.command_count =        TRANSPORT_CMD_COUNT,
-	};
-
+struct upnp_transport *upnp_transport_new(int instance, struct output *out) {
 	static struct var_meta transport_var_meta[] = {
 		{TRANSPORT_VAR_TRANSPORT_STATE, "TransportState", "STOPPED",
 		 EV_NO, DATATYPE_STRING, transport_states, NULL },
@@ -995,16 +1512,43 @@ struct service *upnp_transport_get_service(void) {
 		{TRANSPORT_VAR_COUNT, NULL, NULL, EV_NO, DATATYPE_UNKNOWN, NULL, NULL }
 	};
 
-	if (transport_service_.variable_container == NULL) {
-		state_variables_ = VariableContainer_new(TRANSPORT_VAR_COUNT,
-							 transport_var_meta);
-		transport_service_.variable_container = state_variables_;
-	}
-	return &transport_service_;
+	struct upnp_transport *t = calloc(1, sizeof(*t));
+	pthread_mutex_init(&t->mutex, NULL);
+	t->state_variables = VariableContainer_new(TRANSPORT_VAR_COUNT,
+						   transport_var_meta);
+	t->transport_state = TRANSPORT_STOPPED;
+	t->output = out;
+	t->queue = PlayQueue_new();
+	t->stall_position = -1;
+
+	struct service *service = &t->service;
+	service->service_mutex = &t->mutex;
+	service->service_id = TRANSPORT_SERVICE_ID;
+	service->service_type = TRANSPORT_TYPE;
+	service->scpd_url = TRANSPORT_SCPD_URL;
+	service->control_url = g_strdup_printf(TRANSPORT_CONTROL_URL, instance);
+	service->event_url = g_strdup_printf(TRANSPORT_EVENT_URL, instance);
+	service->event_xml_ns = TRANSPORT_EVENT_XML_NS;
+	service->actions = transport_actions;
+	service->action_arguments = argument_list;
+	service->variable_container = t->state_variables;
+	service->last_change = NULL;
+	service->command_count = TRANSPORT_CMD_COUNT;
+	service->lock_profile = LockProfile_new("transport");
+	return t;
 }
 
-void upnp_transport_init(struct upnp_device *device) {
-	struct service *service = upnp_transport_get_service();
+struct service *upnp_transport_get_service(struct upnp_transport *t) {
+	return &t->service;
+}
+
+struct play_queue *upnp_transport_get_queue(struct upnp_transport *t) {
+	return t->queue;
+}
+
+void upnp_transport_init(struct upnp_transport *t,
+			 struct upnp_device *device) {
+	struct service *service = &t->service;
 	assert(service->last_change == NULL);
 	service->last_change =
 		UPnPLastChangeCollector_new(service->variable_container,
@@ -1022,10 +1566,123 @@ void upnp_transport_init(struct upnp_device *device) {
 					   TRANSPORT_VAR_ABS_CTR_POS);
 
 	pthread_t thread;
-	pthread_create(&thread, NULL, thread_update_track_time, NULL);
+	pthread_create(&thread, NULL, thread_update_track_time, t);
 }
 
-void upnp_transport_register_variable_listener(variable_change_listener_t cb,
+void upnp_transport_set_check_mime_type(int enable) {
+	check_mime_type_ = enable;
+}
+
+void upnp_transport_set_stall_timeout(int seconds) {
+	stall_timeout_sec_ = seconds;
+}
+
+void upnp_transport_register_variable_listener(struct upnp_transport *t,
+					       variable_change_listener_t cb,
 					       void *userdata) {
-	VariableContainer_register_callback(state_variables_, cb, userdata);
+	VariableContainer_register_callback(t->state_variables, cb, userdata);
+}
+
+void upnp_transport_register_track_listener(struct upnp_transport *t,
+					    track_change_listener_t cb,
+					    void *userdata) {
+	struct track_listener *item = malloc(sizeof(*item));
+	item->callback = cb;
+	item->userdata = userdata;
+	item->next = t->track_listeners;
+	t->track_listeners = item;
+}
+
+int upnp_transport_queue_play(struct upnp_transport *t, int index) {
+	int rc = 0;
+	service_lock(t);
+	if (PlayQueue_length(t->queue) == 0) {
+		rc = UPNP_TRANSPORT_E_NO_CONTENTS;
+	} else if (index >= 0) {
+		if (!t->queue_active)
+			queue_activate(t, "", "");
+		rc = queue_jump_to_track(t, index);
+	} else if (!t->queue_active || PlayQueue_current(t->queue) < 0) {
+		const int current = PlayQueue_current(t->queue);
+		if (!t->queue_active)
+			queue_activate(t, "", "");
+		rc = queue_jump_to_track(t, current < 0 ? 0 : current);
+	}
+	if (rc == 0)
+		rc = start_playing(t);
+	service_unlock(t);
+	return rc;
+}
+
+int upnp_transport_queue_skip(struct upnp_transport *t, int delta) {
+	service_lock(t);
+	const int rc = queue_jump_to_track(t, queue_index_from_current(t, delta));
+	service_unlock(t);
+	return rc;
+}
+
+void upnp_transport_queue_changed(struct upnp_transport *t) {
+	service_lock(t);
+	if (t->queue_active) {
+		queue_update_length(t);
+		const int current = PlayQueue_current(t->queue);
+		if (current < 0) {
+			// The track we were at is gone.
+			stop_playing(t);
+			if (t->queue_next_fed)
+				output_set_next_uri(t->output, "");
+			t->queue_next_fed = 0;
+			replace_current_uri_and_meta(t, "", "");
+		} else {
+			char track[16];
+			snprintf(track, sizeof(track), "%d", current + 1);
+			replace_var(t, TRANSPORT_VAR_CUR_TRACK, track);
+			queue_feed_next(t);
+		}
+	}
+	service_unlock(t);
+}
+
+int upnp_transport_set_play_mode(struct upnp_transport *t, const char *mode) {
+	service_lock(t);
+	const int rc = change_play_mode(t, mode);
+	service_unlock(t);
+	return rc;
+}
+
+int upnp_transport_pause(struct upnp_transport *t) {
+	service_lock(t);
+	const int rc = pause_playing(t);
+	service_unlock(t);
+	return rc;
+}
+
+int upnp_transport_stop(struct upnp_transport *t) {
+	service_lock(t);
+	const int rc = stop_playing(t);
+	service_unlock(t);
+	return rc;
+}
+
+int upnp_transport_seek_seconds(struct upnp_transport *t, long seconds, int relative) {
+	const gint64 one_sec_unit = 1000000000LL;
+	gint64 target = seconds * one_sec_unit;
+	int rc = 0;
+	service_lock(t);
+	gint64 duration, position;
+	if (relative) {
+		if (output_get_position(t->output, &duration, &position) == 0)
+			target += position;
+		if (target < 0)
+			target = 0;
+	}
+	if (output_seek(t->output, target) == 0) {
+		char tbuf[32];
+		print_upnp_time(tbuf, sizeof(tbuf), target);
+		replace_var(t, TRANSPORT_VAR_REL_TIME_POS, tbuf);
+	} else {
+		rc = UPNP_TRANSPORT_E_ILL_SEEKTARGET;
+	}
+	service_unlock(t);
+	return rc;
 }
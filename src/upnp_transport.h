@@ -26,15 +26,64 @@
 
 #include "variable-container.h"
 
+struct output;
+struct play_queue;
 struct service;
 struct upnp_device;
+struct upnp_transport;
 
-struct service *upnp_transport_get_service(void);
-void upnp_transport_init(struct upnp_device *);
+// The AVTransport of renderer number "instance" (1, 2, ..), playing on
+// "out". Each renderer has its own, with its own play queue.
+struct upnp_transport *upnp_transport_new(int instance, struct output *out);
+struct service *upnp_transport_get_service(struct upnp_transport *t);
+struct play_queue *upnp_transport_get_queue(struct upnp_transport *t);
+void upnp_transport_init(struct upnp_transport *t, struct upnp_device *);
+
+// If enabled, SetAVTransportURI checks the protocolInfo given in the
+// CurrentURIMetaData against the supported mime types and fails early with
+// 714 (illegal mime type) instead of only failing once we try to play.
+void upnp_transport_set_check_mime_type(int enable);
+
+// If the position does not move for "seconds" while PLAYING, the output
+// pipeline is rebuilt at that position. 0 turns this off.
+void upnp_transport_set_stall_timeout(int seconds);
 
 // Register a callback to get informed when variables change. This should
 // return quickly.
-void upnp_transport_register_variable_listener(variable_change_listener_t cb,
-						       void *userdata);
+void upnp_transport_register_variable_listener(struct upnp_transport *t,
+					       variable_change_listener_t cb,
+					       void *userdata);
+
+// Register a callback to get informed each time a track is started or
+// selected, even if it has the same uri as the one before (e.g. repeating a
+// queue of one entry). Called with the transport service lock held.
+typedef void (*track_change_listener_t)(void *userdata);
+void upnp_transport_register_track_listener(struct upnp_transport *t,
+					    track_change_listener_t cb,
+					    void *userdata);
+
+// -- Playing the play queue on behalf of other services (OpenHome Playlist).
+// These take the service lock themselves, so must not be called from a
+// variable listener. They return 0 or an AVTransport error code.
+
+// Play entry "index" of the queue from its start. With index -1, continue
+// the current entry (or start with the first).
+int upnp_transport_queue_play(struct upnp_transport *t, int index);
+
+// Go "delta" entries forward or back in the queue.
+int upnp_transport_queue_skip(struct upnp_transport *t, int delta);
+
+// To be called after entries were inserted into or deleted from the queue.
+void upnp_transport_queue_changed(struct upnp_transport *t);
+
+// Set the CurrentPlayMode, e.g. "REPEAT_ALL".
+int upnp_transport_set_play_mode(struct upnp_transport *t, const char *mode);
+
+int upnp_transport_pause(struct upnp_transport *t);
+int upnp_transport_stop(struct upnp_transport *t);
+
+// Seek to "seconds" in the current track, or by that much if "relative".
+int upnp_transport_seek_seconds(struct upnp_transport *t, long seconds,
+				int relative);
 
 #endif /* _UPNP_TRANSPORT_H */
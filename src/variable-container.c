@@ -37,8 +37,10 @@
 #include <ctype.h>
 #include <stdint.h>
 
+#include "metrics.h"
 #include "upnp_device.h"
 #include "upnp_service.h"
+#include "trace.h"
 #include "xmlescape.h"
 #include "xmldoc.h"
 
@@ -315,6 +317,7 @@ static void UPnPLastChangeCollector_notify(upnp_last_change_collector_t *obj) {
 	if (obj->open_transactions != 0)
 		return;
 
+	const int64_t start = Trace_begin();
 	char *xml_doc_string = UPnPLastChangeBuilder_to_xml(obj->builder);
 	if (xml_doc_string == NULL)
 		return;
@@ -334,10 +337,15 @@ static void UPnPLastChangeCollector_notify(upnp_last_change_collector_t *obj) {
 		// XML so needs to be XML quoted. The time around 2000 was
 		// pretty sick - people did everything in XML.
 		varvalues[0] = xmlescape(xml_doc_string, 0);
+		Metrics_add(METRIC_LASTCHANGE_EVENTS, 1);
+		Metrics_add(METRIC_LASTCHANGE_BYTES, strlen(varvalues[0]));
 		upnp_device_notify(obj->upnp_device,
 				   obj->service_id,
 				   varnames, varvalues, 1);
 		free((char*)varvalues[0]);
+		const char *service_name = strrchr(obj->service_id, ':');
+		Trace_end("lastchange", (service_name ? service_name + 1
+					 : obj->service_id), start);
 	}
 
 	free(xml_doc_string);
@@ -360,3 +368,43 @@ static void UPnPLastChangeCollector_callback(void *userdata,
 	UPnPLastChangeBuilder_add(object->builder, var_name, new_value);
 	UPnPLastChangeCollector_notify(object);
 }
+
+// -- UPnPVariableEventer
+struct upnp_variable_eventer {
+	const struct var_meta *meta;
+	struct upnp_device *upnp_device;
+	const char *service_id;
+};
+
+static void UPnPVariableEventer_callback(void *userdata,
+					 int var_num, const char *var_name,
+					 const char *old_value,
+					 const char *new_value) {
+	(void)old_value;
+	upnp_variable_eventer_t *object = (upnp_variable_eventer_t*) userdata;
+	if (object->meta[var_num].sendevents != EV_YES)
+		return;
+	const char *varnames[] = { var_name, NULL };
+	const char *varvalues[] = { NULL, NULL };
+	// Values are not escaped by libupnp, and DIDL-Lite meta data is XML.
+	varvalues[0] = xmlescape(new_value, 0);
+	upnp_device_notify(object->upnp_device, object->service_id,
+			   varnames, varvalues, 1);
+	free((char*)varvalues[0]);
+}
+
+upnp_variable_eventer_t *
+UPnPVariableEventer_new(variable_container_t *variable_container,
+			struct upnp_device *upnp_device,
+			const char *service_id) {
+	upnp_variable_eventer_t *result = (upnp_variable_eventer_t*)
+		malloc(sizeof(upnp_variable_eventer_t));
+	int count;
+	result->meta = VariableContainer_get_meta(variable_container, &count);
+	result->upnp_device = upnp_device;
+	result->service_id = service_id;
+	VariableContainer_register_callback(variable_container,
+					    UPnPVariableEventer_callback,
+					    result);
+	return result;
+}
@@ -41,6 +41,9 @@
  *   Hooks into the callback mechanism of the variable_container to assemble
  *   the LastChange variable to be sent over (using the last change builder).
  *
+ * upnp_variable_eventer - for services without LastChange (such as the
+ *   OpenHome ones), sends each evented variable directly when it changes.
+ *
  */
 #ifndef VARIABLE_CONTAINER_H
 #define VARIABLE_CONTAINER_H
@@ -134,4 +137,18 @@ void UPnPLastChangeCollector_start(upnp_last_change_collector_t *object);
 void UPnPLastChangeCollector_finish(upnp_last_change_collector_t *object);
 
 // no delete yet. We leak that.
+
+// -- UPnP variable eventer
+struct upnp_variable_eventer;
+typedef struct upnp_variable_eventer upnp_variable_eventer_t;
+
+// Create a new eventer that registers at the "variable_container" and sends
+// each change of a variable with sendevents="yes" as its own event to the
+// given "upnp_device".
+upnp_variable_eventer_t *
+UPnPVariableEventer_new(variable_container_t *variable_container,
+			struct upnp_device *upnp_device,
+			const char *service_id);
+
+// no delete either.
 #endif  /* VARIABLE_CONTAINER_H */
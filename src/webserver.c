@@ -47,6 +47,7 @@ typedef struct {
 	off_t pos;
 	const char *contents;
 	size_t len;
+	char *allocated;  // Generated content owned by this file, or NULL.
 } WebServerFile;
 
 struct virtual_file;
@@ -56,14 +57,33 @@ static struct virtual_file {
 	const char *contents;
 	const char *content_type;
 	size_t len;
+	webserver_generator_t generate;  // If set, contents are generated.
 	struct virtual_file *next;
 } *virtual_files = NULL;
 
+// libupnp first asks for the file info (which needs the length), then opens
+// the file in the same thread. So generated content is created when asked
+// for the info and handed over to the following open.
+static __thread char *generated_content_ = NULL;
+static __thread const char *generated_fname_ = NULL;
+
+static struct virtual_file *find_virtual_file(const char *path)
+{
+	for (struct virtual_file *it = virtual_files; it; it = it->next) {
+		if (strcmp(it->virtual_fname, path) == 0)
+			return it;
+	}
+	return NULL;
+}
+
 int webserver_register_buf(const char *path, const char *contents,
 			   const char *content_type)
 {
 	struct virtual_file *entry;
 
+	if (find_virtual_file(path) != NULL) {
+		return 0;  // Shared by several devices.
+	}
 	Log_info("webserver", "Provide %s (%s) from buffer",
 		 path, content_type);
 
@@ -79,6 +99,38 @@ int webserver_register_buf(const char *path, const char *contents,
 	entry->contents = contents;
 	entry->virtual_fname = path;
 	entry->content_type = content_type;
+	entry->generate = NULL;
+	entry->next = virtual_files;
+	virtual_files = entry;
+
+	return 0;
+}
+
+int webserver_register_generator(const char *path,
+				 webserver_generator_t generate,
+				 const char *content_type)
+{
+	struct virtual_file *entry;
+
+	if (find_virtual_file(path) != NULL) {
+		return 0;  // Shared by several devices.
+	}
+	Log_info("webserver", "Provide %s (%s) generated on request",
+		 path, content_type);
+
+	assert(path != NULL);
+	assert(generate != NULL);
+	assert(content_type != NULL);
+
+	entry = (struct virtual_file*)malloc(sizeof(struct virtual_file));
+	if (entry == NULL) {
+		return -1;
+	}
+	entry->len = 0;
+	entry->contents = NULL;
+	entry->virtual_fname = path;
+	entry->content_type = content_type;
+	entry->generate = generate;
 	entry->next = virtual_files;
 	virtual_files = entry;
 
@@ -92,6 +144,9 @@ int webserver_register_file(const char *path, const char *content_type)
 	struct virtual_file *entry;
 	int rc;
 
+	if (find_virtual_file(path) != NULL) {
+		return 0;  // Shared by several devices.
+	}
 	snprintf(local_fname, sizeof(local_fname), "%s%s", PKG_DATADIR,
 	         strrchr(path, '/'));
 
@@ -137,6 +192,7 @@ int webserver_register_file(const char *path, const char *content_type)
 	}
 	entry->virtual_fname = path;
 	entry->content_type = content_type;
+	entry->generate = NULL;
 	entry->next = virtual_files;
 	virtual_files = entry;
 
@@ -149,7 +205,15 @@ static VD_GET_INFO_CALLBACK(webserver_get_info, filename, info, cookie)
 
 	while (virtfile != NULL) {
 		if (strcmp(filename, virtfile->virtual_fname) == 0) {
-			UpnpFileInfo_set_FileLength(info, virtfile->len);
+			size_t len = virtfile->len;
+			if (virtfile->generate) {
+				free(generated_content_);
+				generated_content_ = virtfile->generate();
+				generated_fname_ = virtfile->virtual_fname;
+				len = (generated_content_
+				       ? strlen(generated_content_) : 0);
+			}
+			UpnpFileInfo_set_FileLength(info, len);
 			UpnpFileInfo_set_LastModified(info, 0);
 			UpnpFileInfo_set_IsDirectory(info, 0);
 			UpnpFileInfo_set_IsReadable(info, 1);
@@ -157,7 +221,7 @@ static VD_GET_INFO_CALLBACK(webserver_get_info, filename, info, cookie)
 				ixmlCloneDOMString(virtfile->content_type);
 			UpnpFileInfo_set_ContentType(info, (char*) contentType);
 			Log_info("webserver", "Access %s (%s) len=%zd",
-				 filename, contentType, virtfile->len);
+				 filename, contentType, len);
 			return 0;
 		}
 		virtfile = virtfile->next;
@@ -184,6 +248,20 @@ static VD_OPEN_CALLBACK(webserver_open, filename, mode, cookie)
 			file->pos = 0;
 			file->len = vf->len;
 			file->contents = vf->contents;
+			file->allocated = NULL;
+			if (vf->generate) {
+				// Normally prepared in webserver_get_info()
+				if (generated_fname_ == vf->virtual_fname
+				    && generated_content_ != NULL) {
+					file->allocated = generated_content_;
+					generated_content_ = NULL;
+				} else {
+					file->allocated = vf->generate();
+				}
+				file->contents = file->allocated;
+				file->len = (file->allocated
+					     ? strlen(file->allocated) : 0);
+			}
 			return file;
 		}
 	}
@@ -251,6 +329,7 @@ static VD_CLOSE_CALLBACK(webserver_close, fh, cookie)
 {
 	WebServerFile *file = (WebServerFile *) fh;
 
+	free(file->allocated);
 	free(file);
 
 	return 0;
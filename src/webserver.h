@@ -29,9 +29,18 @@
 // Start the webserver with the registered files.
 gboolean webserver_register_callbacks(void);
 
+// Registering a path a second time keeps the first one; renderers share
+// their icons and SCPDs that way.
 int webserver_register_buf(const char *path, const char *contents,
                            const char *content_type);
 int webserver_register_file(const char *path,
                             const char *content_type);
 
+// Register a file whose content is created by calling "generate" on each
+// request. The function returns a malloc()ed string that we free.
+typedef char *(*webserver_generator_t)(void);
+int webserver_register_generator(const char *path,
+				 webserver_generator_t generate,
+				 const char *content_type);
+
 #endif /* _WEBSERVER_H */
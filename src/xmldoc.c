@@ -125,6 +125,27 @@ struct xmlelement *find_element_in_element(struct xmlelement *element,
 	return find_element((IXML_Node*) to_ielem(element), key);
 }
 
+struct xmlelement *find_next_element(struct xmlelement *element,
+				      const char *key) {
+	IXML_Node *node = (IXML_Node*) to_ielem(element);
+	node = ixmlNode_getNextSibling(node);
+	for (/**/; node != NULL; node = ixmlNode_getNextSibling(node)) {
+		if (strcmp(ixmlNode_getNodeName(node), key) == 0) {
+			return (struct xmlelement*) node;
+		}
+	}
+	return NULL;
+}
+
+char *xmlelement_tostring(struct xmlelement *element) {
+	return ixmlNodetoString((IXML_Node*) to_ielem(element));
+}
+
+char *get_attribute_value(struct xmlelement *element, const char *name) {
+	const char *value = ixmlElement_getAttribute(to_ielem(element), name);
+	return value != NULL ? strdup(value) : NULL;
+}
+
 char *get_node_value(struct xmlelement *element) {
 	IXML_Node *node = (IXML_Node*) to_ielem(element);
 	node = ixmlNode_getFirstChild(node);
@@ -61,9 +61,20 @@ struct xmlelement *find_element_in_doc(struct xmldoc *doc,
 struct xmlelement *find_element_in_element(struct xmlelement *element,
 					   const char *key);
 
+// Find the next sibling of "element" with the given name, or NULL.
+struct xmlelement *find_next_element(struct xmlelement *element,
+				      const char *key);
+
 // Returns a newly allocated string representing the element value.
 char *get_node_value(struct xmlelement *element);
 
+// Returns a newly allocated string with the element serialized as XML.
+char *xmlelement_tostring(struct xmlelement *element);
+
+// Returns a newly allocated string with the value of the attribute or NULL
+// if the element does not have such an attribute.
+char *get_attribute_value(struct xmlelement *element, const char *name);
+
 struct xmlelement *add_attributevalue_element(struct xmldoc *doc,
 					      struct xmlelement *parent,
 					      const char *tagname,